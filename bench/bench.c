@@ -69,6 +69,17 @@ random_double(struct rng *rng, unsigned int n, double *p)
                 *p++ = d;
 #elif defined(BENCH_DOUBLE_INTEGER)
                 *p++ = (double)rng_rand_u32(rng);
+#elif defined(BENCH_DOUBLE_REPEATED)
+                /*
+                 * a few distinct values like quantized gauges and
+                 * percentages, with many zeros.
+                 */
+                uint32_t r = rng_rand_u32(rng);
+                if (r % 4 == 0) {
+                        *p++ = 0;
+                } else {
+                        *p++ = (double)((r >> 2) % 8) * 12.5 / 100;
+                }
 #else
                 double d;
                 do {
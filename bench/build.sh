@@ -18,7 +18,39 @@ bench.c \
 rng.c \
 jsonsink.c \
 ${JSONSINK}/jsonsink.c \
-${JSONSINK}/jsonsink_serialization.c
+${JSONSINK}/jsonsink_serialization.c \
+${JSONSINK}/jsonsink_itoa.c
+
+# micro benchmarks. use the simd instructions available on this machine.
+${CC} \
+-march=native \
+-o micro \
+-I ${JSONSINK} \
+micro.c \
+rng.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_base64.c \
+${JSONSINK}/jsonsink_itoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_timestamp.c \
+${JSONSINK}/jsonsink_ids.c \
+${JSONSINK}/jsonsink_escape.c
+
+# fd sink vs fwrite. (see fdsink.c)
+${CC} \
+-o fdsink \
+-I ${JSONSINK} \
+fdsink.c \
+rng.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_itoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_fd.c \
+${JSONSINK}/jsonsink_mmap.c \
+${JSONSINK}/jsonsink_ring.c \
+${JSONSINK}/jsonsink_uring.c
 
 LJSON=deps/ljson
 ${CC} \
@@ -31,8 +63,64 @@ rng.c \
 jsonsink.c \
 ${JSONSINK}/jsonsink.c \
 ${JSONSINK}/jsonsink_serialization_jnum.c \
+${JSONSINK}/jsonsink_itoa.c \
 ${LJSON}/jnum.c
 
+${CC} \
+-D JSONSINK_BENCH_DTOA \
+-o jsonsink-dtoa \
+-I ${JSONSINK} \
+bench.c \
+rng.c \
+jsonsink.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_itoa.c
+
+# the same as jsonsink-dtoa, but with jsonsink_add_double_array.
+${CC} \
+-D JSONSINK_BENCH_DTOA_ARRAY \
+-o jsonsink-dtoa-array \
+-I ${JSONSINK} \
+bench.c \
+rng.c \
+jsonsink.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_array.c \
+${JSONSINK}/jsonsink_itoa.c
+
+# the same as jsonsink-dtoa, but with jsonsink_add_double_cached.
+${CC} \
+-D JSONSINK_BENCH_DOUBLE_CACHED \
+-o jsonsink-dtoa-cached \
+-I ${JSONSINK} \
+bench.c \
+rng.c \
+jsonsink.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_double_cache.c \
+${JSONSINK}/jsonsink_itoa.c
+
+# precision-limited output. not in run.sh's quick test as the output differs.
+for v in FIXED SIG; do
+${CC} \
+-D JSONSINK_BENCH_DOUBLE_${v} \
+-o jsonsink-dtoa-$(echo ${v} | tr A-Z a-z) \
+-I ${JSONSINK} \
+bench.c \
+rng.c \
+jsonsink.c \
+${JSONSINK}/jsonsink.c \
+${JSONSINK}/jsonsink_serialization_dtoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_itoa.c
+done
+
 FPCONV=deps/fpconv/src
 ${CC} \
 -D JSONSINK_BENCH_FPCONV \
@@ -44,6 +132,7 @@ rng.c \
 jsonsink.c \
 ${JSONSINK}/jsonsink.c \
 ${JSONSINK}/jsonsink_serialization_fpconv.c \
+${JSONSINK}/jsonsink_itoa.c \
 ${FPCONV}/fpconv.c
 
 ${CC} \
@@ -0,0 +1,402 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * compare the output to a file descriptor:
+ *
+ * - fwrite: a 64-byte static buffer with a flush callback calling
+ *   fwrite. (like test_with_static_buffer in jsonsink.c)
+ * - fd: jsonsink_fd with the default buffer size.
+ * - uring: jsonsink_uring with the default buffers. (linux)
+ * - mmap: jsonsink_mmap with the default window. (file only)
+ * - direct: jsonsink_uring_init_direct with O_DIRECT. (linux, file only)
+ * - ring: jsonsink_ring with the default size. a child process writes
+ *   the data from the ring. (linux)
+ *
+ * and, for records with a large pre-serialized value:
+ *
+ * - fd-blob: jsonsink_fd, which copies the value into its buffer.
+ * - sg-blob: jsonsink_sg, which passes the value to writev.
+ *
+ * usage: fdsink file|pipe
+ *
+ * "file" writes to a temporary file. "pipe" writes to a pipe drained by
+ * a child process.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* O_DIRECT */
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+#include "rng.h"
+
+#define NRECORDS 1000000
+#define NBLOBRECORDS 10000
+#define BLOBSIZE 65536
+
+struct sink {
+        struct jsonsink s;
+        FILE *fp;
+};
+
+static bool
+flush(struct jsonsink *s, size_t needed)
+{
+        const struct sink *sink = (void *)s;
+        size_t nwritten = fwrite(s->buf, 1, s->bufpos, sink->fp);
+        if (nwritten != s->bufpos) {
+                return false;
+        }
+        s->bufpos = 0;
+        return true;
+}
+
+static void
+build(struct jsonsink *s)
+{
+        struct rng rng;
+        unsigned int i;
+        rng_init(&rng, 0x12345678);
+        jsonsink_array_start(s);
+        for (i = 0; i < NRECORDS; i++) {
+                jsonsink_object_start(s);
+                JSONSINK_ADD_LITERAL_KEY(s, "id");
+                jsonsink_add_uint32(s, i);
+                JSONSINK_ADD_LITERAL_KEY(s, "u32");
+                jsonsink_add_uint32(s, rng_rand_u32(&rng));
+                JSONSINK_ADD_LITERAL_KEY(s, "status");
+                JSONSINK_ADD_LITERAL_STRING(s, "ok");
+                JSONSINK_ADD_LITERAL_KEY(s, "double");
+                jsonsink_add_double(s,
+                                    (double)(int32_t)rng_rand_u32(&rng) /
+                                            100000);
+                jsonsink_object_end(s);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * build_blob: records with a BLOBSIZE-byte string value.
+ */
+
+static void
+build_blob(struct jsonsink *s,
+           void (*add_value)(struct jsonsink *, const char *, size_t))
+{
+        static char blob[BLOBSIZE];
+        unsigned int i;
+        memset(blob, 'x', sizeof(blob));
+        blob[0] = blob[sizeof(blob) - 1] = '"';
+        jsonsink_array_start(s);
+        for (i = 0; i < NBLOBRECORDS; i++) {
+                jsonsink_object_start(s);
+                JSONSINK_ADD_LITERAL_KEY(s, "id");
+                jsonsink_add_uint32(s, i);
+                JSONSINK_ADD_LITERAL_KEY(s, "blob");
+                add_value(s, blob, sizeof(blob));
+                jsonsink_object_end(s);
+        }
+        jsonsink_array_end(s);
+}
+
+static double
+now(void)
+{
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+                fprintf(stderr, "clock_gettime failed\n");
+                exit(1);
+        }
+        return ts.tv_sec * 1.0 + ts.tv_nsec / 1000000000.0;
+}
+
+static void
+run_fwrite(int fd)
+{
+        struct sink sink;
+        char buf[JSONSINK_MAX_RESERVATION];
+        struct jsonsink *s = &sink.s;
+        sink.fp = fdopen(fd, "w");
+        if (sink.fp == NULL) {
+                fprintf(stderr, "fdopen failed\n");
+                exit(1);
+        }
+        jsonsink_init(s);
+        jsonsink_set_buffer(s, buf, sizeof(buf));
+        s->flush = flush;
+        build(s);
+        jsonsink_flush(s, 0);
+        if (jsonsink_error(s) != JSONSINK_OK || fclose(sink.fp) != 0) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+}
+
+static void
+run_fd(int fd)
+{
+        struct jsonsink_fd fs;
+        if (!jsonsink_fd_init(&fs, fd, 0)) {
+                fprintf(stderr, "jsonsink_fd_init failed\n");
+                exit(1);
+        }
+        build(&fs.s);
+        if (!jsonsink_fd_finish(&fs)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_fd_destroy(&fs);
+        close(fd);
+}
+
+#if defined(__linux__)
+static void
+run_uring(int fd)
+{
+        struct jsonsink_uring u;
+        if (!jsonsink_uring_init(&u, fd, 0, 0)) {
+                fprintf(stderr, "jsonsink_uring_init failed\n");
+                exit(1);
+        }
+        build(&u.s);
+        if (!jsonsink_uring_finish(&u)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_uring_destroy(&u);
+        close(fd);
+}
+
+static void
+run_direct(int fd)
+{
+        struct jsonsink_uring u;
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_DIRECT) == -1) {
+                fprintf(stderr, "O_DIRECT is not supported\n");
+                exit(1);
+        }
+        if (!jsonsink_uring_init_direct(&u, fd, 0, 0)) {
+                fprintf(stderr, "jsonsink_uring_init_direct failed\n");
+                exit(1);
+        }
+        build(&u.s);
+        if (!jsonsink_uring_finish(&u)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_uring_destroy(&u);
+        close(fd);
+}
+
+static void
+run_ring(int fd)
+{
+        struct jsonsink_ring r;
+        if (!jsonsink_ring_init(&r, 0)) {
+                fprintf(stderr, "jsonsink_ring_init failed\n");
+                exit(1);
+        }
+        pid_t pid = fork();
+        if (pid == -1) {
+                fprintf(stderr, "fork failed\n");
+                exit(1);
+        }
+        if (pid == 0) {
+                const void *p;
+                size_t len;
+                while ((len = jsonsink_ring_read(&r, &p)) > 0) {
+                        ssize_t ret = write(fd, p, len);
+                        if (ret == -1) {
+                                _exit(1);
+                        }
+                        jsonsink_ring_consume(&r, ret);
+                }
+                _exit(0);
+        }
+        close(fd);
+        build(&r.s);
+        jsonsink_ring_finish(&r);
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_ring_destroy(&r);
+}
+#endif
+
+static void
+run_mmap(int fd)
+{
+        struct jsonsink_mmap m;
+        if (!jsonsink_mmap_init(&m, fd, 0)) {
+                fprintf(stderr, "jsonsink_mmap_init failed\n");
+                exit(1);
+        }
+        build(&m.s);
+        if (!jsonsink_mmap_finish(&m)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_mmap_destroy(&m);
+        close(fd);
+}
+
+static void
+run_fd_blob(int fd)
+{
+        struct jsonsink_fd fs;
+        if (!jsonsink_fd_init(&fs, fd, 0)) {
+                fprintf(stderr, "jsonsink_fd_init failed\n");
+                exit(1);
+        }
+        build_blob(&fs.s, jsonsink_add_serialized_value);
+        if (!jsonsink_fd_finish(&fs)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_fd_destroy(&fs);
+        close(fd);
+}
+
+static void
+sg_add_value(struct jsonsink *s, const char *p, size_t len)
+{
+        jsonsink_sg_add_serialized_value((void *)s, p, len);
+}
+
+static void
+run_sg_blob(int fd)
+{
+        struct jsonsink_sg sg;
+        if (!jsonsink_sg_init(&sg, fd, 0, 0)) {
+                fprintf(stderr, "jsonsink_sg_init failed\n");
+                exit(1);
+        }
+        build_blob(&sg.s, sg_add_value);
+        if (!jsonsink_sg_finish(&sg)) {
+                fprintf(stderr, "write error\n");
+                exit(1);
+        }
+        jsonsink_sg_destroy(&sg);
+        close(fd);
+}
+
+/*
+ * open_target: open the output. for pipes, `*pidp` is the reader.
+ */
+
+static int
+open_target(bool use_pipe, pid_t *pidp)
+{
+        if (!use_pipe) {
+                char path[] = "/tmp/fdsink.XXXXXX";
+                int fd = mkstemp(path);
+                if (fd == -1) {
+                        fprintf(stderr, "mkstemp failed\n");
+                        exit(1);
+                }
+                unlink(path);
+                *pidp = -1;
+                return fd;
+        }
+        int fds[2];
+        if (pipe(fds) != 0) {
+                fprintf(stderr, "pipe failed\n");
+                exit(1);
+        }
+        pid_t pid = fork();
+        if (pid == -1) {
+                fprintf(stderr, "fork failed\n");
+                exit(1);
+        }
+        if (pid == 0) {
+                static char buf[65536];
+                close(fds[1]);
+                while (read(fds[0], buf, sizeof(buf)) > 0) {
+                }
+                _exit(0);
+        }
+        close(fds[0]);
+        *pidp = pid;
+        return fds[1];
+}
+
+int
+main(int argc, char **argv)
+{
+        static const struct {
+                const char *name;
+                void (*fn)(int fd);
+                unsigned int nrecords;
+                bool file_only;
+        } methods[] = {
+                {"fwrite", run_fwrite, NRECORDS},
+                {"fd", run_fd, NRECORDS},
+#if defined(__linux__)
+                {"uring", run_uring, NRECORDS},
+                {"direct", run_direct, NRECORDS, true},
+                {"ring", run_ring, NRECORDS},
+#endif
+                {"mmap", run_mmap, NRECORDS, true},
+                {"fd-blob", run_fd_blob, NBLOBRECORDS},
+                {"sg-blob", run_sg_blob, NBLOBRECORDS},
+        };
+        if (argc != 2 ||
+            (strcmp(argv[1], "file") != 0 && strcmp(argv[1], "pipe") != 0)) {
+                fprintf(stderr, "usage: fdsink file|pipe\n");
+                exit(2);
+        }
+        bool use_pipe = !strcmp(argv[1], "pipe");
+        unsigned int i;
+        for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+                if (use_pipe && methods[i].file_only) {
+                        continue;
+                }
+                pid_t pid;
+                int fd = open_target(use_pipe, &pid);
+                double start = now();
+                methods[i].fn(fd);
+                if (pid != -1) {
+                        waitpid(pid, NULL, 0);
+                }
+                double t = now() - start;
+                printf("%s, %s, %g records per second\n", argv[1],
+                       methods[i].name, methods[i].nrecords / t);
+        }
+}
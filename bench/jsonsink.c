@@ -24,6 +24,7 @@
  * SUCH DAMAGE.
  */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -47,6 +48,27 @@ flush(struct jsonsink *s, size_t needed)
         return true;
 }
 
+/*
+ * precision-limited variants of jsonsink+dtoa.
+ * note: their output is different from the other implementations.
+ */
+#if defined(JSONSINK_BENCH_DOUBLE_CACHED)
+/*
+ * smaller than the data set (ndata * 4 doubles in bench.c) so that
+ * the cache doesn't hide the cost of the formatting unless the values
+ * repeat. (BENCH_DOUBLE_REPEATED)
+ */
+static uint64_t double_cache_mem[64 * JSONSINK_DOUBLE_CACHE_ENTRY_SIZE / 8];
+static struct jsonsink_double_cache double_cache;
+#define ADD_DOUBLE(s, v) jsonsink_add_double_cached(s, &double_cache, v)
+#elif defined(JSONSINK_BENCH_DOUBLE_FIXED)
+#define ADD_DOUBLE(s, v) jsonsink_add_double_fixed(s, v, 3)
+#elif defined(JSONSINK_BENCH_DOUBLE_SIG)
+#define ADD_DOUBLE(s, v) jsonsink_add_double_sig(s, v, 6)
+#else
+#define ADD_DOUBLE(s, v) jsonsink_add_double(s, v)
+#endif
+
 static void
 build(struct jsonsink *s, unsigned int n, const double *data_double,
       const uint32_t *data_u32)
@@ -60,12 +82,17 @@ build(struct jsonsink *s, unsigned int n, const double *data_double,
                 JSONSINK_ADD_LITERAL_KEY(s, "u32");
                 jsonsink_add_uint32(s, *data_u32++);
                 JSONSINK_ADD_LITERAL_KEY(s, "double_array");
+#if defined(JSONSINK_BENCH_DTOA_ARRAY)
+                jsonsink_add_double_array(s, data_double, 4);
+                data_double += 4;
+#else
                 jsonsink_array_start(s);
-                jsonsink_add_double(s, *data_double++);
-                jsonsink_add_double(s, *data_double++);
-                jsonsink_add_double(s, *data_double++);
-                jsonsink_add_double(s, *data_double++);
+                ADD_DOUBLE(s, *data_double++);
+                ADD_DOUBLE(s, *data_double++);
+                ADD_DOUBLE(s, *data_double++);
+                ADD_DOUBLE(s, *data_double++);
                 jsonsink_array_end(s);
+#endif
                 jsonsink_object_end(s);
         }
         jsonsink_array_end(s);
@@ -208,6 +235,16 @@ out:
 #define NAME "jsonsink+jnum"
 #elif defined(JSONSINK_BENCH_FPCONV)
 #define NAME "jsonsink+fpconv"
+#elif defined(JSONSINK_BENCH_DOUBLE_FIXED)
+#define NAME "jsonsink+dtoa fixed 3"
+#elif defined(JSONSINK_BENCH_DOUBLE_SIG)
+#define NAME "jsonsink+dtoa sig 6"
+#elif defined(JSONSINK_BENCH_DTOA_ARRAY)
+#define NAME "jsonsink+dtoa array"
+#elif defined(JSONSINK_BENCH_DOUBLE_CACHED)
+#define NAME "jsonsink+dtoa cached"
+#elif defined(JSONSINK_BENCH_DTOA)
+#define NAME "jsonsink+dtoa"
 #else
 #define NAME "jsonsink+snprintf"
 #endif
@@ -215,9 +252,20 @@ out:
 void
 run_bench(void)
 {
+#if defined(JSONSINK_BENCH_DOUBLE_CACHED)
+        jsonsink_double_cache_init(&double_cache, double_cache_mem,
+                                   sizeof(double_cache_mem));
+#endif
         bench(NAME " (static buffer)", test_with_static_buffer);
         if (!test_run) {
                 bench(NAME " (two pass)", test_with_malloc);
                 bench(NAME " (realloc)", test_with_realloc);
         }
+#if defined(JSONSINK_BENCH_DOUBLE_CACHED)
+        if (!test_run) {
+                fprintf(stderr, "double cache: %" PRIu64 " hits, %" PRIu64
+                                " misses\n",
+                        double_cache.hits, double_cache.misses);
+        }
+#endif
 }
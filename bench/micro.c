@@ -0,0 +1,511 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * micro benchmarks for individual encoders.
+ *
+ * unlike bench.c, which measures the whole JSON generation, this measures
+ * the throughput of a single function over several payload sizes.
+ *
+ * usage: micro [name]
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "jsonsink.h"
+#include "rng.h"
+
+struct micro {
+        const char *name;
+        /* the size of an item. eg. 8 for int64 */
+        size_t itemsize;
+        /* the size of the output for the given input size */
+        size_t (*outsize)(size_t sz);
+        void (*fn)(struct jsonsink *s, const void *p, size_t sz);
+};
+
+static size_t
+base64_outsize(size_t sz)
+{
+        return (sz + 2) / 3 * 4 + 2 + JSONSINK_MAX_RESERVATION;
+}
+
+static void
+base64(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_base64(s, p, sz);
+}
+
+static void
+base64url(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_base64url(s, p, sz, false);
+}
+
+static size_t
+hex_outsize(size_t sz)
+{
+        return sz * 2 + 2 + JSONSINK_MAX_RESERVATION;
+}
+
+static void
+hex(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_hex(s, p, sz);
+}
+
+static size_t
+base32_outsize(size_t sz)
+{
+        return (sz + 4) / 5 * 8 + 2 + JSONSINK_MAX_RESERVATION;
+}
+
+static void
+base32(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_base32(s, p, sz);
+}
+
+static size_t
+int64_outsize(size_t sz)
+{
+        /* 20 digits and a comma */
+        return sz / 8 * 21 + 2 + JSONSINK_MAX_RESERVATION;
+}
+
+static void
+uint64(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                uint64_t v;
+                memcpy(&v, cp + i * 8, 8);
+                jsonsink_add_uint64(s, v);
+        }
+        jsonsink_array_end(s);
+}
+
+static void
+int64(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                int64_t v;
+                memcpy(&v, cp + i * 8, 8);
+                /* vary the number of digits */
+                v >>= v & 63;
+                jsonsink_add_int64(s, v);
+        }
+        jsonsink_array_end(s);
+}
+
+static size_t
+float_outsize(size_t sz)
+{
+        /* the longest number and a comma. enough for float32_as_double */
+        return sz / 4 * (JSONSINK_FORMAT_DOUBLE_MAXLEN + 1) + 2 +
+               JSONSINK_MAX_RESERVATION;
+}
+
+static void
+float32(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 4; i++) {
+                uint32_t u;
+                float v;
+                memcpy(&u, cp + i * 4, 4);
+                if ((u & 0x7f800000) == 0x7f800000) {
+                        u ^= 0x40000000; /* avoid nan and inf */
+                }
+                memcpy(&v, &u, 4);
+                jsonsink_add_float(s, v);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * the same float values as float32, but widened to double.
+ * to compare with jsonsink_add_double.
+ */
+
+static void
+float32_as_double(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 4; i++) {
+                uint32_t u;
+                float v;
+                memcpy(&u, cp + i * 4, 4);
+                if ((u & 0x7f800000) == 0x7f800000) {
+                        u ^= 0x40000000; /* avoid nan and inf */
+                }
+                memcpy(&v, &u, 4);
+                jsonsink_add_double(s, v);
+        }
+        jsonsink_array_end(s);
+}
+
+static size_t
+double_outsize(size_t sz)
+{
+        /* the longest double and a comma */
+        return sz / 8 * (JSONSINK_FORMAT_DOUBLE_MAXLEN + 1) + 2 +
+               JSONSINK_MAX_RESERVATION;
+}
+
+static void
+float64(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                uint64_t u;
+                double v;
+                memcpy(&u, cp + i * 8, 8);
+                if ((u & 0x7ff0000000000000) == 0x7ff0000000000000) {
+                        u ^= 0x4000000000000000; /* avoid nan and inf */
+                }
+                memcpy(&v, &u, 8);
+                jsonsink_add_double(s, v);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * money in cents, as jsonsink_add_decimal and as a double.
+ */
+
+static void
+decimal(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                int64_t v;
+                memcpy(&v, cp + i * 8, 8);
+                v >>= 32; /* up to about 20M dollars */
+                jsonsink_add_decimal(s, v, 2, false);
+        }
+        jsonsink_array_end(s);
+}
+
+static void
+decimal_as_double(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                int64_t v;
+                memcpy(&v, cp + i * 8, 8);
+                v >>= 32;
+                jsonsink_add_double(s, (double)v / 100);
+        }
+        jsonsink_array_end(s);
+}
+
+static size_t
+timestamp_outsize(size_t sz)
+{
+        /* a quoted timestamp and a comma */
+        return sz / 8 * (JSONSINK_FORMAT_TIMESTAMP_MAXLEN + 3) + 2 +
+               JSONSINK_MAX_RESERVATION;
+}
+
+/*
+ * a log-like sequence of timestamps, up to about 16ms apart.
+ */
+
+static void
+timestamp(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        int64_t t = 1792240496789123456;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 8; i++) {
+                uint64_t v;
+                memcpy(&v, cp + i * 8, 8);
+                t += v & 0xffffff;
+                jsonsink_add_timestamp_ns(s, t, 6);
+        }
+        jsonsink_array_end(s);
+}
+
+static size_t
+id_outsize(size_t sz)
+{
+        /* the longest is 18 bytes for 4 bytes. ("255.255.255.255",) */
+        return sz * 5 + 2 + JSONSINK_MAX_RESERVATION;
+}
+
+static void
+uuid(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 16; i++) {
+                jsonsink_add_uuid(s, cp + i * 16);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * the same as uuid, but with snprintf. for comparison.
+ */
+
+static void
+uuid_snprintf(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 16; i++) {
+                const uint8_t *a = cp + i * 16;
+                char buf[37];
+                int n = snprintf(buf, sizeof(buf),
+                                 "%02x%02x%02x%02x-%02x%02x-%02x%02x-"
+                                 "%02x%02x-%02x%02x%02x%02x%02x%02x",
+                                 a[0], a[1], a[2], a[3], a[4], a[5], a[6],
+                                 a[7], a[8], a[9], a[10], a[11], a[12],
+                                 a[13], a[14], a[15]);
+                jsonsink_add_escaped_string(s, buf, n);
+        }
+        jsonsink_array_end(s);
+}
+
+static void
+ipv4(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 4; i++) {
+                jsonsink_add_ipv4(s, cp + i * 4);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * zero some of the fields to exercise the "::" compression.
+ */
+
+static void
+make_ipv6(uint8_t *a, const uint8_t *p)
+{
+        unsigned int j;
+        memcpy(a, p, 16);
+        for (j = 0; j < 8; j++) {
+                if ((p[0] >> j & 1) != 0) {
+                        a[j * 2] = a[j * 2 + 1] = 0;
+                }
+        }
+}
+
+static void
+ipv6(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 16; i++) {
+                uint8_t a[16];
+                make_ipv6(a, cp + i * 16);
+                jsonsink_add_ipv6(s, a);
+        }
+        jsonsink_array_end(s);
+}
+
+static void
+ipv6_inet_ntop(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 16; i++) {
+                uint8_t a[16];
+                char buf[INET6_ADDRSTRLEN];
+                make_ipv6(a, cp + i * 16);
+                inet_ntop(AF_INET6, a, buf, sizeof(buf));
+                jsonsink_add_escaped_string(s, buf, strlen(buf));
+        }
+        jsonsink_array_end(s);
+}
+
+static void
+mac(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t i;
+        jsonsink_array_start(s);
+        for (i = 0; i < sz / 6; i++) {
+                jsonsink_add_mac(s, cp + i * 6);
+        }
+        jsonsink_array_end(s);
+}
+
+static const struct micro micros[] = {
+        {"base64", 1, base64_outsize, base64},
+        {"base64url", 1, base64_outsize, base64url},
+        {"hex", 1, hex_outsize, hex},
+        {"base32", 1, base32_outsize, base32},
+        {"uint64", 8, int64_outsize, uint64},
+        {"int64", 8, int64_outsize, int64},
+        {"float", 4, float_outsize, float32},
+        {"float_as_double", 4, float_outsize, float32_as_double},
+        {"double", 8, double_outsize, float64},
+        {"decimal", 8, double_outsize, decimal},
+        {"decimal_as_double", 8, double_outsize, decimal_as_double},
+        {"timestamp", 8, timestamp_outsize, timestamp},
+        {"uuid", 16, id_outsize, uuid},
+        {"uuid_snprintf", 16, id_outsize, uuid_snprintf},
+        {"ipv4", 4, id_outsize, ipv4},
+        {"ipv6", 16, id_outsize, ipv6},
+        {"ipv6_inet_ntop", 16, id_outsize, ipv6_inet_ntop},
+        {"mac", 6, id_outsize, mac},
+};
+
+static const size_t sizes[] = {
+        16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576,
+};
+
+static uint64_t
+cycles(void)
+{
+#if defined(HAVE_RDTSC)
+        /* note: this counts the reference cycles */
+        return __rdtsc();
+#else
+        return 0;
+#endif
+}
+
+static double
+now(void)
+{
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+                fprintf(stderr, "clock_gettime failed\n");
+                exit(1);
+        }
+        return ts.tv_sec * 1.0 + ts.tv_nsec / 1000000000.0;
+}
+
+static void
+run(const struct micro *m, const uint8_t *data)
+{
+        unsigned int i;
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                size_t sz = sizes[i];
+                size_t buflen = m->outsize(sz);
+                void *buf = malloc(buflen);
+                if (buf == NULL) {
+                        fprintf(stderr, "malloc failed\n");
+                        exit(1);
+                }
+                /* process about 1GB in total */
+                uint64_t n = ((uint64_t)1 << 30) / sz;
+                uint64_t j;
+                struct jsonsink s;
+                jsonsink_init(&s);
+
+                double start_sec = now();
+                uint64_t start_cycles = cycles();
+                for (j = 0; j < n; j++) {
+                        jsonsink_set_buffer(&s, buf, buflen);
+                        m->fn(&s, data, sz);
+                }
+                uint64_t end_cycles = cycles();
+                double end_sec = now();
+                if (jsonsink_error(&s) != JSONSINK_OK) {
+                        fprintf(stderr, "jsonsink error: %d\n",
+                                jsonsink_error(&s));
+                        exit(1);
+                }
+                free(buf);
+
+                double bytes = (double)n * sz;
+                double bpc = 0;
+                if (end_cycles != start_cycles) {
+                        bpc = bytes / (end_cycles - start_cycles);
+                }
+                printf("%s, %zu, %g, %g, %g\n", m->name, sz, bpc,
+                       bytes / (end_sec - start_sec) / 1000000000.0,
+                       (end_sec - start_sec) * 1000000000.0 /
+                               (bytes / m->itemsize));
+        }
+}
+
+int
+main(int argc, char **argv)
+{
+        const size_t maxsize = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+        uint8_t *data = malloc(maxsize);
+        if (data == NULL) {
+                fprintf(stderr, "malloc failed\n");
+                exit(1);
+        }
+        struct rng rng;
+        rng_init(&rng, 0x12345678);
+        size_t i;
+        for (i = 0; i < maxsize; i++) {
+                data[i] = rng_rand_u32(&rng);
+        }
+
+        printf("name, size, bytes per cycle, GB per second, "
+               "ns per item\n");
+        for (i = 0; i < sizeof(micros) / sizeof(micros[0]); i++) {
+                const struct micro *m = &micros[i];
+                if (argc > 1 && strcmp(argv[1], m->name)) {
+                        continue;
+                }
+                run(m, data);
+        }
+        free(data);
+}
@@ -0,0 +1,728 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * a conformance and throughput harness for the number formatting.
+ *
+ * this is built once for each serialization backend. (see numcheck.sh)
+ * for each distribution of values, it checks:
+ *
+ * - the output is a valid JSON number.
+ * - the output reads back to the same value with strtod/strtof/strtoll.
+ * - for doubles, the number of significant digits compared to the
+ *   shortest round-trip representation, which is computed independently
+ *   from the backends: the smallest precision for which "%.*g" reads
+ *   back to the same value.
+ *   more digits are an error for the backends which are supposed to
+ *   produce the shortest representations (dtoa and jnum) and only
+ *   reported for the others. (snprintf, and fpconv whose Grisu2
+ *   doesn't always find the shortest) fewer digits are only reported.
+ *   they can legitimately happen at the power-of-2 boundaries, where a
+ *   value other than the nearest one of the same length reads back.
+ *
+ * and reports ns and bytes per value.
+ *
+ * usage:
+ *   numcheck [n]       check and benchmark n values per distribution
+ *   numcheck --dump    print the formatted values, one per line
+ *   numcheck --compare ref out
+ *                      compare two --dump outputs by value. the
+ *                      notation can differ between backends. (eg.
+ *                      "1e21" and "1e+21") the values must be the
+ *                      same and the numbers of significant digits
+ *                      are checked as above.
+ *
+ * the exit status is non-zero if any error is found.
+ */
+
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "jsonsink.h"
+#include "rng.h"
+
+#if defined(NUMCHECK_JNUM)
+#define BACKEND "jnum"
+#define SHORTEST true
+#elif defined(NUMCHECK_FPCONV)
+#define BACKEND "fpconv"
+#define SHORTEST false
+#elif defined(NUMCHECK_DTOA)
+#define BACKEND "dtoa"
+#define SHORTEST true
+#else
+#define BACKEND "snprintf"
+#define SHORTEST false
+#endif
+
+enum kind {
+        KIND_DOUBLE,
+        KIND_FLOAT,
+        KIND_INT64,
+};
+
+struct dist {
+        const char *name;
+        enum kind kind;
+        void (*gen)(struct rng *rng, size_t n, void *p);
+};
+
+struct result {
+        uint64_t invalid;
+        uint64_t mismatch;
+        uint64_t longer;
+        uint64_t shorter;
+};
+
+static uint64_t
+rand_u64(struct rng *rng)
+{
+        return ((uint64_t)rng_rand_u32(rng) << 32) | rng_rand_u32(rng);
+}
+
+/*
+ * distributions
+ */
+
+static const double double_edges[] = {
+        0,
+        -0.0,
+        5e-324,
+        -5e-324,
+        DBL_MIN,
+        0x1.fffffffffffffp-1023, /* the largest subnormal */
+        DBL_MAX,
+        -DBL_MAX,
+        DBL_EPSILON,
+        1,
+        -1,
+        0.1,
+        0.2,
+        0.3,
+        1.0 / 3,
+        2.0 / 3,
+        9007199254740991.0, /* 2^53 - 1 */
+        9007199254740992.0,
+        9007199254740994.0,
+        1e15,
+        1e16,
+        1e21,
+        1e22,
+        1e23,
+        123456789012345678e3,
+        1e-5,
+        1e-6,
+        1e-7,
+        5e-7,
+        0.000001234,
+        2.2250738585072011e-308,
+        1.7976931348623157e308,
+        4.9406564584124654e-324,
+        0x1p-1022,
+        0x1p-1074,
+        0x1p1023,
+        0x1.0000000000001p0,
+        0x1.fffffffffffffp0,
+        1.5e300,
+        -123.456,
+};
+
+static const double double_scales[] = {
+        1, 10, 100, 1000, 1e10, 1e20, 1e100, 1e-10, 1e-100, 1e-300,
+};
+
+static void
+gen_double_edge(struct rng *rng, size_t n, void *p)
+{
+        const size_t nedges = sizeof(double_edges) / sizeof(double_edges[0]);
+        double *d = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                double v = double_edges[i % nedges];
+                if (i >= nedges) {
+                        /* the neighbors of the edges and powers of 10 */
+                        uint32_t r = rng_rand_u32(rng);
+                        if ((r & 1) != 0) {
+                                v = pow(10, (int)(r >> 1) % 617 - 308);
+                        }
+                        v = nextafter(v, (r & 2) != 0 ? INFINITY : -INFINITY);
+                        if (isinf(v)) {
+                                v = DBL_MAX;
+                        }
+                }
+                d[i] = v;
+        }
+}
+
+static void
+gen_double_bits(struct rng *rng, size_t n, void *p)
+{
+        double *d = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                double v;
+                do {
+                        uint64_t u = rand_u64(rng);
+                        memcpy(&v, &u, sizeof(v));
+                } while (isnan(v) || isinf(v));
+                d[i] = v;
+        }
+}
+
+/* the same distribution as bench.c */
+static void
+gen_double_uniform(struct rng *rng, size_t n, void *p)
+{
+        double *d = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                d[i] = (double)(int32_t)rng_rand_u32(rng) / 100000;
+        }
+}
+
+/* short decimals like measurements and prices */
+static void
+gen_double_decimal(struct rng *rng, size_t n, void *p)
+{
+        double *d = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                uint32_t r = rng_rand_u32(rng);
+                d[i] = (double)(r % 100000) /
+                       double_scales[(r >> 20) % 4] /
+                       (double)((r >> 24) % 2 ? 100 : 1);
+        }
+}
+
+static void
+gen_double_integer(struct rng *rng, size_t n, void *p)
+{
+        double *d = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                uint64_t u = rand_u64(rng);
+                d[i] = (double)(int64_t)(u >> (u & 63));
+        }
+}
+
+static void
+gen_float_bits(struct rng *rng, size_t n, void *p)
+{
+        float *f = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                float v;
+                do {
+                        uint32_t u = rng_rand_u32(rng);
+                        memcpy(&v, &u, sizeof(v));
+                } while (isnan(v) || isinf(v));
+                f[i] = v;
+        }
+}
+
+static void
+gen_int64(struct rng *rng, size_t n, void *p)
+{
+        int64_t *v = p;
+        size_t i;
+        for (i = 0; i < n; i++) {
+                uint64_t u = rand_u64(rng);
+                v[i] = (int64_t)u >> (u & 63);
+        }
+        if (n >= 2) {
+                v[0] = INT64_MIN;
+                v[1] = INT64_MAX;
+        }
+}
+
+static const struct dist dists[] = {
+        {"double-edge", KIND_DOUBLE, gen_double_edge},
+        {"double-bits", KIND_DOUBLE, gen_double_bits},
+        {"double-uniform", KIND_DOUBLE, gen_double_uniform},
+        {"double-decimal", KIND_DOUBLE, gen_double_decimal},
+        {"double-integer", KIND_DOUBLE, gen_double_integer},
+        {"float-bits", KIND_FLOAT, gen_float_bits},
+        {"int64", KIND_INT64, gen_int64},
+};
+
+/*
+ * checks
+ */
+
+/*
+ * is_json_number: check the JSON number grammar. (RFC 8259 section 6)
+ */
+
+static bool
+is_json_number(const char *p, size_t len)
+{
+        const char *ep = p + len;
+        if (p < ep && *p == '-') {
+                p++;
+        }
+        if (p == ep) {
+                return false;
+        }
+        if (*p == '0') {
+                p++;
+        } else if (*p >= '1' && *p <= '9') {
+                while (p < ep && *p >= '0' && *p <= '9') {
+                        p++;
+                }
+        } else {
+                return false;
+        }
+        if (p < ep && *p == '.') {
+                p++;
+                if (p == ep || *p < '0' || *p > '9') {
+                        return false;
+                }
+                while (p < ep && *p >= '0' && *p <= '9') {
+                        p++;
+                }
+        }
+        if (p < ep && (*p == 'e' || *p == 'E')) {
+                p++;
+                if (p < ep && (*p == '+' || *p == '-')) {
+                        p++;
+                }
+                if (p == ep || *p < '0' || *p > '9') {
+                        return false;
+                }
+                while (p < ep && *p >= '0' && *p <= '9') {
+                        p++;
+                }
+        }
+        return p == ep;
+}
+
+/*
+ * significant_digits: the number of significant digits, ignoring
+ * leading and trailing zeros.
+ */
+
+static unsigned int
+significant_digits(const char *p, size_t len)
+{
+        unsigned int n = 0;
+        unsigned int zeros = 0;
+        bool leading = true;
+        size_t i;
+        for (i = 0; i < len; i++) {
+                char c = p[i];
+                if (c == 'e' || c == 'E') {
+                        break;
+                }
+                if (c < '0' || c > '9') {
+                        continue;
+                }
+                if (c == '0') {
+                        if (!leading) {
+                                zeros++;
+                        }
+                        continue;
+                }
+                leading = false;
+                n += zeros + 1;
+                zeros = 0;
+        }
+        return n;
+}
+
+static void
+add_value(struct jsonsink *s, enum kind kind, const void *values, size_t i)
+{
+        switch (kind) {
+        case KIND_DOUBLE:
+                jsonsink_add_double(s, ((const double *)values)[i]);
+                break;
+        case KIND_FLOAT:
+                jsonsink_add_float(s, ((const float *)values)[i]);
+                break;
+        case KIND_INT64:
+                jsonsink_add_int64(s, ((const int64_t *)values)[i]);
+                break;
+        }
+}
+
+/*
+ * format: format a single value with the backend. return the length.
+ */
+
+static size_t
+format(char *buf, size_t buflen, enum kind kind, const void *values,
+       size_t i)
+{
+        struct jsonsink s;
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, buf, buflen);
+        add_value(&s, kind, values, i);
+        if (jsonsink_error(&s) != JSONSINK_OK) {
+                return 0;
+        }
+        return jsonsink_size(&s);
+}
+
+static bool
+same_value(enum kind kind, const void *values, size_t i, const char *str)
+{
+        char *ep;
+        switch (kind) {
+        case KIND_DOUBLE: {
+                double v = strtod(str, &ep);
+                return *ep == 0 &&
+                       !memcmp(&v, &((const double *)values)[i], sizeof(v));
+        }
+        case KIND_FLOAT: {
+                float v = strtof(str, &ep);
+                return *ep == 0 &&
+                       !memcmp(&v, &((const float *)values)[i], sizeof(v));
+        }
+        default: {
+                long long v = strtoll(str, &ep, 10);
+                return *ep == 0 && v == ((const int64_t *)values)[i];
+        }
+        }
+}
+
+/*
+ * shortest_digits: the smallest precision for which "%.*g" reads back to
+ * the same value.
+ */
+
+static unsigned int
+shortest_digits(double v)
+{
+        char buf[32];
+        unsigned int p;
+        if (v == 0) {
+                /* as significant_digits counts no digits for zeros */
+                return 0;
+        }
+        for (p = 1; p < 17; p++) {
+                snprintf(buf, sizeof(buf), "%.*g", (int)p, v);
+                double v2 = strtod(buf, NULL);
+                if (!memcmp(&v, &v2, sizeof(v))) {
+                        break;
+                }
+        }
+        return p;
+}
+
+static void
+check(const struct dist *d, const void *values, size_t n, struct result *r)
+{
+        char buf[JSONSINK_MAX_RESERVATION + 1];
+        size_t i;
+
+        memset(r, 0, sizeof(*r));
+        for (i = 0; i < n; i++) {
+                size_t len = format(buf, sizeof(buf) - 1, d->kind, values, i);
+                buf[len] = 0;
+                if (len == 0 || !is_json_number(buf, len)) {
+                        if (r->invalid++ == 0) {
+                                fprintf(stderr, "%s: %s: invalid: \"%s\"\n",
+                                        BACKEND, d->name, buf);
+                        }
+                        continue;
+                }
+                if (!same_value(d->kind, values, i, buf)) {
+                        if (r->mismatch++ == 0) {
+                                fprintf(stderr,
+                                        "%s: %s: round-trip mismatch: %s\n",
+                                        BACKEND, d->name, buf);
+                        }
+                        continue;
+                }
+                if (d->kind == KIND_DOUBLE) {
+                        double v = ((const double *)values)[i];
+                        unsigned int a = significant_digits(buf, len);
+                        unsigned int b = shortest_digits(v);
+                        if (a > b) {
+                                if (r->longer++ == 0 && SHORTEST) {
+                                        fprintf(stderr,
+                                                "%s: %s: longer than the "
+                                                "reference: %s %.*g\n",
+                                                BACKEND, d->name, buf, (int)b,
+                                                v);
+                                }
+                        } else if (a < b) {
+                                r->shorter++;
+                        }
+                }
+        }
+}
+
+/*
+ * parse_dump_line: split a --dump line into the distribution and the
+ * formatted value.
+ */
+
+static const struct dist *
+parse_dump_line(char *line, char **valuep)
+{
+        line[strcspn(line, "\n")] = 0;
+        char *sp = strchr(line, ' ');
+        unsigned int i;
+        if (sp == NULL) {
+                return NULL;
+        }
+        *sp = 0;
+        *valuep = sp + 1;
+        for (i = 0; i < sizeof(dists) / sizeof(dists[0]); i++) {
+                if (!strcmp(dists[i].name, line)) {
+                        return &dists[i];
+                }
+        }
+        return NULL;
+}
+
+static bool
+same_parsed_value(enum kind kind, const char *a, const char *b)
+{
+        char *ep1;
+        char *ep2;
+        switch (kind) {
+        case KIND_DOUBLE: {
+                double v1 = strtod(a, &ep1);
+                double v2 = strtod(b, &ep2);
+                return ep1 != a && *ep1 == 0 && ep2 != b && *ep2 == 0 &&
+                       !memcmp(&v1, &v2, sizeof(v1));
+        }
+        case KIND_FLOAT: {
+                float v1 = strtof(a, &ep1);
+                float v2 = strtof(b, &ep2);
+                return ep1 != a && *ep1 == 0 && ep2 != b && *ep2 == 0 &&
+                       !memcmp(&v1, &v2, sizeof(v1));
+        }
+        default: {
+                long long v1 = strtoll(a, &ep1, 10);
+                long long v2 = strtoll(b, &ep2, 10);
+                return ep1 != a && *ep1 == 0 && ep2 != b && *ep2 == 0 &&
+                       v1 == v2;
+        }
+        }
+}
+
+/*
+ * compare: compare the --dump output of this backend (`path`) with the
+ * one of another backend (`refpath`) by value.
+ */
+
+static int
+compare(const char *refpath, const char *path)
+{
+        char refline[JSONSINK_MAX_RESERVATION + 64];
+        char line[JSONSINK_MAX_RESERVATION + 64];
+        struct result r;
+        uint64_t n = 0;
+        int ret = 0;
+
+        FILE *reffp = fopen(refpath, "r");
+        FILE *fp = fopen(path, "r");
+        if (reffp == NULL || fp == NULL) {
+                fprintf(stderr, "fopen failed\n");
+                exit(2);
+        }
+        memset(&r, 0, sizeof(r));
+        for (;;) {
+                bool refeof = fgets(refline, sizeof(refline), reffp) == NULL;
+                bool eof = fgets(line, sizeof(line), fp) == NULL;
+                if (refeof || eof) {
+                        if (refeof != eof) {
+                                fprintf(stderr, "%s: different number of "
+                                        "values\n", BACKEND);
+                                ret = 1;
+                        }
+                        break;
+                }
+                n++;
+                char *refvalue;
+                char *value;
+                const struct dist *d = parse_dump_line(refline, &refvalue);
+                const struct dist *d2 = parse_dump_line(line, &value);
+                if (d == NULL || d != d2) {
+                        fprintf(stderr, "%s: line %" PRIu64 ": malformed\n",
+                                BACKEND, n);
+                        ret = 1;
+                        break;
+                }
+                if (!same_parsed_value(d->kind, refvalue, value)) {
+                        if (r.mismatch++ == 0) {
+                                fprintf(stderr,
+                                        "%s: %s: value mismatch: %s %s\n",
+                                        BACKEND, d->name, refvalue, value);
+                        }
+                        continue;
+                }
+                if (d->kind == KIND_INT64) {
+                        continue;
+                }
+                unsigned int a = significant_digits(value, strlen(value));
+                unsigned int b = significant_digits(refvalue,
+                                                    strlen(refvalue));
+                if (a > b) {
+                        if (r.longer++ == 0 && SHORTEST) {
+                                fprintf(stderr,
+                                        "%s: %s: longer: %s %s\n",
+                                        BACKEND, d->name, refvalue, value);
+                        }
+                } else if (a < b) {
+                        r.shorter++;
+                }
+        }
+        fclose(reffp);
+        fclose(fp);
+        printf("%s, compared with the reference, %" PRIu64 " values, "
+               "mismatch %" PRIu64 ", longer %" PRIu64 ", shorter %" PRIu64
+               "\n", BACKEND, n, r.mismatch, r.longer, r.shorter);
+        if (r.mismatch != 0 || (SHORTEST && r.longer != 0)) {
+                ret = 1;
+        }
+        return ret;
+}
+
+static double
+now(void)
+{
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+                fprintf(stderr, "clock_gettime failed\n");
+                exit(1);
+        }
+        return ts.tv_sec * 1.0 + ts.tv_nsec / 1000000000.0;
+}
+
+/*
+ * measure: format all the values as an array. return the best time of
+ * a few runs in seconds and the output size via `sizep`.
+ */
+
+static double
+measure(const struct dist *d, const void *values, size_t n, void *buf,
+        size_t buflen, size_t *sizep)
+{
+        double best = 0;
+        unsigned int run;
+        for (run = 0; run < 5; run++) {
+                struct jsonsink s;
+                size_t i;
+                double start = now();
+                jsonsink_init(&s);
+                jsonsink_set_buffer(&s, buf, buflen);
+                jsonsink_array_start(&s);
+                for (i = 0; i < n; i++) {
+                        add_value(&s, d->kind, values, i);
+                }
+                jsonsink_array_end(&s);
+                double t = now() - start;
+                if (jsonsink_error(&s) != JSONSINK_OK) {
+                        fprintf(stderr, "jsonsink error: %d\n",
+                                jsonsink_error(&s));
+                        exit(1);
+                }
+                if (run == 0 || t < best) {
+                        best = t;
+                }
+                *sizep = jsonsink_size(&s);
+        }
+        return best;
+}
+
+int
+main(int argc, char **argv)
+{
+        bool dump = false;
+        size_t n = 1000000;
+        unsigned int i;
+        int ret = 0;
+
+        if (argc > 3 && !strcmp(argv[1], "--compare")) {
+                return compare(argv[2], argv[3]);
+        }
+        if (argc > 1 && !strcmp(argv[1], "--dump")) {
+                dump = true;
+                n = 100000;
+        } else if (argc > 1) {
+                n = strtoul(argv[1], NULL, 0);
+        }
+        if (n < 2) {
+                fprintf(stderr, "too few values\n");
+                exit(2);
+        }
+        void *values = malloc(n * sizeof(double));
+        size_t buflen = n * (JSONSINK_FORMAT_DOUBLE_MAXLEN + 1) +
+                        JSONSINK_MAX_RESERVATION;
+        void *buf = malloc(buflen);
+        if (values == NULL || buf == NULL) {
+                fprintf(stderr, "malloc failed\n");
+                exit(1);
+        }
+        if (!dump) {
+                printf("backend, distribution, ns per value, "
+                       "bytes per value, invalid, mismatch, longer, "
+                       "shorter\n");
+        }
+        for (i = 0; i < sizeof(dists) / sizeof(dists[0]); i++) {
+                const struct dist *d = &dists[i];
+                struct rng rng;
+                rng_init(&rng, 0x12345678 + i);
+                d->gen(&rng, n, values);
+                if (dump) {
+                        char str[JSONSINK_MAX_RESERVATION];
+                        size_t j;
+                        for (j = 0; j < n; j++) {
+                                size_t len = format(str, sizeof(str),
+                                                    d->kind, values, j);
+                                printf("%s %.*s\n", d->name, (int)len, str);
+                        }
+                        continue;
+                }
+                struct result r;
+                size_t size;
+                check(d, values, n, &r);
+                double t = measure(d, values, n, buf, buflen, &size);
+                /* exclude the brackets and the commas */
+                size -= n + 1;
+                printf("%s, %s, %.1f, %.2f, %" PRIu64 ", %" PRIu64
+                       ", %" PRIu64 ", %" PRIu64 "\n",
+                       BACKEND, d->name, t * 1e9 / n, (double)size / n,
+                       r.invalid, r.mismatch, r.longer, r.shorter);
+                if (r.invalid != 0 || r.mismatch != 0 ||
+                    (SHORTEST && r.longer != 0)) {
+                        ret = 1;
+                }
+        }
+        free(values);
+        free(buf);
+        return ret;
+}
@@ -0,0 +1,64 @@
+#! /bin/sh
+
+# build numcheck for each serialization backend, run it, and compare
+# the outputs of the backends.
+#
+# usage: numcheck.sh [n]
+#
+# the backends whose dependencies are not in deps/ are skipped.
+
+set -e
+
+JSONSINK=..
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -Wall}
+
+build() {
+	name=$1
+	shift
+	${CC} ${CFLAGS} \
+	-o numcheck-${name} \
+	-I ${JSONSINK} \
+	numcheck.c \
+	rng.c \
+	${JSONSINK}/jsonsink.c \
+	${JSONSINK}/jsonsink_itoa.c \
+	${JSONSINK}/jsonsink_dtoa.c \
+	"$@" \
+	-lm
+	BACKENDS="${BACKENDS} ${name}"
+}
+
+BACKENDS=
+build snprintf ${JSONSINK}/jsonsink_serialization.c
+build dtoa -D NUMCHECK_DTOA ${JSONSINK}/jsonsink_serialization_dtoa.c
+LJSON=deps/ljson
+if test -f ${LJSON}/jnum.c; then
+	build jnum -D NUMCHECK_JNUM -I ${LJSON} \
+	${JSONSINK}/jsonsink_serialization_jnum.c ${LJSON}/jnum.c
+fi
+FPCONV=deps/fpconv/src
+if test -f ${FPCONV}/fpconv.c; then
+	build fpconv -D NUMCHECK_FPCONV -I ${FPCONV} \
+	${JSONSINK}/jsonsink_serialization_fpconv.c ${FPCONV}/fpconv.c
+fi
+
+FAIL=0
+for b in ${BACKENDS}; do
+	./numcheck-${b} "$@" || FAIL=1
+done
+
+# compare the outputs with the dtoa one by value, as the notation
+# differs between the backends. (eg. "1e21" and "1e+21")
+TMP=$(mktemp -d)
+./numcheck-dtoa --dump > ${TMP}/dtoa.txt
+for b in ${BACKENDS}; do
+	if test ${b} = dtoa; then
+		continue
+	fi
+	./numcheck-${b} --dump > ${TMP}/${b}.txt
+	./numcheck-${b} --compare ${TMP}/dtoa.txt ${TMP}/${b}.txt || FAIL=1
+done
+rm -rf ${TMP}
+
+exit ${FAIL}
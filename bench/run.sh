@@ -1,4 +1,4 @@
-TESTS="jsonsink jsonsink-jnum jsonsink-fpconv snprintf ljson ljson_dom rapidjson cjson parson"
+TESTS="jsonsink jsonsink-dtoa jsonsink-dtoa-array jsonsink-dtoa-cached jsonsink-jnum jsonsink-fpconv snprintf ljson ljson_dom rapidjson cjson parson"
 
 # note: macOS's system openssl seems to have a bit differnt output format
 # from the homebrew version, which might be found in PATH.
@@ -39,3 +39,8 @@ for t in $TESTS; do
 	DYLD_INSERT_LIBRARIES=malloc_interposer.dylib ./$t
 done
 DYLD_INSERT_LIBRARIES=malloc_interposer.dylib ./flatbuffers
+
+# precision-limited variants. (not comparable with the above)
+for t in jsonsink-dtoa-fixed jsonsink-dtoa-sig; do
+	DYLD_INSERT_LIBRARIES=malloc_interposer.dylib ./$t
+done
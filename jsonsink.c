@@ -84,9 +84,29 @@ write_serialized(struct jsonsink *s, const void *value, size_t len)
         commit_buffer(s, len);
 }
 
+static void
+write_direct(struct jsonsink *s, const void *value, size_t len)
+{
+        JSONSINK_ASSERT(s->reserved == 0);
+        if (s->bufpos > 0) {
+                if (!jsonsink_flush(s, 0)) {
+                        return;
+                }
+                JSONSINK_ASSERT(s->bufpos == 0);
+        }
+        if (!s->write_direct(s, value, len)) {
+                set_error(s, JSONSINK_ERROR_FLUSH_FAILED);
+        }
+}
+
 static void
 write_serialized_chunked(struct jsonsink *s, const void *value, size_t len)
 {
+        if (s->write_direct != NULL && len >= s->direct_threshold &&
+            s->error == JSONSINK_OK) {
+                write_direct(s, value, len);
+                return;
+        }
         const uint8_t *p = value;
         const size_t maxchunksize = JSONSINK_MAX_RESERVATION;
         do {
@@ -294,6 +314,38 @@ jsonsink_reserve_buffer(struct jsonsink *s, size_t len)
         return reserve_buffer(s, len);
 }
 
+void *
+jsonsink_reserve_buffer_upto(struct jsonsink *s, size_t minlen, size_t maxlen,
+                             size_t *lenp)
+{
+        JSONSINK_ASSUME(0 < minlen && minlen <= maxlen);
+        JSONSINK_ASSUME(minlen <= JSONSINK_MAX_RESERVATION);
+        JSONSINK_ASSERT(s->reserved == 0);
+        size_t avail = 0;
+        if (s->bufpos <= s->buflen) {
+                avail = s->buflen - s->bufpos;
+        }
+        if (avail < minlen) {
+                if (s->flush == NULL || !jsonsink_flush(s, minlen)) {
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+                        s->reserved = maxlen;
+#endif
+                        *lenp = maxlen;
+                        return NULL;
+                }
+                avail = s->buflen - s->bufpos;
+        }
+        size_t len = maxlen;
+        if (len > avail) {
+                len = avail;
+        }
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+        s->reserved = len;
+#endif
+        *lenp = len;
+        return (char *)s->buf + s->bufpos;
+}
+
 void
 jsonsink_commit_buffer(struct jsonsink *s, size_t len)
 {
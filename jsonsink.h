@@ -35,7 +35,7 @@
 extern "C" {
 #endif
 
-#if !defined(JSONSINK_MAX_RESERVE)
+#if !defined(JSONSINK_MAX_RESERVATION)
 #define JSONSINK_MAX_RESERVATION 64 /* max reservation size in bytes */
 #endif
 
@@ -43,6 +43,10 @@ extern "C" {
 #define JSONSINK_ERROR_NO_BUFFER_SPACE 1
 #define JSONSINK_ERROR_FLUSH_FAILED 2
 #define JSONSINK_ERROR_SERIALIZATION 3
+#define JSONSINK_ERROR_INVALID_UTF8 4
+#define JSONSINK_ERROR_READ_FAILED 5
+
+struct jsonsink_escape_profile;
 
 struct jsonsink {
         /*
@@ -80,11 +84,33 @@ struct jsonsink {
          */
         bool (*flush)(struct jsonsink *s, size_t needed);
 
+        /*
+         * the optional `write_direct` callback is used to bypass the buffer
+         * for large data.
+         *
+         * when a serialized fragment (eg. jsonsink_add_serialized_value)
+         * of `direct_threshold` bytes or more is added, the data in the
+         * buffer is flushed with the `flush` callback first, and then the
+         * fragment is passed to this callback as it is, instead of being
+         * copied into the buffer piece by piece. the fragment is only
+         * valid during the call. it returns true on success.
+         *
+         * it's only for sinks whose `flush` callback empties the buffer.
+         * with 's->write_direct = NULL' (the default) the buffer is always
+         * used.
+         */
+        bool (*write_direct)(struct jsonsink *s, const void *p, size_t len);
+        size_t direct_threshold;
+
         /*
          * internal states. do not access them directly.
          */
         int error;
         bool need_comma;
+        const struct jsonsink_escape_profile *escape_profile;
+        uint8_t carry[3]; /* see jsonsink_string_append/base64_append */
+        uint8_t carrylen;
+        uint8_t stream_flags;
 
 #if defined(JSONSINK_ENABLE_ASSERTIONS)
         /*
@@ -218,6 +244,22 @@ void *jsonsink_reserve_buffer(struct jsonsink *s, size_t len);
 void jsonsink_commit_buffer(struct jsonsink *s, size_t len);
 void jsonsink_add_fragment(struct jsonsink *s, const char *frag, size_t len);
 
+/*
+ * jsonsink_reserve_buffer_upto: similar to jsonsink_reserve_buffer,
+ * but reserve as much of the buffer as available, up to `maxlen` bytes.
+ * at least `minlen` bytes are reserved. (0 < minlen <=
+ * JSONSINK_MAX_RESERVATION) the reserved size is returned via `lenp`.
+ *
+ * this is intended to be used by encoders which can produce a large
+ * output in one go.
+ *
+ * when it returns NULL, `*lenp` is set to `maxlen` so that the caller
+ * can account the whole output.
+ */
+
+void *jsonsink_reserve_buffer_upto(struct jsonsink *s, size_t minlen,
+                                   size_t maxlen, size_t *lenp);
+
 /*
  * the api to deal with serialized key/value.
  *
@@ -266,7 +308,8 @@ void jsonsink_add_escaped_string(struct jsonsink *s, const char *value,
  * serialization utility api
  *
  * implementation: jsonsink_serialization.c
- * alternative implementation: jsonsink_serialization_jnum.c
+ * alternative implementations: jsonsink_serialization_dtoa.c,
+ *                              jsonsink_serialization_jnum.c
  **************************************************************************/
 
 /*
@@ -276,14 +319,21 @@ void jsonsink_add_escaped_string(struct jsonsink *s, const char *value,
  * jsonsink_serialization.c just uses snprintf to convert values
  * to strings.
  *
+ * note: integers are not handled by these backends. see the "integers"
+ * section below.
+ *
  * if the performance of the string conversion is important, you might
  * want to use an optimized implemontation instead of snprintf.
  * cf.
  * - https://github.com/miloyip/dtoa-benchmark
  * - https://github.com/miloyip/itoa-benchmark
  *
+ * jsonsink_serialization_dtoa.c has an alternative implementation which
+ * uses the in-tree dtoa. (jsonsink_format_double below) it's far faster
+ * than snprintf and produces the shortest representation.
+ *
  * jsonsink_serialization_jnum.c has an alternative implementation which uses
- * itoa/dtoa functions from LJSON jnum.c, which is usually far faster
+ * the dtoa function from LJSON jnum.c, which is usually far faster
  * than snprintf.
  *
  * the advantage of the default snprintf implementation is the code size.
@@ -299,9 +349,304 @@ void jsonsink_add_escaped_string(struct jsonsink *s, const char *value,
  * [LJSON]: https://github.com/lengjingzju/json
  */
 
+void jsonsink_add_double(struct jsonsink *s, double v);
+
+/*
+ * jsonsink_format_double: write the shortest decimal representation of
+ * the value which rounds back to the same double, and return its length.
+ * the result is not NUL-terminated. `dst` should have
+ * JSONSINK_FORMAT_DOUBLE_MAXLEN bytes.
+ *
+ * the notation is the same as javascript's Number.prototype.toString.
+ * (eg. 100, 0.001, 1.5e+21) except that -0 is formatted as "-0".
+ *
+ * this is a self-contained implementation of the schubfach algorithm
+ * with a small (about 700 bytes) table. unlike jsonsink_add_double, it's
+ * available regardless of the serialization backend.
+ * jsonsink_serialization_dtoa.c is a backend which uses it.
+ *
+ * implementation: jsonsink_dtoa.c
+ */
+
+#define JSONSINK_FORMAT_DOUBLE_MAXLEN 25 /* -0.0000012345678901234567 */
+
+size_t jsonsink_format_double(char *dst, double v);
+
+/*
+ * jsonsink_format_float: similar to jsonsink_format_double, but for
+ * single precision values. the result is the shortest representation
+ * which rounds back to the same float. (eg. 0.1f is formatted as "0.1",
+ * not "0.10000000149011612" as the widened double would be)
+ *
+ * jsonsink_add_float: add a float value formatted with
+ * jsonsink_format_float. unlike jsonsink_add_double, it's not provided by
+ * the serialization backends.
+ *
+ * implementation: jsonsink_dtoa.c
+ */
+
+#define JSONSINK_FORMAT_FLOAT_MAXLEN 22 /* -100000000000000000000 */
+
+size_t jsonsink_format_float(char *dst, float v);
+void jsonsink_add_float(struct jsonsink *s, float v);
+
+/*
+ * jsonsink_format_double_fixed: write the value rounded to `decimals`
+ * decimal places. (0 <= decimals <= JSONSINK_DOUBLE_FIXED_MAX_DECIMALS)
+ * eg. 3.14159 with 3 decimals is formatted as "3.142".
+ *
+ * jsonsink_format_double_sig: write the value rounded to `digits`
+ * significant digits. (1 <= digits <= 17)
+ * eg. 3.14159 with 3 digits is formatted as "3.14".
+ *
+ * the rounding is correct (round-half-even on the exact binary value)
+ * like printf. unlike printf, trailing zeros are omitted. (1.5 with 3
+ * decimals is "1.5", not "1.500") and values rounded to zero are
+ * formatted as "0" without a sign.
+ *
+ * the notation is the same as jsonsink_format_double except that
+ * jsonsink_format_double_fixed never uses the exponent notation for
+ * small values.
+ *
+ * for values which already have fewer digits, (eg. large values with
+ * jsonsink_format_double_fixed) the results are the same as
+ * jsonsink_format_double.
+ *
+ * `dst` should have JSONSINK_FORMAT_DOUBLE_MAXLEN bytes.
+ *
+ * jsonsink_add_double_fixed/jsonsink_add_double_sig: add a double value
+ * formatted with the above functions.
+ *
+ * implementation: jsonsink_dtoa.c
+ */
+
+#define JSONSINK_DOUBLE_FIXED_MAX_DECIMALS 17
+
+size_t jsonsink_format_double_fixed(char *dst, double v,
+                                    unsigned int decimals);
+size_t jsonsink_format_double_sig(char *dst, double v, unsigned int digits);
+void jsonsink_add_double_fixed(struct jsonsink *s, double v,
+                               unsigned int decimals);
+void jsonsink_add_double_sig(struct jsonsink *s, double v,
+                             unsigned int digits);
+
+/**************************************************************************
+ * integers
+ *
+ * implementation: jsonsink_itoa.c
+ **************************************************************************/
+
+/*
+ * jsonsink_format_uint32 and friends: write the decimal representation
+ * of the value to `dst` and return its length. the result is not
+ * NUL-terminated. `dst` should have JSONSINK_FORMAT_xxx_MAXLEN bytes.
+ *
+ * unlike jsonsink_add_double, the integer functions are not provided by
+ * the serialization backends. they are shared by all of them.
+ */
+
+#define JSONSINK_FORMAT_UINT32_MAXLEN 10 /* 4294967295 */
+#define JSONSINK_FORMAT_INT32_MAXLEN 11  /* -2147483648 */
+#define JSONSINK_FORMAT_UINT64_MAXLEN 20 /* 18446744073709551615 */
+#define JSONSINK_FORMAT_INT64_MAXLEN 20  /* -9223372036854775808 */
+
+size_t jsonsink_format_uint32(char *dst, uint32_t v);
+size_t jsonsink_format_int32(char *dst, int32_t v);
+size_t jsonsink_format_uint64(char *dst, uint64_t v);
+size_t jsonsink_format_int64(char *dst, int64_t v);
+
+/*
+ * jsonsink_add_uint32/jsonsink_add_int32: add a 32-bit integer value.
+ *
+ * jsonsink_add_uint64/jsonsink_add_int64: add a 64-bit integer value.
+ *
+ * jsonsink_add_uint64_string/jsonsink_add_int64_string: similar, but
+ * add the number as a JSON string. (eg. "18446744073709551615")
+ * it's for consumers which parse JSON numbers as doubles, (eg. javascript)
+ * where integers larger than 2^53 lose precision.
+ */
+
 void jsonsink_add_uint32(struct jsonsink *s, uint32_t v);
 void jsonsink_add_int32(struct jsonsink *s, int32_t v);
-void jsonsink_add_double(struct jsonsink *s, double v);
+void jsonsink_add_uint64(struct jsonsink *s, uint64_t v);
+void jsonsink_add_int64(struct jsonsink *s, int64_t v);
+void jsonsink_add_uint64_string(struct jsonsink *s, uint64_t v);
+void jsonsink_add_int64_string(struct jsonsink *s, int64_t v);
+
+/*
+ * jsonsink_format_decimal: write mantissa * 10^-scale as an exact decimal
+ * number. (0 <= scale <= JSONSINK_DECIMAL_MAX_SCALE)
+ * eg. 1234 with scale 2 is formatted as "12.34", -5 with scale 3 as
+ * "-0.005". it's for fixed-point values like money in cents, which would
+ * not be exact when converted to double.
+ *
+ * if `trim` is true, trailing zeros in the fraction are omitted.
+ * (eg. 1200 with scale 2 is "12" instead of "12.00")
+ *
+ * the result is not NUL-terminated. `dst` should have
+ * JSONSINK_FORMAT_DECIMAL_MAXLEN bytes.
+ *
+ * jsonsink_add_decimal: add a number formatted with
+ * jsonsink_format_decimal.
+ */
+
+#define JSONSINK_DECIMAL_MAX_SCALE 19
+#define JSONSINK_FORMAT_DECIMAL_MAXLEN 22 /* -0.9223372036854775808 */
+
+size_t jsonsink_format_decimal(char *dst, int64_t mantissa,
+                               unsigned int scale, bool trim);
+void jsonsink_add_decimal(struct jsonsink *s, int64_t mantissa,
+                          unsigned int scale, bool trim);
+
+/**************************************************************************
+ * double cache
+ *
+ * implementation: jsonsink_double_cache.c
+ **************************************************************************/
+
+/*
+ * a double cache is a small direct-mapped cache of formatted doubles,
+ * keyed by their bit patterns. it's for workloads which repeat the same
+ * values a lot. (eg. zeros, quantized gauges, thresholds)
+ *
+ * jsonsink_double_cache_init: initialize the cache with the given memory.
+ * the cache never allocates memory by itself. `mem` should be aligned
+ * suitably for uint64_t. the number of entries is memsize /
+ * JSONSINK_DOUBLE_CACHE_ENTRY_SIZE, rounded down to a power of 2.
+ *
+ * jsonsink_add_double_cached: similar to jsonsink_add_double, but use
+ * the cached text if available. on a miss, the value is formatted with
+ * jsonsink_add_double, whichever serialization backend provides it, and
+ * stored in the cache unless it's too long. (more than
+ * JSONSINK_DOUBLE_CACHE_ENTRY_SIZE - 9 bytes)
+ *
+ * `hits` and `misses` count the lookups. the user can read and reset
+ * them to see if the cache helps a given workload.
+ *
+ * thread-safety: a cache can't be shared among threads without locks.
+ * use a cache per thread.
+ */
+
+#define JSONSINK_DOUBLE_CACHE_ENTRY_SIZE 32
+
+struct jsonsink_double_cache_entry;
+
+struct jsonsink_double_cache {
+        uint64_t hits;
+        uint64_t misses;
+
+        /*
+         * internal states. do not access them directly.
+         */
+        struct jsonsink_double_cache_entry *entries;
+        size_t mask;
+};
+
+void jsonsink_double_cache_init(struct jsonsink_double_cache *c, void *mem,
+                                size_t memsize);
+void jsonsink_add_double_cached(struct jsonsink *s,
+                                struct jsonsink_double_cache *c, double v);
+
+/**************************************************************************
+ * numeric arrays
+ *
+ * implementation: jsonsink_array.c
+ **************************************************************************/
+
+/*
+ * jsonsink_add_uint32_array and friends: add an array of `n` numbers.
+ * eg. jsonsink_add_int64_array(s, (int64_t[]){1, -2, 3}, 3) adds [1,-2,3]
+ *
+ * the result is the same as jsonsink_array_start, jsonsink_add_xxx for
+ * each value, and jsonsink_array_end, except that the doubles are
+ * formatted with jsonsink_format_double regardless of the serialization
+ * backend. (like jsonsink_add_float)
+ *
+ * it's faster for large arrays because the values are written into large
+ * reservations in a tight loop, without updating the library states for
+ * each value.
+ */
+
+void jsonsink_add_uint32_array(struct jsonsink *s, const uint32_t *values,
+                               size_t n);
+void jsonsink_add_int64_array(struct jsonsink *s, const int64_t *values,
+                              size_t n);
+void jsonsink_add_float_array(struct jsonsink *s, const float *values,
+                              size_t n);
+void jsonsink_add_double_array(struct jsonsink *s, const double *values,
+                               size_t n);
+
+/**************************************************************************
+ * timestamps
+ *
+ * implementation: jsonsink_timestamp.c
+ **************************************************************************/
+
+/*
+ * jsonsink_format_timestamp_ns: write an RFC 3339 timestamp in UTC
+ * for the given nanoseconds since the unix epoch, with `precision`
+ * (0 <= precision <= 9) fractional digits. the fraction is truncated,
+ * not rounded. eg. "2026-10-17T12:34:56.789123Z" with precision 6.
+ * the result is not NUL-terminated. `dst` should have
+ * JSONSINK_FORMAT_TIMESTAMP_MAXLEN bytes.
+ *
+ * jsonsink_add_timestamp_ns: add a timestamp formatted with
+ * jsonsink_format_timestamp_ns as a string value.
+ *
+ * the formatted date and time up to the second is cached per thread
+ * and only recomputed when the second changes.
+ */
+
+/* 2026-10-17T12:34:56.123456789Z */
+#define JSONSINK_FORMAT_TIMESTAMP_MAXLEN 30
+
+size_t jsonsink_format_timestamp_ns(char *dst, int64_t epoch_ns,
+                                    unsigned int precision);
+void jsonsink_add_timestamp_ns(struct jsonsink *s, int64_t epoch_ns,
+                               unsigned int precision);
+
+/**************************************************************************
+ * uuids and network addresses
+ *
+ * implementation: jsonsink_ids.c
+ **************************************************************************/
+
+/*
+ * jsonsink_format_uuid: write a 16-byte uuid as 8-4-4-4-12 lowercase hex
+ * digits. (eg. 123e4567-e89b-12d3-a456-426614174000)
+ *
+ * jsonsink_format_ipv4: write a 4-byte ipv4 address in network byte
+ * order (eg. struct in_addr) in the dotted decimal notation.
+ *
+ * jsonsink_format_ipv6: write a 16-byte ipv6 address (eg. struct
+ * in6_addr) in the rfc 5952 canonical form. (eg. 2001:db8::1)
+ * like inet_ntop, ipv4-mapped and ipv4-compatible addresses are written
+ * with the dotted decimal notation for the last 32 bits.
+ * (eg. ::ffff:192.0.2.1)
+ *
+ * jsonsink_format_mac: write a 6-byte mac address as colon-separated
+ * lowercase hex digits. (eg. 00:00:5e:00:53:01)
+ *
+ * these functions return the length of the result. it's not
+ * NUL-terminated. `dst` should have JSONSINK_FORMAT_xxx_MAXLEN bytes.
+ *
+ * jsonsink_add_uuid and friends: add the formatted text as a string
+ * value.
+ */
+
+#define JSONSINK_FORMAT_UUID_MAXLEN 36
+#define JSONSINK_FORMAT_IPV4_MAXLEN 15 /* 255.255.255.255 */
+#define JSONSINK_FORMAT_IPV6_MAXLEN 39 /* 8 fields of 4 digits */
+#define JSONSINK_FORMAT_MAC_MAXLEN 17
+
+size_t jsonsink_format_uuid(char *dst, const void *uuid);
+size_t jsonsink_format_ipv4(char *dst, const void *addr);
+size_t jsonsink_format_ipv6(char *dst, const void *addr);
+size_t jsonsink_format_mac(char *dst, const void *mac);
+void jsonsink_add_uuid(struct jsonsink *s, const void *uuid);
+void jsonsink_add_ipv4(struct jsonsink *s, const void *addr);
+void jsonsink_add_ipv6(struct jsonsink *s, const void *addr);
+void jsonsink_add_mac(struct jsonsink *s, const void *mac);
 
 /**************************************************************************
  * utf-8 and string escaping
@@ -320,13 +665,196 @@ void jsonsink_add_double(struct jsonsink *s, double v);
  * it's users' responsibility to pass a valid utf-8 string.
  * the library doesn't perform any validations.
  *
- * the current implementation is straightforward and slow.
+ * which characters are escaped, and how, is controlled by the escape
+ * profile of the sink. (see below)
+ *
+ * runs of characters which don't need escaping are found with simd
+ * instructions when available (SSSE3 or AVX2) and copied as they are.
  */
 
 void jsonsink_add_string(struct jsonsink *s, const char *cp, size_t sz);
 
+/*
+ * jsonsink_add_untrusted_string: add a string value which might not be
+ * a valid utf-8 sequence.
+ *
+ * the input is validated while being escaped, in the same pass.
+ * ill-formed sequences, including overlong encodings, surrogate halves,
+ * and truncated sequences, are handled as specified by `flags`:
+ *
+ * JSONSINK_INVALID_UTF8_REPLACE: replace each maximal subpart of
+ * ill-formed sequences with U+FFFD.
+ *
+ * JSONSINK_INVALID_UTF8_ERROR: record JSONSINK_ERROR_INVALID_UTF8.
+ * (see jsonsink_error) the string value is terminated at the first
+ * ill-formed sequence.
+ *
+ * the validation uses simd instructions when available. (SSSE3 or AVX2)
+ */
+
+#define JSONSINK_INVALID_UTF8_REPLACE 0
+#define JSONSINK_INVALID_UTF8_ERROR 1
+
+void jsonsink_add_untrusted_string(struct jsonsink *s, const char *cp,
+                                   size_t sz, unsigned int flags);
+
+/*
+ * the api to add a string value in chunks.
+ *
+ * eg.
+ *   jsonsink_string_start(s);
+ *   jsonsink_string_append(s, "\xe3\x81", 2);
+ *   jsonsink_string_append(s, "\x93 world", 7);
+ *   jsonsink_string_end(s);
+ *
+ * is an equivalent of
+ *
+ *   jsonsink_add_string(s, "\xe3\x81\x93 world", 9);
+ *
+ * each chunk is escaped directly into the buffer as it's appended.
+ * chunks can split a multi-byte sequence anywhere. the incomplete
+ * sequence at the end of a chunk is carried over to the next
+ * jsonsink_string_append call. thus the memory usage doesn't depend on
+ * the size of the string value.
+ *
+ * jsonsink_string_start_untrusted is similar, but the chunks are
+ * validated as jsonsink_add_untrusted_string does.
+ * an incomplete sequence at jsonsink_string_end is handled as an ill-formed
+ * sequence.
+ *
+ * nothing other than jsonsink_string_append can be added between
+ * jsonsink_string_start and jsonsink_string_end.
+ */
+
+void jsonsink_string_start(struct jsonsink *s);
+void jsonsink_string_start_untrusted(struct jsonsink *s, unsigned int flags);
+void jsonsink_string_append(struct jsonsink *s, const char *cp, size_t sz);
+void jsonsink_string_end(struct jsonsink *s);
+
+/*
+ * jsonsink_add_string_latin1: add an iso-8859-1 string value.
+ *
+ * jsonsink_add_string_utf16: add a utf-16 string value.
+ * `n` is the number of 16-bit code units. the byte order is the native one.
+ * unpaired surrogates are replaced with U+FFFD.
+ *
+ * these functions transcode the input to utf-8 (or \uXXXX escapes,
+ * depending on the escape profile) directly into the buffer, without
+ * an intermediate copy. runs of ascii characters are processed with
+ * simd instructions when available. (SSSE3)
+ */
+
+void jsonsink_add_string_latin1(struct jsonsink *s, const char *cp,
+                                size_t sz);
+void jsonsink_add_string_utf16(struct jsonsink *s, const uint16_t *p,
+                               size_t n);
+
+/*
+ * escape profiles
+ *
+ * jsonsink_escape_ascii: the default. escape '"', '\\', control characters,
+ * and all non-ascii characters. (as \uXXXX, or a surrogate pair of them)
+ * that is, the output is pure ascii.
+ *
+ * jsonsink_escape_html: escape '"', '\\', control characters,
+ * '<', '>', '&', U+2028, and U+2029. the output is safe to embed in
+ * html <script> elements and is valid javascript.
+ * other non-ascii characters are transmitted as they are.
+ *
+ * jsonsink_escape_minimal: escape only what RFC 8259 requires.
+ * ie. '"', '\\', and control characters.
+ * the short forms like \n are used where available.
+ *
+ * each profile is a 256-entry table which classifies bytes.
+ * the choice of the profile doesn't affect the performance of
+ * the common path, where no escaping is necessary.
+ *
+ * jsonsink_set_escape_profile: set the escape profile used by
+ * jsonsink_add_string. NULL means the default.
+ */
+
+extern const struct jsonsink_escape_profile jsonsink_escape_ascii;
+extern const struct jsonsink_escape_profile jsonsink_escape_html;
+extern const struct jsonsink_escape_profile jsonsink_escape_minimal;
+
+void jsonsink_set_escape_profile(struct jsonsink *s,
+                                 const struct jsonsink_escape_profile *prof);
+
+/**************************************************************************
+ * interned strings
+ *
+ * implementation: jsonsink_intern.c
+ **************************************************************************/
+
+/*
+ * an intern table keeps the escaped and quoted forms of frequently used
+ * strings. (eg. enum names, hostnames, status strings)
+ * adding an interned string is a plain copy without escaping.
+ *
+ * jsonsink_intern_init: initialize the table with the given memory.
+ * the table never allocates memory by itself. `mem` should be aligned
+ * suitably for a pointer. a table with less than
+ * JSONSINK_INTERN_MIN_MEMSIZE bytes can't register any strings.
+ * the escape profile `prof` is used to escape the strings, including
+ * the ones added by jsonsink_add_string_interned/jsonsink_add_string_intern
+ * on a miss. NULL means the default.
+ *
+ * jsonsink_intern: register a string. returns NULL if the table is full.
+ * registering an already registered string returns the existing entry.
+ *
+ * jsonsink_intern_lookup: look up a string by its contents.
+ * returns NULL if it's not registered.
+ *
+ * jsonsink_add_interned: add an interned string as a string value.
+ *
+ * jsonsink_add_string_interned: similar to jsonsink_add_string, but use
+ * the interned form if available.
+ *
+ * jsonsink_add_string_intern: similar to jsonsink_add_string_interned,
+ * but register the string on a miss.
+ *
+ * thread-safety: the functions which can register strings
+ * (jsonsink_intern and jsonsink_add_string_intern) need an exclusive
+ * access to the table. once the table is filled, the rest of functions
+ * can be used concurrently from multiple threads without locks.
+ */
+
+#define JSONSINK_INTERN_MIN_MEMSIZE (2 * sizeof(void *))
+
+struct jsonsink_interned;
+
+struct jsonsink_intern_table {
+        /*
+         * internal states. do not access them directly.
+         */
+        const struct jsonsink_interned **slots;
+        size_t mask;
+        size_t count;
+        uint8_t *arena;
+        size_t arenalen;
+        size_t arenapos;
+        const struct jsonsink_escape_profile *escape_profile;
+};
+
+void jsonsink_intern_init(struct jsonsink_intern_table *t, void *mem,
+                          size_t memsize,
+                          const struct jsonsink_escape_profile *prof);
+const struct jsonsink_interned *
+jsonsink_intern(struct jsonsink_intern_table *t, const char *cp, size_t sz);
+const struct jsonsink_interned *
+jsonsink_intern_lookup(const struct jsonsink_intern_table *t, const char *cp,
+                       size_t sz);
+void jsonsink_add_interned(struct jsonsink *s,
+                           const struct jsonsink_interned *e);
+void jsonsink_add_string_interned(struct jsonsink *s,
+                                  const struct jsonsink_intern_table *t,
+                                  const char *cp, size_t sz);
+void jsonsink_add_string_intern(struct jsonsink *s,
+                                struct jsonsink_intern_table *t,
+                                const char *cp, size_t sz);
+
 /**************************************************************************
- * base64
+ * base64 and other binary-to-text encodings
  *
  * implementation: jsonsink_base64.c
  **************************************************************************/
@@ -334,10 +862,358 @@ void jsonsink_add_string(struct jsonsink *s, const char *cp, size_t sz);
 /*
  * jsonsink_add_binary_base64: add a byte array as a JSON string with base64
  * encoding
+ *
+ * the encoder uses SSSE3 or AVX2 when available.
+ *
+ * when JSONSINK_BASE64_ALIGN is defined to a power of 2, whitespaces are
+ * inserted before large payloads so that the encoded data starts at
+ * a multiple of JSONSINK_BASE64_ALIGN in the buffer. it makes simd stores
+ * aligned if the buffer itself is aligned. note that it makes the output
+ * depend on the buffer position.
  */
 
 void jsonsink_add_binary_base64(struct jsonsink *s, const void *p, size_t sz);
 
+/*
+ * other encodings. (rfc 4648)
+ *
+ * jsonsink_add_binary_base64url: base64url. the trailing padding ('=')
+ * is omitted unless `padding` is true.
+ *
+ * jsonsink_add_binary_hex: lowercase hex.
+ *
+ * jsonsink_add_binary_base32: base32 with padding.
+ *
+ * like jsonsink_add_binary_base64, these encoders write directly into
+ * the buffer, using SSSE3 or AVX2 when available.
+ */
+
+void jsonsink_add_binary_base64url(struct jsonsink *s, const void *p,
+                                   size_t sz, bool padding);
+void jsonsink_add_binary_hex(struct jsonsink *s, const void *p, size_t sz);
+void jsonsink_add_binary_base32(struct jsonsink *s, const void *p, size_t sz);
+
+/*
+ * the streaming api to add a base64 string value from chunks.
+ *
+ *   jsonsink_base64_start(s);
+ *   jsonsink_base64_append(s, chunk1, chunk1len);
+ *   jsonsink_base64_append(s, chunk2, chunk2len);
+ *   jsonsink_base64_end(s);
+ *
+ * is an equivalent of jsonsink_add_binary_base64 with the concatenation
+ * of the chunks. chunks can have arbitrary sizes.
+ * the sink keeps up to 2 bytes which don't form a complete 3-byte block
+ * between calls.
+ *
+ * it's the user's responsibility not to add other values between
+ * jsonsink_base64_start and jsonsink_base64_end.
+ */
+
+void jsonsink_base64_start(struct jsonsink *s);
+void jsonsink_base64_append(struct jsonsink *s, const void *p, size_t sz);
+void jsonsink_base64_end(struct jsonsink *s);
+
+/*
+ * jsonsink_add_base64_fd: read `len` bytes from the file descriptor and
+ * add them as a base64 string value.
+ *
+ * the data is read through a bounded buffer on the stack. the memory usage
+ * doesn't depend on `len`.
+ *
+ * on a read error, or when the file ends before `len` bytes,
+ * JSONSINK_ERROR_READ_FAILED is recorded. (see jsonsink_error)
+ *
+ * implementation: jsonsink_base64_fd.c (posix)
+ */
+
+void jsonsink_add_base64_fd(struct jsonsink *s, int fd, size_t len);
+
+/**************************************************************************
+ * file descriptor sinks
+ *
+ * implementation: jsonsink_fd.c (posix)
+ **************************************************************************/
+
+/*
+ * a ready-made sink which writes the generated JSON to a file descriptor
+ * through a large staging buffer.
+ *
+ * jsonsink_fd_init: allocate a page-aligned buffer of `bufsize` bytes,
+ * rounded up to the page size, and set up `fs->s` to use it. 0 means
+ * JSONSINK_FD_DEFAULT_BUFSIZE. returns false if the allocation failed.
+ * after that, use `&fs->s` with the usual api.
+ *
+ * the buffer is written only when it gets full, with as many write(2)
+ * calls as necessary. fragments of the buffer size or larger are written
+ * directly without being copied. (see `write_direct` in struct jsonsink)
+ * EINTR and partial writes are handled. on a write error,
+ * JSONSINK_ERROR_FLUSH_FAILED is recorded (see jsonsink_error) and
+ * `fs->write_errno` has the errno value.
+ *
+ * jsonsink_fd_finish: write the remaining data in the buffer. it should
+ * be called at the end. returns false if any error has been recorded.
+ *
+ * jsonsink_fd_destroy: free the buffer. it doesn't close the file
+ * descriptor.
+ */
+
+#define JSONSINK_FD_DEFAULT_BUFSIZE (64 * 1024)
+
+struct jsonsink_fd {
+        struct jsonsink s; /* must be the first member */
+        int fd;
+        int write_errno;
+};
+
+bool jsonsink_fd_init(struct jsonsink_fd *fs, int fd, size_t bufsize);
+bool jsonsink_fd_finish(struct jsonsink_fd *fs);
+void jsonsink_fd_destroy(struct jsonsink_fd *fs);
+
+/*
+ * a scatter-gather variant of jsonsink_fd.
+ *
+ * jsonsink_sg_add_serialized_value/jsonsink_sg_add_fragment: similar to
+ * jsonsink_add_serialized_value/jsonsink_add_fragment, but when `len` is
+ * `threshold` bytes or more, the data is not copied into the buffer.
+ * instead, a reference to it is recorded in an iovec list between the
+ * buffer segments, and the whole list is written with writev(2).
+ * the caller should keep the referenced memory valid and unmodified
+ * until the next flush, that is, until the buffer gets full, the list
+ * gets full (JSONSINK_SG_IOVMAX entries) or jsonsink_sg_finish is
+ * called. the safest is to keep it until jsonsink_sg_finish.
+ *
+ * jsonsink_sg_init: similar to jsonsink_fd_init. 0 `threshold` means
+ * JSONSINK_SG_DEFAULT_THRESHOLD.
+ *
+ * jsonsink_sg_finish/jsonsink_sg_destroy: similar to the jsonsink_fd
+ * counterparts.
+ */
+
+#define JSONSINK_SG_IOVMAX 64
+#define JSONSINK_SG_DEFAULT_THRESHOLD 4096
+
+struct iovec;
+
+struct jsonsink_sg {
+        struct jsonsink s; /* must be the first member */
+        int fd;
+        int write_errno;
+        size_t threshold;
+
+        /*
+         * internal states. do not access them directly.
+         */
+        struct iovec *iov;
+        unsigned int iovcnt;
+        size_t segstart;
+};
+
+bool jsonsink_sg_init(struct jsonsink_sg *sg, int fd, size_t bufsize,
+                      size_t threshold);
+void jsonsink_sg_add_serialized_value(struct jsonsink_sg *sg,
+                                      const char *value, size_t len);
+void jsonsink_sg_add_fragment(struct jsonsink_sg *sg, const char *frag,
+                              size_t len);
+bool jsonsink_sg_finish(struct jsonsink_sg *sg);
+void jsonsink_sg_destroy(struct jsonsink_sg *sg);
+
+/**************************************************************************
+ * mmap sink
+ *
+ * implementation: jsonsink_mmap.c (posix)
+ **************************************************************************/
+
+/*
+ * a sink which writes to a regular file through a window of `winsize`
+ * bytes mapped with mmap(2). the JSON is generated directly into the
+ * mapped pages. neither staging copies nor write(2) are involved.
+ *
+ * when the window gets full, the blocks for the next window are
+ * allocated with posix_fallocate(3) (ftruncate(2) on macOS) and the
+ * window slides to the next part of the file.
+ *
+ * jsonsink_mmap_init: `fd` should be a regular file opened with O_RDWR.
+ * the output starts at the beginning of the file. 0 `winsize` means
+ * JSONSINK_MMAP_DEFAULT_WINSIZE. `winsize` is rounded up to the page
+ * size. returns false if the first window couldn't be mapped, with
+ * `m->write_errno` set. (jsonsink_mmap_destroy is still safe to call)
+ * after that, use `&m->s` with the usual api.
+ *
+ * jsonsink_mmap_finish: truncate the file to the exact size of the
+ * output. it should be called at the end. returns false if any error has
+ * been recorded.
+ *
+ * jsonsink_mmap_destroy: unmap the window.
+ *
+ * errors of posix_fallocate/ftruncate/mmap, including running out of
+ * disk space, are recorded as JSONSINK_ERROR_FLUSH_FAILED
+ * (see jsonsink_error) with `m->write_errno` set.
+ *
+ * note: on macOS, where the windows are sparse, running out of disk
+ * space while writing to the mapped pages is reported as SIGBUS, as
+ * usual for mmap.
+ */
+
+#define JSONSINK_MMAP_DEFAULT_WINSIZE (4 * 1024 * 1024)
+
+struct jsonsink_mmap {
+        struct jsonsink s; /* must be the first member */
+        int fd;
+        int write_errno;
+
+        /*
+         * internal states. do not access them directly.
+         */
+        size_t pagesize;
+        size_t winsize;
+        uint64_t winoff; /* the file offset of the window */
+};
+
+bool jsonsink_mmap_init(struct jsonsink_mmap *m, int fd, size_t winsize);
+bool jsonsink_mmap_finish(struct jsonsink_mmap *m);
+void jsonsink_mmap_destroy(struct jsonsink_mmap *m);
+
+/**************************************************************************
+ * io_uring sink
+ *
+ * implementation: jsonsink_uring.c (linux)
+ **************************************************************************/
+
+/*
+ * a sink which writes to a file descriptor asynchronously with io_uring,
+ * rotating `nbufs` buffers of `bufsize` bytes.
+ *
+ * the buffers are registered with io_uring (IORING_REGISTER_BUFFERS) and
+ * written with IORING_OP_WRITE_FIXED. if the registration fails, plain
+ * IORING_OP_WRITE is used instead.
+ *
+ * when the current buffer gets full, a write of it is submitted and the
+ * generation continues in a free buffer while the write is in progress.
+ * it blocks only when all the buffers are in flight. no helper threads
+ * are used.
+ *
+ * for seekable files, the buffers are written at their offsets, starting
+ * at the current file offset, and multiple writes can be in flight.
+ * otherwise (eg. pipes, sockets, O_APPEND files) only one write is in
+ * flight at a time to keep the order. it's still overlapped with the
+ * generation.
+ *
+ * jsonsink_uring_init: 0 `nbufs` and 0 `bufsize` mean
+ * JSONSINK_URING_DEFAULT_NBUFS and JSONSINK_URING_DEFAULT_BUFSIZE.
+ * `bufsize` is rounded up to the page size. returns false if io_uring is
+ * not available (eg. old kernels, seccomp) or the allocation failed.
+ * after that, use `&u->s` with the usual api.
+ *
+ * write errors are reported by a later flush. JSONSINK_ERROR_FLUSH_FAILED
+ * is recorded (see jsonsink_error) and `u->write_errno` has the errno
+ * value.
+ *
+ * jsonsink_uring_finish: write the remaining data in the buffer and wait
+ * for all the writes to complete. for seekable files, the file offset is
+ * moved to the end of the written data. it should be called at the end,
+ * even after errors. returns false if any error has been recorded.
+ *
+ * jsonsink_uring_destroy: free the resources.
+ *
+ * jsonsink_uring_init_direct: similar to jsonsink_uring_init, but for a
+ * regular file opened with O_DIRECT, to write bulk data without
+ * polluting the page cache. every write is aligned to the page size,
+ * which is a multiple of the logical block size in practice. the
+ * current file offset should be aligned as well. (eg. a new file)
+ * when the buffer gets full, the unaligned tail is carried over to the
+ * next buffer. jsonsink_uring_finish writes the last block padded with
+ * zeros and truncates the file to the exact size of the output.
+ * `bufsize` is at least two pages.
+ */
+
+#define JSONSINK_URING_DEFAULT_NBUFS 4
+#define JSONSINK_URING_DEFAULT_BUFSIZE (64 * 1024)
+
+struct jsonsink_uring_ring;
+
+struct jsonsink_uring {
+        struct jsonsink s; /* must be the first member */
+        int fd;
+        int write_errno;
+        unsigned int nbufs;
+
+        /*
+         * internal states. do not access them directly.
+         */
+        struct jsonsink_uring_ring *ring;
+};
+
+bool jsonsink_uring_init(struct jsonsink_uring *u, int fd, unsigned int nbufs,
+                         size_t bufsize);
+bool jsonsink_uring_init_direct(struct jsonsink_uring *u, int fd,
+                                unsigned int nbufs, size_t bufsize);
+bool jsonsink_uring_finish(struct jsonsink_uring *u);
+void jsonsink_uring_destroy(struct jsonsink_uring *u);
+
+/**************************************************************************
+ * ring buffer sink
+ *
+ * implementation: jsonsink_ring.c (linux)
+ **************************************************************************/
+
+/*
+ * a sink which hands the generated JSON over to a consumer (another
+ * thread, or a process forked after jsonsink_ring_init) through a
+ * bounded ring buffer without copies.
+ *
+ * the ring is a memfd mapped twice back to back. a reservation is
+ * always contiguous even across the end of the ring, and the consumer
+ * can read any published range in place.
+ *
+ * jsonsink_ring_init: create a ring of `size` bytes, rounded up to a
+ * power of two and the page size. 0 means JSONSINK_RING_DEFAULT_SIZE.
+ * returns false on failures. after that, the producer uses `&r->s` with
+ * the usual api. the data is published to the consumer every quarter
+ * of the ring. when the ring is full, the producer waits for the
+ * consumer.
+ *
+ * jsonsink_ring_finish: (producer) publish the remaining data and tell
+ * the consumer the end of the data.
+ *
+ * jsonsink_ring_read: (consumer) wait for published data and return its
+ * length. `*pp` is set to the pointer to it. returns 0 at the end of the
+ * data.
+ *
+ * jsonsink_ring_consume: (consumer) release the first `len` bytes of the
+ * data returned by jsonsink_ring_read. the producer can reuse them.
+ *
+ * jsonsink_ring_destroy: unmap the ring. a forked consumer should call
+ * it as well.
+ *
+ * note: there should be a single producer and a single consumer.
+ * if the consumer goes away, the producer might wait forever.
+ */
+
+#define JSONSINK_RING_DEFAULT_SIZE (1024 * 1024)
+#define JSONSINK_RING_MAX_SIZE (1024 * 1024 * 1024)
+
+struct jsonsink_ring_ctl;
+
+struct jsonsink_ring {
+        struct jsonsink s; /* must be the first member */
+
+        /*
+         * internal states. do not access them directly.
+         */
+        int memfd;
+        size_t size;
+        size_t chunksize;
+        char *base;
+        struct jsonsink_ring_ctl *ctl;
+};
+
+bool jsonsink_ring_init(struct jsonsink_ring *r, size_t size);
+void jsonsink_ring_finish(struct jsonsink_ring *r);
+size_t jsonsink_ring_read(struct jsonsink_ring *r, const void **pp);
+void jsonsink_ring_consume(struct jsonsink_ring *r, size_t len);
+void jsonsink_ring_destroy(struct jsonsink_ring *r);
+
 /**************************************************************************
  * debug stuff
  **************************************************************************/
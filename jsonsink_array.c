@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * batch emitters for numeric arrays.
+ *
+ * unlike a loop of jsonsink_add_xxx, the whole array including the
+ * brackets and the commas is written as a single value, into
+ * reservations as large as the buffer allows. the per-value overhead is
+ * only the formatting itself.
+ */
+
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+#include <math.h>
+#endif
+
+#include "jsonsink.h"
+
+/* the longest formatted item among the following */
+#define ITEM_MAXLEN JSONSINK_FORMAT_DOUBLE_MAXLEN
+
+typedef size_t (*format_fn)(char *dst, const void *values, size_t i);
+
+/*
+ * add_array: add an array of `n` values formatted by `format`,
+ * each of which is at most `maxlen` bytes.
+ *
+ * each reservation is at least large enough for a separator, an item and
+ * the closing bracket so that every iteration makes a progress.
+ */
+
+static inline void
+add_array(struct jsonsink *s, const void *values, size_t n, size_t maxlen,
+          format_fn format)
+{
+        const size_t itemlen = maxlen + 1; /* "," or "[" and an item */
+        bool opened = false;
+        size_t i = 0;
+
+        JSONSINK_ASSUME(maxlen <= ITEM_MAXLEN);
+        jsonsink_value_start(s);
+        for (;;) {
+                size_t want = !opened + (n - i) * itemlen + 1;
+                size_t minlen = itemlen + 1;
+                if (minlen > want) {
+                        minlen = want;
+                }
+                size_t avail;
+                char *dest =
+                        jsonsink_reserve_buffer_upto(s, minlen, want, &avail);
+                if (dest == NULL) {
+                        /* no buffer. just calculate the length */
+                        char tmp[ITEM_MAXLEN];
+                        size_t len = !opened + 1;
+                        for (; i < n; i++) {
+                                len += (i > 0) + format(tmp, values, i);
+                        }
+                        jsonsink_commit_buffer(s, len);
+                        break;
+                }
+                char *p = dest;
+                const char *end = dest + avail;
+                if (!opened) {
+                        *p++ = '[';
+                        opened = true;
+                }
+                while (i < n && (size_t)(end - p) >= itemlen) {
+                        *p = ',';
+                        p += i > 0;
+                        p += format(p, values, i);
+                        i++;
+                }
+                if (i == n && p < end) {
+                        *p++ = ']';
+                        jsonsink_commit_buffer(s, p - dest);
+                        break;
+                }
+                jsonsink_commit_buffer(s, p - dest);
+        }
+        jsonsink_value_end(s);
+}
+
+static size_t
+format_uint32_at(char *dst, const void *values, size_t i)
+{
+        return jsonsink_format_uint32(dst, ((const uint32_t *)values)[i]);
+}
+
+static size_t
+format_int64_at(char *dst, const void *values, size_t i)
+{
+        return jsonsink_format_int64(dst, ((const int64_t *)values)[i]);
+}
+
+static size_t
+format_float_at(char *dst, const void *values, size_t i)
+{
+        float v = ((const float *)values)[i];
+        JSONSINK_ASSERT(!isnan(v));
+        JSONSINK_ASSERT(!isinf(v));
+        return jsonsink_format_float(dst, v);
+}
+
+static size_t
+format_double_at(char *dst, const void *values, size_t i)
+{
+        double v = ((const double *)values)[i];
+        JSONSINK_ASSERT(!isnan(v));
+        JSONSINK_ASSERT(!isinf(v));
+        return jsonsink_format_double(dst, v);
+}
+
+void
+jsonsink_add_uint32_array(struct jsonsink *s, const uint32_t *values,
+                          size_t n)
+{
+        add_array(s, values, n, JSONSINK_FORMAT_UINT32_MAXLEN,
+                  format_uint32_at);
+}
+
+void
+jsonsink_add_int64_array(struct jsonsink *s, const int64_t *values, size_t n)
+{
+        add_array(s, values, n, JSONSINK_FORMAT_INT64_MAXLEN,
+                  format_int64_at);
+}
+
+void
+jsonsink_add_float_array(struct jsonsink *s, const float *values, size_t n)
+{
+        add_array(s, values, n, JSONSINK_FORMAT_FLOAT_MAXLEN,
+                  format_float_at);
+}
+
+void
+jsonsink_add_double_array(struct jsonsink *s, const double *values, size_t n)
+{
+        add_array(s, values, n, JSONSINK_FORMAT_DOUBLE_MAXLEN,
+                  format_double_at);
+}
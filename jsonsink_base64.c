@@ -25,11 +25,16 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "jsonsink.h"
 
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
 #if !defined(LITTLE_ENDIAN)
 #if defined(__LITTLE_ENDIAN__) || (defined(__BYTE_ORDER__) &&                 \
                                    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
@@ -50,8 +55,41 @@
 
 #define BASE64_ASSUME(cond) JSONSINK_ASSUME(cond)
 
+#if !defined(JSONSINK_BASE64_ALIGN)
+#define JSONSINK_BASE64_ALIGN 0
+#endif
+
+#if JSONSINK_BASE64_ALIGN < 0 ||                                              \
+        JSONSINK_BASE64_ALIGN > JSONSINK_MAX_RESERVATION
+#error invalid JSONSINK_BASE64_ALIGN
+#endif
+
+/* payloads smaller than this are not worth aligning */
+#define BASE64_ALIGN_THRESHOLD 1024
+
+/*
+ * an encoder converts `inblock` input bytes to `outblock` characters.
+ *
+ * encode: encode `srclen` bytes to `dst`. only the last call for a value
+ * can have a partial block.
+ *
+ * size: the size of the output for `srclen` bytes.
+ */
+
+struct encoder {
+        unsigned int inblock;
+        unsigned int outblock;
+        void (*encode)(const void *restrict src, size_t srclen,
+                       char *restrict dst);
+        size_t (*size)(size_t srclen);
+};
+
+/**************************************************************************
+ * base64 (rfc 4648 section 4) and base64url (rfc 4648 section 5)
+ **************************************************************************/
+
 static uint8_t
-conv_to_char(uint8_t x)
+conv_to_char(uint8_t x, bool url)
 {
         BASE64_ASSUME(x < 64);
         static const char table[64] = {
@@ -62,6 +100,9 @@ conv_to_char(uint8_t x)
                 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2',
                 '3', '4', '5', '6', '7', '8', '9', '+', '/',
         };
+        if (url && x >= 62) {
+                return x == 62 ? '-' : '_';
+        }
         return table[x];
 }
 
@@ -87,7 +128,7 @@ byteswap(uint32_t x)
 }
 
 static uint32_t
-convert(uint32_t x)
+convert(uint32_t x, bool url)
 {
         union {
                 uint32_t u32;
@@ -96,7 +137,7 @@ convert(uint32_t x)
         u.u32 = x;
         unsigned int j;
         for (j = 0; j < 4; j++) {
-                u.u8[j] = conv_to_char(u.u8[j]);
+                u.u8[j] = conv_to_char(u.u8[j], url);
         }
         return u.u32;
 }
@@ -120,7 +161,7 @@ pad(uint32_t x, unsigned int srclen)
 }
 
 static void
-enc3(const uint8_t p[3], char dst[4], unsigned int srclen)
+enc3(const uint8_t p[3], char dst[4], unsigned int srclen, bool url)
 {
         BASE64_ASSUME(srclen > 0 && srclen <= 3);
 
@@ -129,7 +170,7 @@ enc3(const uint8_t p[3], char dst[4], unsigned int srclen)
 #if LITTLE_ENDIAN
         x = byteswap(x);
 #endif
-        x = convert(x);
+        x = convert(x, url);
         x = pad(x, srclen);
         memcpy(dst, &x, 4);
 }
@@ -142,56 +183,553 @@ base64encode_size(size_t srclen)
         return bsz;
 }
 
-static void
-base64encode(const void *restrict src, size_t srclen, char *restrict dst)
+static size_t
+base64encode_size_nopad(size_t srclen)
+{
+        size_t tail = srclen % 3;
+        return srclen / 3 * 4 + (tail > 0 ? tail + 1 : 0);
+}
+
+#if defined(__SSSE3__)
+/*
+ * the simd encoders are based on the algorithm described in:
+ * http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+ *
+ * split: split 12 bytes (at offset 0 of each 128-bit lane) into
+ * 16 6-bit indexes.
+ *
+ * lookup: convert the 6-bit indexes to characters.
+ */
+
+#define SPLIT_SHUFFLE                                                         \
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+
+/* clang-format off */
+#define LOOKUP_SHIFT(c62, c63)                                                \
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,           \
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, (c62) - 62,         \
+        (c63) - 63, 'A', 0, 0
+/* clang-format on */
+
+static __m128i
+split_ssse3(__m128i in)
+{
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(SPLIT_SHUFFLE));
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t1, t3);
+}
+
+static __m128i
+lookup_ssse3(__m128i idx, bool url)
+{
+        __m128i shift = url ? _mm_setr_epi8(LOOKUP_SHIFT('-', '_'))
+                            : _mm_setr_epi8(LOOKUP_SHIFT('+', '/'));
+        __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+        r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+        r = _mm_shuffle_epi8(shift, r);
+        return _mm_add_epi8(r, idx);
+}
+#endif
+
+#if defined(__AVX2__)
+static __m256i
+split_avx2(__m256i in)
+{
+        in = _mm256_shuffle_epi8(
+                in, _mm256_setr_epi8(SPLIT_SHUFFLE, SPLIT_SHUFFLE));
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        return _mm256_or_si256(t1, t3);
+}
+
+static __m256i
+lookup_avx2(__m256i idx, bool url)
+{
+        __m256i shift =
+                url ? _mm256_setr_epi8(LOOKUP_SHIFT('-', '_'),
+                                       LOOKUP_SHIFT('-', '_'))
+                    : _mm256_setr_epi8(LOOKUP_SHIFT('+', '/'),
+                                       LOOKUP_SHIFT('+', '/'));
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        r = _mm256_shuffle_epi8(shift, r);
+        return _mm256_add_epi8(r, idx);
+}
+#endif
+
+static inline void
+base64encode_common(const void *restrict src, size_t srclen,
+                    char *restrict dst, bool url, bool padding)
 {
         const uint8_t *p = src;
-        size_t n = srclen / 3;
+        const uint8_t *ep = p + srclen;
+
+#if defined(__AVX2__)
+        /* 24 bytes -> 32 chars. note that we read 28 bytes. */
+        while (ep - p >= 28) {
+                __m256i in = _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(
+                                _mm_loadu_si128((const void *)p)),
+                        _mm_loadu_si128((const void *)(p + 12)), 1);
+                _mm256_storeu_si256((void *)dst,
+                                    lookup_avx2(split_avx2(in), url));
+                p += 24;
+                dst += 32;
+        }
+#endif
+#if defined(__SSSE3__)
+        /* 12 bytes -> 16 chars. note that we read 16 bytes. */
+        while (ep - p >= 16) {
+                __m128i in = _mm_loadu_si128((const void *)p);
+                _mm_storeu_si128((void *)dst,
+                                 lookup_ssse3(split_ssse3(in), url));
+                p += 12;
+                dst += 16;
+        }
+#endif
+
+        size_t n = (ep - p) / 3;
         size_t i;
 
         for (i = 0; i < n; i++) {
-                enc3(p, dst, 3);
+                enc3(p, dst, 3, url);
                 p += 3;
                 dst += 4;
         }
-        size_t tail = srclen - n * 3;
+        size_t tail = ep - p;
         BASE64_ASSUME(0 <= tail && tail < 3);
         if (tail > 0) {
                 uint8_t tmp[3];
                 memset(tmp, 0, sizeof(tmp));
                 memcpy(tmp, p, tail);
-                enc3(tmp, dst, tail);
+                if (padding) {
+                        enc3(tmp, dst, tail, url);
+                } else {
+                        char tmpdst[4];
+                        enc3(tmp, tmpdst, tail, url);
+                        memcpy(dst, tmpdst, tail + 1);
+                }
         }
 }
 
-void
-jsonsink_add_binary_base64(struct jsonsink *s, const void *p, size_t sz)
+static void
+base64encode(const void *restrict src, size_t srclen, char *restrict dst)
 {
-        const uint8_t *cp = p;
-        const uint8_t *ep = cp + sz;
-        JSONSINK_ASSUME(cp <= ep);
-        const size_t maxchunksize = JSONSINK_MAX_RESERVATION / 4 * 3;
+        base64encode_common(src, srclen, dst, false, true);
+}
 
-        /*
-         * REVISIT: maybe we can add extra spaces here to make the
-         * base64 output buffer better aligned.
-         */
-        jsonsink_value_start(s);
-        jsonsink_add_fragment(s, "\"", 1);
+static void
+base64urlencode(const void *restrict src, size_t srclen, char *restrict dst)
+{
+        base64encode_common(src, srclen, dst, true, true);
+}
+
+static void
+base64urlencode_nopad(const void *restrict src, size_t srclen,
+                      char *restrict dst)
+{
+        base64encode_common(src, srclen, dst, true, false);
+}
+
+static const struct encoder base64 = {
+        3, 4, base64encode, base64encode_size,
+};
+
+static const struct encoder base64url = {
+        3, 4, base64urlencode, base64encode_size,
+};
+
+static const struct encoder base64url_nopad = {
+        3, 4, base64urlencode_nopad, base64encode_size_nopad,
+};
+
+/**************************************************************************
+ * hex (lowercase)
+ **************************************************************************/
+
+static const char hexdigits[16] = "0123456789abcdef";
+
+static void
+hexencode(const void *restrict src, size_t srclen, char *restrict dst)
+{
+        const uint8_t *p = src;
+        const uint8_t *ep = p + srclen;
+
+#if defined(__AVX2__)
+        /* 32 bytes -> 64 chars */
+        while (ep - p >= 32) {
+                const __m256i digits = _mm256_setr_epi8(
+                        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a',
+                        'b', 'c', 'd', 'e', 'f', '0', '1', '2', '3', '4', '5',
+                        '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+                const __m256i mask = _mm256_set1_epi8(0x0f);
+                __m256i in = _mm256_loadu_si256((const void *)p);
+                __m256i hi = _mm256_shuffle_epi8(
+                        digits,
+                        _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+                __m256i lo = _mm256_shuffle_epi8(
+                        digits, _mm256_and_si256(in, mask));
+                /* unpack works within 128-bit lanes */
+                __m256i a = _mm256_unpacklo_epi8(hi, lo);
+                __m256i b = _mm256_unpackhi_epi8(hi, lo);
+                _mm256_storeu_si256((void *)dst,
+                                    _mm256_permute2x128_si256(a, b, 0x20));
+                _mm256_storeu_si256((void *)(dst + 32),
+                                    _mm256_permute2x128_si256(a, b, 0x31));
+                p += 32;
+                dst += 64;
+        }
+#endif
+#if defined(__SSSE3__)
+        /* 16 bytes -> 32 chars */
+        while (ep - p >= 16) {
+                const __m128i digits =
+                        _mm_loadu_si128((const void *)hexdigits);
+                const __m128i mask = _mm_set1_epi8(0x0f);
+                __m128i in = _mm_loadu_si128((const void *)p);
+                __m128i hi = _mm_shuffle_epi8(
+                        digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+                __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+                _mm_storeu_si128((void *)dst, _mm_unpacklo_epi8(hi, lo));
+                _mm_storeu_si128((void *)(dst + 16),
+                                 _mm_unpackhi_epi8(hi, lo));
+                p += 16;
+                dst += 32;
+        }
+#endif
+        while (p < ep) {
+                uint8_t x = *p++;
+                *dst++ = hexdigits[x >> 4];
+                *dst++ = hexdigits[x & 0xf];
+        }
+}
+
+static size_t
+hexencode_size(size_t srclen)
+{
+        return srclen * 2;
+}
+
+static const struct encoder hex = {
+        1, 2, hexencode, hexencode_size,
+};
+
+/**************************************************************************
+ * base32 (rfc 4648 section 6)
+ **************************************************************************/
+
+static uint8_t
+base32_conv_to_char(uint8_t x)
+{
+        BASE64_ASSUME(x < 32);
+        return x < 26 ? 'A' + x : '2' + (x - 26);
+}
+
+static void
+enc5(const uint8_t p[5], char dst[8])
+{
+        uint64_t x = ((uint64_t)p[0] << 32) | ((uint64_t)p[1] << 24) |
+                     ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 8) | p[4];
+        unsigned int j;
+        for (j = 0; j < 8; j++) {
+                dst[j] = base32_conv_to_char((x >> (35 - j * 5)) & 0x1f);
+        }
+}
+
+#if defined(__SSSE3__)
+/*
+ * base32 simd encoder
+ *
+ * split: split 10 bytes (at offset 0 of each 128-bit lane) into
+ * 16 5-bit indexes. first, each 16-bit word gets a 10-bit field,
+ * which spans two bytes:
+ *
+ *   word 0: (b0 << 8 | b1) >> 6
+ *   word 1: (b1 << 8 | b2) >> 4
+ *   word 2: (b2 << 8 | b3) >> 2
+ *   word 3: (b3 << 8 | b4) >> 0
+ *
+ * the variable right shift is done as a left shift by a multiplication
+ * followed by a constant right shift. then each 10-bit field is split
+ * into two 5-bit indexes in the low and high bytes.
+ *
+ * lookup: 'A' + x for x < 26, '2' + (x - 26) for the rest.
+ */
+
+#define BASE32_SPLIT_SHUFFLE 1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8
+#define BASE32_SPLIT_MUL 1, 4, 16, 64, 1, 4, 16, 64
+
+static __m128i
+base32_split_ssse3(__m128i in)
+{
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(BASE32_SPLIT_SHUFFLE));
+        __m128i f = _mm_srli_epi16(
+                _mm_mullo_epi16(in, _mm_setr_epi16(BASE32_SPLIT_MUL)), 6);
+        __m128i hi = _mm_srli_epi16(f, 5);
+        __m128i lo = _mm_slli_epi16(_mm_and_si128(f, _mm_set1_epi16(0x1f)),
+                                    8);
+        return _mm_or_si128(hi, lo);
+}
+
+static __m128i
+base32_lookup_ssse3(__m128i idx)
+{
+        __m128i ge26 = _mm_cmpgt_epi8(idx, _mm_set1_epi8(25));
+        __m128i r = _mm_add_epi8(idx, _mm_set1_epi8('A'));
+        return _mm_add_epi8(
+                r, _mm_and_si128(ge26, _mm_set1_epi8('2' - 26 - 'A')));
+}
+#endif
+
+#if defined(__AVX2__)
+static __m256i
+base32_split_avx2(__m256i in)
+{
+        in = _mm256_shuffle_epi8(
+                in, _mm256_setr_epi8(BASE32_SPLIT_SHUFFLE,
+                                     BASE32_SPLIT_SHUFFLE));
+        __m256i f = _mm256_srli_epi16(
+                _mm256_mullo_epi16(in,
+                                   _mm256_setr_epi16(BASE32_SPLIT_MUL,
+                                                     BASE32_SPLIT_MUL)),
+                6);
+        __m256i hi = _mm256_srli_epi16(f, 5);
+        __m256i lo = _mm256_slli_epi16(
+                _mm256_and_si256(f, _mm256_set1_epi16(0x1f)), 8);
+        return _mm256_or_si256(hi, lo);
+}
+
+static __m256i
+base32_lookup_avx2(__m256i idx)
+{
+        __m256i ge26 = _mm256_cmpgt_epi8(idx, _mm256_set1_epi8(25));
+        __m256i r = _mm256_add_epi8(idx, _mm256_set1_epi8('A'));
+        return _mm256_add_epi8(
+                r, _mm256_and_si256(ge26, _mm256_set1_epi8('2' - 26 - 'A')));
+}
+#endif
+
+static void
+base32encode(const void *restrict src, size_t srclen, char *restrict dst)
+{
+        const uint8_t *p = src;
+        const uint8_t *ep = p + srclen;
+
+#if defined(__AVX2__)
+        /* 20 bytes -> 32 chars. note that we read 26 bytes. */
+        while (ep - p >= 26) {
+                __m256i in = _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(
+                                _mm_loadu_si128((const void *)p)),
+                        _mm_loadu_si128((const void *)(p + 10)), 1);
+                _mm256_storeu_si256((void *)dst,
+                                    base32_lookup_avx2(base32_split_avx2(in)));
+                p += 20;
+                dst += 32;
+        }
+#endif
+#if defined(__SSSE3__)
+        /* 10 bytes -> 16 chars. note that we read 16 bytes. */
+        while (ep - p >= 16) {
+                __m128i in = _mm_loadu_si128((const void *)p);
+                _mm_storeu_si128((void *)dst,
+                                 base32_lookup_ssse3(base32_split_ssse3(in)));
+                p += 10;
+                dst += 16;
+        }
+#endif
+        while (ep - p >= 5) {
+                enc5(p, dst);
+                p += 5;
+                dst += 8;
+        }
+        size_t tail = ep - p;
+        if (tail > 0) {
+                /* the number of significant characters for the tail */
+                static const uint8_t nchars[5] = {0, 2, 4, 5, 7};
+                uint8_t tmp[5];
+                memset(tmp, 0, sizeof(tmp));
+                memcpy(tmp, p, tail);
+                enc5(tmp, dst);
+                memset(dst + nchars[tail], '=', 8 - nchars[tail]);
+        }
+}
+
+static size_t
+base32encode_size(size_t srclen)
+{
+        return (srclen + 4) / 5 * 8;
+}
+
+static const struct encoder base32 = {
+        5, 8, base32encode, base32encode_size,
+};
+
+/**************************************************************************
+ * the common logic
+ **************************************************************************/
+
+/*
+ * encode: encode the data into the buffer.
+ * only the last call for a value can have a partial block.
+ */
+
+static void
+encode(struct jsonsink *s, const struct encoder *enc, const uint8_t *cp,
+       const uint8_t *ep)
+{
+        JSONSINK_ASSUME(cp <= ep);
+        JSONSINK_ASSUME(enc->outblock <= 8);
         while (cp < ep) {
                 size_t len = ep - cp;
-                if (len > maxchunksize) {
-                        len = maxchunksize;
+                size_t bsz = enc->size(len);
+                size_t minlen = bsz;
+                if (minlen > JSONSINK_MAX_RESERVATION) {
+                        minlen = JSONSINK_MAX_RESERVATION / 8 * 8;
+                }
+                size_t avail;
+                void *dest = jsonsink_reserve_buffer_upto(s, minlen, bsz,
+                                                          &avail);
+                if (avail < bsz) {
+                        /*
+                         * only a part of the output fits the buffer.
+                         * encode whole 32-character blocks if possible
+                         * to keep the simd stores aligned.
+                         */
+                        if (avail >= 32) {
+                                bsz = avail & ~(size_t)31;
+                        } else {
+                                bsz = avail - avail % enc->outblock;
+                        }
+                        JSONSINK_ASSUME(bsz % enc->outblock == 0);
+                        len = bsz / enc->outblock * enc->inblock;
                 }
-                size_t bsz = base64encode_size(len);
-                JSONSINK_ASSUME(bsz <= JSONSINK_MAX_RESERVATION);
-                void *dest = jsonsink_reserve_buffer(s, bsz);
                 if (dest != NULL) {
-                        base64encode(cp, len, dest);
+                        enc->encode(cp, len, dest);
                 }
                 jsonsink_commit_buffer(s, bsz);
                 cp += len;
         }
+}
+
+#if JSONSINK_BASE64_ALIGN > 0
+static void
+align_output(struct jsonsink *s)
+{
+        /*
+         * insert whitespaces so that the encoded data (after the opening
+         * quote) starts at an aligned offset in the buffer.
+         */
+        const size_t align = JSONSINK_BASE64_ALIGN;
+        char *dest = jsonsink_reserve_buffer(s, align);
+        size_t npad = (align - (s->bufpos + 1) % align) % align;
+        if (dest != NULL) {
+                memset(dest, ' ', npad);
+        }
+        jsonsink_commit_buffer(s, npad);
+}
+#endif
+
+static void
+add_binary(struct jsonsink *s, const struct encoder *enc, const void *p,
+           size_t sz)
+{
+        const uint8_t *cp = p;
+        const uint8_t *ep = cp + sz;
+        JSONSINK_ASSUME(cp <= ep);
+
+        jsonsink_value_start(s);
+#if JSONSINK_BASE64_ALIGN > 0
+        if (sz >= BASE64_ALIGN_THRESHOLD) {
+                align_output(s);
+        }
+#endif
+        jsonsink_add_fragment(s, "\"", 1);
+        encode(s, enc, cp, ep);
+        jsonsink_add_fragment(s, "\"", 1);
+        jsonsink_value_end(s);
+}
+
+void
+jsonsink_add_binary_base64(struct jsonsink *s, const void *p, size_t sz)
+{
+        add_binary(s, &base64, p, sz);
+}
+
+void
+jsonsink_add_binary_base64url(struct jsonsink *s, const void *p, size_t sz,
+                              bool padding)
+{
+        add_binary(s, padding ? &base64url : &base64url_nopad, p, sz);
+}
+
+void
+jsonsink_add_binary_hex(struct jsonsink *s, const void *p, size_t sz)
+{
+        add_binary(s, &hex, p, sz);
+}
+
+void
+jsonsink_add_binary_base32(struct jsonsink *s, const void *p, size_t sz)
+{
+        add_binary(s, &base32, p, sz);
+}
+
+/*
+ * streaming api
+ *
+ * s->carry keeps the last 0-2 bytes which don't form a complete
+ * 3-byte block yet.
+ */
+
+void
+jsonsink_base64_start(struct jsonsink *s)
+{
+        jsonsink_value_start(s);
+        jsonsink_add_fragment(s, "\"", 1);
+        s->carrylen = 0;
+}
+
+void
+jsonsink_base64_append(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        const uint8_t *ep = cp + sz;
+        JSONSINK_ASSUME(cp <= ep);
+        JSONSINK_ASSUME(s->carrylen < 3);
+
+        if (sz == 0) {
+                return;
+        }
+        if (s->carrylen > 0) {
+                while (s->carrylen < 3 && cp < ep) {
+                        s->carry[s->carrylen++] = *cp++;
+                }
+                if (s->carrylen < 3) {
+                        return;
+                }
+                encode(s, &base64, s->carry, s->carry + 3);
+                s->carrylen = 0;
+        }
+        size_t tail = (ep - cp) % 3;
+        encode(s, &base64, cp, ep - tail);
+        memcpy(s->carry, ep - tail, tail);
+        s->carrylen = tail;
+}
+
+void
+jsonsink_base64_end(struct jsonsink *s)
+{
+        JSONSINK_ASSUME(s->carrylen < 3);
+        encode(s, &base64, s->carry, s->carry + s->carrylen);
+        s->carrylen = 0;
         jsonsink_add_fragment(s, "\"", 1);
         jsonsink_value_end(s);
 }
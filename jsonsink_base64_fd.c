@@ -0,0 +1,62 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+
+/*
+ * a multiple of 3 to avoid carrying bytes between chunks.
+ */
+#define READ_CHUNK_SIZE (3 * 4096)
+
+void
+jsonsink_add_base64_fd(struct jsonsink *s, int fd, size_t len)
+{
+        unsigned char buf[READ_CHUNK_SIZE];
+
+        jsonsink_base64_start(s);
+        while (len > 0) {
+                size_t want = len;
+                if (want > sizeof(buf)) {
+                        want = sizeof(buf);
+                }
+                ssize_t ret = read(fd, buf, want);
+                if (ret == -1 && errno == EINTR) {
+                        continue;
+                }
+                if (ret <= 0) {
+                        /* an error or unexpected eof */
+                        jsonsink_set_error(s, JSONSINK_ERROR_READ_FAILED);
+                        break;
+                }
+                jsonsink_base64_append(s, buf, ret);
+                len -= ret;
+        }
+        jsonsink_base64_end(s);
+}
@@ -0,0 +1,102 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * a direct-mapped cache of formatted doubles.
+ *
+ * on a miss, the value is formatted with jsonsink_add_double into a
+ * temporary sink so that the cache works with any serialization backend.
+ */
+
+#include <string.h>
+
+#include "jsonsink.h"
+
+struct jsonsink_double_cache_entry {
+        uint64_t bits;
+        uint8_t len; /* 0 for an empty entry */
+        char text[JSONSINK_DOUBLE_CACHE_ENTRY_SIZE - 9];
+};
+
+void
+jsonsink_double_cache_init(struct jsonsink_double_cache *c, void *mem,
+                           size_t memsize)
+{
+        JSONSINK_ASSUME(sizeof(struct jsonsink_double_cache_entry) ==
+                        JSONSINK_DOUBLE_CACHE_ENTRY_SIZE);
+        size_t n = memsize / sizeof(struct jsonsink_double_cache_entry);
+        JSONSINK_ASSERT(n > 0);
+        /* round down to a power of 2 */
+        while ((n & (n - 1)) != 0) {
+                n &= n - 1;
+        }
+        memset(mem, 0, n * sizeof(struct jsonsink_double_cache_entry));
+        c->entries = mem;
+        c->mask = n - 1;
+        c->hits = 0;
+        c->misses = 0;
+}
+
+void
+jsonsink_add_double_cached(struct jsonsink *s, struct jsonsink_double_cache *c,
+                           double v)
+{
+        const uint64_t k = 0x9e3779b97f4a7c15;
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        /*
+         * fold the exponent and the upper mantissa bits into the lower
+         * half first. "round" values have only zeros there.
+         */
+        uint64_t h = (bits ^ (bits >> 32)) * k;
+        struct jsonsink_double_cache_entry *e =
+                &c->entries[(h >> 32) & c->mask];
+        if (e->bits == bits && e->len != 0) {
+                c->hits++;
+                jsonsink_add_serialized_value(s, e->text, e->len);
+                return;
+        }
+        c->misses++;
+
+        char buf[JSONSINK_MAX_RESERVATION];
+        struct jsonsink tmp;
+        jsonsink_init(&tmp);
+        jsonsink_set_buffer(&tmp, buf, sizeof(buf));
+        jsonsink_add_double(&tmp, v);
+        int error = jsonsink_error(&tmp);
+        if (error != JSONSINK_OK) {
+                jsonsink_set_error(s, error);
+                return;
+        }
+        size_t len = jsonsink_size(&tmp);
+        if (len <= sizeof(e->text)) {
+                e->bits = bits;
+                e->len = len;
+                memcpy(e->text, buf, len);
+        }
+        jsonsink_add_serialized_value(s, buf, len);
+}
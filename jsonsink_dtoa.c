@@ -0,0 +1,922 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * shortest round-trip double and float to decimal string conversion.
+ *
+ * the digits are calculated with the schubfach algorithm.
+ * (Raffaello Giulietti, "The Schubfach way to render doubles")
+ * the structure of the code follows the implementation in Drachennest
+ * by Alexander Bolz.
+ *
+ * [Drachennest]: https://github.com/abolz/Drachennest
+ *
+ * the algorithm needs 128-bit approximations of 10^k for
+ * -292 <= k <= 326. instead of having a table of all of them (about 10KB)
+ * we only have every 27th of them and recover the others by multiplying
+ * 5^n, similarly to the compressed cache of dragonbox. the recovered values
+ * are slightly smaller than the correct ones because the truncation errors
+ * of the base values are amplified. the differences are small (1 to 3)
+ * and kept in a 2-bit table.
+ */
+
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+#include <math.h>
+#endif
+#include <string.h>
+
+#include "jsonsink.h"
+
+struct u128 {
+        uint64_t hi;
+        uint64_t lo;
+};
+
+static struct u128
+mul64(uint64_t a, uint64_t b)
+{
+        struct u128 r;
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 p = (unsigned __int128)a * b;
+        r.hi = (uint64_t)(p >> 64);
+        r.lo = (uint64_t)p;
+#else
+        uint64_t a_lo = (uint32_t)a;
+        uint64_t a_hi = a >> 32;
+        uint64_t b_lo = (uint32_t)b;
+        uint64_t b_hi = b >> 32;
+        uint64_t ll = a_lo * b_lo;
+        uint64_t lh = a_lo * b_hi;
+        uint64_t hl = a_hi * b_lo;
+        uint64_t hh = a_hi * b_hi;
+        uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+        r.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+        r.lo = (mid << 32) | (uint32_t)ll;
+#endif
+        return r;
+}
+
+/*
+ * pow10_base[i]: floor(10^k * 2^(127 - floor(log2(10^k))))
+ * for k = -297 + 27 * i
+ *
+ * pow5[i]: 5^i
+ *
+ * pow10_corr: the differences between the recovered values and the
+ * correct ones, minus 1. 2 bits for each k, starting from k = -297.
+ */
+
+#define POW10_KMIN -297
+#define POW10_STEP 27
+
+static const uint64_t pow10_base[24][2] = {
+        {0xa76c582338ed2621, 0xaf2af2b80af6f24e}, /* -297 */
+        {0x873e4f75e2224e68, 0x5a7744a6e804a291}, /* -270 */
+        {0xda7f5bf590966848, 0xaf39a475506a899e}, /* -243 */
+        {0xb080392cc4349dec, 0xbd8d794d96aacfb3}, /* -216 */
+        {0x8e938662882af53e, 0x547eb47b7282ee9c}, /* -189 */
+        {0xe65829b3046b0afa, 0x0cb4a5a3112a5112}, /* -162 */
+        {0xba121a4650e4ddeb, 0x92f34d62616ce413}, /* -135 */
+        {0x964e858c91ba2655, 0x3a6a07f8d510f86f}, /* -108 */
+        {0xf2d56790ab41c2a2, 0xfae27299423fb9c3}, /* -81 */
+        {0xc428d05aa4751e4c, 0xaa97e14c3c26b886}, /* -54 */
+        {0x9e74d1b791e07e48, 0x775ea264cf55347d}, /* -27 */
+        {0x8000000000000000, 0x0000000000000000}, /* 0 */
+        {0xcecb8f27f4200f3a, 0x0000000000000000}, /* 27 */
+        {0xa70c3c40a64e6c51, 0x999090b65f67d924}, /* 54 */
+        {0x86f0ac99b4e8dafd, 0x69a028bb3ded71a3}, /* 81 */
+        {0xda01ee641a708de9, 0xe80e6f4820cc9495}, /* 108 */
+        {0xb01ae745b101e9e4, 0x5ec05dcff72e7f8f}, /* 135 */
+        {0x8e41ade9fbebc27d, 0x14588f13be847307}, /* 162 */
+        {0xe5d3ef282a242e81, 0x8f1668c8a86da5fa}, /* 189 */
+        {0xb9a74a0637ce2ee1, 0x6d953e2bd7173692}, /* 216 */
+        {0x95f83d0a1fb69cd9, 0x4abdaf101564f98e}, /* 243 */
+        {0xf24a01a73cf2dccf, 0xbc633b39673c8cec}, /* 270 */
+        {0xc3b8358109e84f07, 0x0a862f80ec4700c8}, /* 297 */
+        {0x9e19db92b4e31ba9, 0x6c07a2c26a8346d1}, /* 324 */
+};
+static const uint64_t pow5[27] = {
+        1,
+        5,
+        25,
+        125,
+        625,
+        3125,
+        15625,
+        78125,
+        390625,
+        1953125,
+        9765625,
+        48828125,
+        244140625,
+        1220703125,
+        6103515625u,
+        30517578125u,
+        152587890625u,
+        762939453125u,
+        3814697265625u,
+        19073486328125u,
+        95367431640625u,
+        476837158203125u,
+        2384185791015625u,
+        11920928955078125u,
+        59604644775390625u,
+        298023223876953125u,
+        1490116119384765625u,
+};
+static const uint32_t pow10_corr[41] = {
+        0x00500000, 0x15040140, 0x59555651, 0x151045a5, 0x41550151, 0x94955550,
+        0x10554565, 0x41500144, 0x04101110, 0x01000550, 0x00000004, 0x50000000,
+        0x54555a55, 0x10045965, 0x04000014, 0x41455500, 0x45551045, 0x41546551,
+        0x00011514, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x56400000,
+        0xa6596955, 0x51554165, 0x14055555, 0x15154454, 0x04155545, 0x04404000,
+        0x45550400, 0x55151555, 0x05414111, 0x00550511, 0x04000000, 0x10000000,
+        0x00000100, 0x00000000, 0x40000000, 0x00000000, 0x00000000,
+};
+
+static int
+floor_log2_pow10(int e)
+{
+        return (e * 1741647) >> 19;
+}
+
+static int
+floor_log10_pow2(int e)
+{
+        return (e * 315653) >> 20;
+}
+
+static int
+floor_log10_three_quarters_pow2(int e)
+{
+        return (e * 315653 - 131237) >> 20;
+}
+
+/*
+ * compute_pow10: floor(10^k * 2^(127 - floor(log2(10^k)))) + 1
+ */
+
+static struct u128
+compute_pow10(int k)
+{
+        unsigned int idx = k - POW10_KMIN;
+        unsigned int off = idx % POW10_STEP;
+        const uint64_t *base = pow10_base[idx / POW10_STEP];
+        struct u128 r;
+
+        if (off == 0) {
+                r.hi = base[0];
+                r.lo = base[1];
+        } else {
+                /* base * 5^off, shifted right to have 128 bits */
+                int kb = k - off;
+                unsigned int sh = floor_log2_pow10(k) - floor_log2_pow10(kb) -
+                                  off;
+                JSONSINK_ASSUME(sh > 0 && sh < 64);
+                struct u128 l = mul64(base[1], pow5[off]);
+                struct u128 h = mul64(base[0], pow5[off]);
+                uint64_t p0 = l.lo;
+                uint64_t p1 = h.lo + l.hi;
+                uint64_t p2 = h.hi + (p1 < l.hi);
+                r.hi = (p2 << (64 - sh)) | (p1 >> sh);
+                r.lo = (p1 << (64 - sh)) | (p0 >> sh);
+        }
+        uint64_t corr = (pow10_corr[idx / 16] >> (idx % 16 * 2)) & 3;
+        r.lo += corr + 1;
+        r.hi += r.lo < corr + 1;
+        return r;
+}
+
+static uint64_t
+round_to_odd(struct u128 g, uint64_t cp)
+{
+        struct u128 x = mul64(g.lo, cp);
+        struct u128 y = mul64(g.hi, cp);
+        uint64_t y0 = y.lo + x.hi;
+        uint64_t y1 = y.hi + (y0 < x.hi);
+        return y1 | (y0 > 1);
+}
+
+/*
+ * to_decimal: calculate the shortest decimal m * 10^e which rounds to
+ * c * 2^q.
+ */
+
+static uint64_t
+to_decimal64(uint64_t c, int q, bool lower_closer, int *ep)
+{
+        bool is_even = (c & 1) == 0;
+        uint64_t cbl = 4 * c - 2 + lower_closer;
+        uint64_t cb = 4 * c;
+        uint64_t cbr = 4 * c + 2;
+        int k = lower_closer ? floor_log10_three_quarters_pow2(q)
+                             : floor_log10_pow2(q);
+        int h = q + floor_log2_pow10(-k) + 1;
+        JSONSINK_ASSUME(h >= 1 && h <= 4);
+        struct u128 g = compute_pow10(-k);
+        uint64_t vbl = round_to_odd(g, cbl << h);
+        uint64_t vb = round_to_odd(g, cb << h);
+        uint64_t vbr = round_to_odd(g, cbr << h);
+        uint64_t lower = vbl + !is_even;
+        uint64_t upper = vbr - !is_even;
+        uint64_t s = vb / 4;
+
+        if (s >= 10) {
+                uint64_t sp = s / 10;
+                bool up_inside = lower <= 40 * sp;
+                bool wp_inside = 40 * sp + 40 <= upper;
+                if (up_inside != wp_inside) {
+                        *ep = k + 1;
+                        return sp + wp_inside;
+                }
+        }
+        bool u_inside = lower <= 4 * s;
+        bool w_inside = 4 * s + 4 <= upper;
+        if (u_inside != w_inside) {
+                *ep = k;
+                return s + w_inside;
+        }
+        uint64_t mid = 4 * s + 2;
+        bool round_up = vb > mid || (vb == mid && (s & 1) != 0);
+        *ep = k;
+        return s + round_up;
+}
+
+static uint64_t
+rotr(uint64_t x, unsigned int n)
+{
+        return (x >> n) | (x << (64 - n));
+}
+
+/*
+ * remove_trailing_zeros: m / 10^n for the largest n which divides m.
+ *
+ * m is divisible by 10^n iff rotr(m * (5^-n mod 2^64), n) <= (2^64-1) / 10^n
+ * and the rotated value is the quotient. (Granlund and Montgomery)
+ * it's cheaper than the usual m % 10^n.
+ */
+
+static uint64_t
+remove_trailing_zeros(uint64_t m, int *ep)
+{
+        uint64_t t;
+        int e = *ep;
+
+        JSONSINK_ASSUME(m != 0);
+        while ((t = rotr(m * 0xc767074b22e90e21, 8)) <= 184467440737) {
+                m = t;
+                e += 8;
+        }
+        if ((t = rotr(m * 0xd288ce703afb7e91, 4)) <= 1844674407370955) {
+                m = t;
+                e += 4;
+        }
+        if ((t = rotr(m * 0x8f5c28f5c28f5c29, 2)) <= 184467440737095516) {
+                m = t;
+                e += 2;
+        }
+        if ((t = rotr(m * 0xcccccccccccccccd, 1)) <= 1844674407370955161) {
+                m = t;
+                e += 1;
+        }
+        *ep = e;
+        return m;
+}
+
+/*
+ * format_decimal: write m * 10^e and return the end of the output.
+ * m should not have trailing zeros.
+ *
+ * the output format is the same as javascript Number.prototype.toString:
+ * the exponent notation is only used for very large or small values.
+ *
+ *   100, 1.5, 0.001, 1e+21, 1.5e-7
+ *
+ * except that the fixed notation is used for 0.ddd * 10^n down to
+ * n = min_n. (-5 for javascript)
+ *
+ * the digits are written at p + 1 first and then moved as necessary.
+ */
+
+static char *
+format_decimal(char *p, uint64_t m, int e, int min_n)
+{
+        int len = jsonsink_format_uint64(p + 1, m);
+        int n = len + e;
+        if (0 < n && n <= 21) {
+                if (len <= n) {
+                        /* 12300 */
+                        memmove(p, p + 1, len);
+                        memset(p + len, '0', n - len);
+                        p += n;
+                } else {
+                        /* 12.3 */
+                        memmove(p, p + 1, n);
+                        p[n] = '.';
+                        p += len + 1;
+                }
+        } else if (min_n <= n && n <= 0) {
+                /* 0.00123 */
+                memmove(p + 2 - n, p + 1, len);
+                p[0] = '0';
+                p[1] = '.';
+                memset(p + 2, '0', -n);
+                p += 2 - n + len;
+        } else {
+                /* 1.23e+45 */
+                p[0] = p[1];
+                if (len > 1) {
+                        p[1] = '.';
+                        p += len + 1;
+                } else {
+                        p += 1;
+                }
+                *p++ = 'e';
+                int x = n - 1;
+                if (x < 0) {
+                        *p++ = '-';
+                        x = -x;
+                } else {
+                        *p++ = '+';
+                }
+                p += jsonsink_format_uint32(p, x);
+        }
+        return p;
+}
+
+size_t
+jsonsink_format_double(char *dst, double v)
+{
+        uint64_t bits;
+        char *p = dst;
+
+        memcpy(&bits, &v, sizeof(bits));
+        /* branchless as the sign is often random */
+        *p = '-';
+        p += bits >> 63;
+        uint64_t ieee_sig = bits & (((uint64_t)1 << 52) - 1);
+        unsigned int ieee_exp = (bits >> 52) & 0x7ff;
+        uint64_t c;
+        int q;
+
+        JSONSINK_ASSERT(ieee_exp != 0x7ff); /* nan or inf */
+        if (ieee_exp == 0) {
+                if (ieee_sig == 0) {
+                        *p++ = '0';
+                        return p - dst;
+                }
+                c = ieee_sig;
+                q = 1 - 1075;
+        } else {
+                c = ieee_sig | ((uint64_t)1 << 52);
+                q = (int)ieee_exp - 1075;
+                /* integers < 2^53 */
+                if (q <= 0 && q >= -52 &&
+                    (c & (((uint64_t)1 << -q) - 1)) == 0) {
+                        p += jsonsink_format_uint64(p, c >> -q);
+                        return p - dst;
+                }
+        }
+
+        int e;
+        uint64_t m = to_decimal64(c, q, ieee_sig == 0 && ieee_exp > 1, &e);
+        m = remove_trailing_zeros(m, &e);
+
+        p = format_decimal(p, m, e, -5);
+        JSONSINK_ASSUME(p - dst <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        return p - dst;
+}
+
+/*
+ * precision-limited output
+ */
+
+static const uint64_t pow10_u64[20] = {
+        1,
+        10,
+        100,
+        1000,
+        10000,
+        100000,
+        1000000,
+        10000000,
+        100000000,
+        1000000000,
+        10000000000,
+        100000000000,
+        1000000000000,
+        10000000000000,
+        100000000000000,
+        1000000000000000,
+        10000000000000000,
+        100000000000000000,
+        1000000000000000000,
+        10000000000000000000u,
+};
+
+static bool
+decompose(double v, uint64_t *cp, int *qp, bool *lower_closerp)
+{
+        uint64_t bits;
+
+        memcpy(&bits, &v, sizeof(bits));
+        uint64_t ieee_sig = bits & (((uint64_t)1 << 52) - 1);
+        unsigned int ieee_exp = (bits >> 52) & 0x7ff;
+        JSONSINK_ASSERT(ieee_exp != 0x7ff); /* nan or inf */
+        if (ieee_exp == 0) {
+                if (ieee_sig == 0) {
+                        return false;
+                }
+                *cp = ieee_sig;
+                *qp = 1 - 1075;
+        } else {
+                *cp = ieee_sig | ((uint64_t)1 << 52);
+                *qp = (int)ieee_exp - 1075;
+        }
+        *lower_closerp = ieee_sig == 0 && ieee_exp > 1;
+        return true;
+}
+
+/*
+ * compare_exact: compare c * 2^q with m * 10^e exactly.
+ * m * 10^e should be derived from the result of to_decimal64 for c * 2^q.
+ *
+ * as vb in to_decimal64 is rounded to odd, comparing it with a multiple
+ * of 4 gives the exact result.
+ */
+
+static int
+compare_exact(uint64_t c, int q, bool lower_closer, uint64_t m, int e)
+{
+        int k = lower_closer ? floor_log10_three_quarters_pow2(q)
+                             : floor_log10_pow2(q);
+        int h = q + floor_log2_pow10(-k) + 1;
+        uint64_t vb = round_to_odd(compute_pow10(-k), (4 * c) << h);
+        JSONSINK_ASSUME(e >= k && e - k <= 18);
+        uint64_t x = 4 * m * pow10_u64[e - k];
+        return (vb > x) - (vb < x);
+}
+
+/*
+ * round_digits: round m * 10^e, the shortest representation of c * 2^q,
+ * to a multiple of 10^(e + j). the result is in the unit of 10^(e + j).
+ *
+ * as m is the shortest representation, rounding m gives the same result
+ * as rounding c * 2^q except when m is just at the midpoint. in that case,
+ * c * 2^q is compared with m exactly.
+ */
+
+static uint64_t
+round_digits(uint64_t m, int e, unsigned int j, uint64_t c, int q,
+             bool lower_closer)
+{
+        if (j >= 20) {
+                return 0;
+        }
+        uint64_t d = pow10_u64[j];
+        uint64_t t = m / d;
+        uint64_t r = m - t * d;
+        uint64_t half = d / 2;
+        if (r > half) {
+                t++;
+        } else if (r == half) {
+                int cmp = compare_exact(c, q, lower_closer, m, e);
+                if (cmp > 0 || (cmp == 0 && (t & 1) != 0)) {
+                        t++;
+                }
+        }
+        return t;
+}
+
+/*
+ * scale_round: round_half_even(c * 2^q * 10^d) for 0 <= d <= 26.
+ * return false if the result doesn't fit in 64 bits.
+ *
+ * the calculation is exact, using:
+ *
+ *   c * 2^q * 10^d = c * 5^d * 2^(q + d)
+ *
+ * where c * 5^d < 2^(53 + 61) fits in 128 bits.
+ */
+
+static bool
+scale_round(uint64_t c, int q, unsigned int d, uint64_t *np)
+{
+        JSONSINK_ASSUME(d < 27);
+        struct u128 x = mul64(c, pow5[d]);
+        int sh = -(q + (int)d);
+        uint64_t n;
+        if (sh <= 0) {
+                /* an integer. no rounding is necessary */
+                if (x.hi != 0 || sh <= -64 ||
+                    (sh < 0 && (x.lo >> (64 + sh)) != 0)) {
+                        return false;
+                }
+                *np = x.lo << -sh;
+                return true;
+        }
+
+        /*
+         * n = round_half_even(x / 2^sh)
+         * rem: x % 2^sh, half: 2^(sh-1), both in 128 bits
+         */
+        struct u128 rem;
+        struct u128 half;
+        if (sh >= 128) {
+                n = 0;
+                rem = x;
+                half.hi = ~(uint64_t)0; /* larger than x */
+                half.lo = 0;
+        } else if (sh >= 64) {
+                n = x.hi >> (sh - 64);
+                rem.hi = x.hi & (((uint64_t)1 << (sh - 64)) - 1);
+                rem.lo = x.lo;
+                half.hi = sh > 64 ? (uint64_t)1 << (sh - 65) : 0;
+                half.lo = sh > 64 ? 0 : (uint64_t)1 << 63;
+        } else {
+                if ((x.hi >> sh) != 0) {
+                        return false;
+                }
+                n = (x.lo >> sh) | (x.hi << (63 - sh) << 1);
+                rem.hi = 0;
+                rem.lo = x.lo & (((uint64_t)1 << sh) - 1);
+                half.hi = 0;
+                half.lo = (uint64_t)1 << (sh - 1);
+        }
+        if (rem.hi > half.hi ||
+            (rem.hi == half.hi &&
+             (rem.lo > half.lo || (rem.lo == half.lo && (n & 1) != 0)))) {
+                n++;
+                if (n == 0) {
+                        return false;
+                }
+        }
+        *np = n;
+        return true;
+}
+
+/*
+ * jsonsink_format_double_fixed: when |v| * 10^decimals < 2^64, the
+ * value is scaled and rounded exactly with scale_round.
+ * otherwise the value has no more than `decimals` decimals in its shortest
+ * representation anyway. (ulp(v) > 1000 * 10^-decimals)
+ */
+
+size_t
+jsonsink_format_double_fixed(char *dst, double v, unsigned int decimals)
+{
+        uint64_t c;
+        int q;
+        bool lower_closer;
+        char *p = dst;
+
+        JSONSINK_ASSERT(decimals <= JSONSINK_DOUBLE_FIXED_MAX_DECIMALS);
+        if (!decompose(v, &c, &q, &lower_closer)) {
+                *p++ = '0';
+                return p - dst;
+        }
+        uint64_t n;
+        int e;
+        if (q >= 0) {
+                /* integers >= 2^52 */
+                if (q > 11) {
+                        return jsonsink_format_double(dst, v);
+                }
+                n = c << q;
+                e = 0;
+        } else {
+                if (!scale_round(c, q, decimals, &n)) {
+                        return jsonsink_format_double(dst, v);
+                }
+                if (n == 0) {
+                        *p++ = '0';
+                        return p - dst;
+                }
+                e = -(int)decimals;
+        }
+        n = remove_trailing_zeros(n, &e);
+        *p = '-';
+        p += v < 0;
+        p = format_decimal(p, n, e, -JSONSINK_DOUBLE_FIXED_MAX_DECIMALS);
+        JSONSINK_ASSUME(p - dst <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        return p - dst;
+}
+
+/*
+ * jsonsink_format_double_sig: for up to 15 digits, the exact value is
+ * rounded with scale_round after estimating its decimal exponent.
+ * otherwise, or when the scaled value doesn't fit in 64 bits, the shortest
+ * representation is rounded with round_digits, which consults the exact
+ * value for ties.
+ */
+
+size_t
+jsonsink_format_double_sig(char *dst, double v, unsigned int digits)
+{
+        uint64_t c;
+        int q;
+        bool lower_closer;
+        char *p = dst;
+        uint64_t m;
+        int e;
+
+        JSONSINK_ASSERT(digits >= 1 && digits <= 17);
+        if (!decompose(v, &c, &q, &lower_closer)) {
+                *p++ = '0';
+                return p - dst;
+        }
+        if (digits <= 15) {
+                /*
+                 * 2^(q + bits - 1) <= v < 2^(q + bits)
+                 * the decimal exponent of v is k or k + 1.
+                 */
+                int bits = 64 - __builtin_clzll(c);
+                int k = floor_log10_pow2(q + bits - 1);
+                int d = (int)digits - 1 - k;
+                if (d >= 0 && d < 27 && scale_round(c, q, d, &m)) {
+                        if (m > pow10_u64[digits]) {
+                                /* the exponent was k + 1 */
+                                if (d == 0 || !scale_round(c, q, --d, &m)) {
+                                        goto shortest;
+                                }
+                        }
+                        e = -d;
+                        goto done;
+                }
+        }
+shortest:
+        m = to_decimal64(c, q, lower_closer, &e);
+        m = remove_trailing_zeros(m, &e);
+        unsigned int len = 1;
+        while (len < 20 && m >= pow10_u64[len]) {
+                len++;
+        }
+        if (len > digits) {
+                unsigned int j = len - digits;
+                m = round_digits(m, e, j, c, q, lower_closer);
+                e += j;
+        }
+done:
+        m = remove_trailing_zeros(m, &e);
+        *p = '-';
+        p += v < 0;
+        p = format_decimal(p, m, e, -5);
+        JSONSINK_ASSUME(p - dst <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        return p - dst;
+}
+
+void
+jsonsink_add_double_fixed(struct jsonsink *s, double v, unsigned int decimals)
+{
+        JSONSINK_ASSERT(!isnan(v));
+        JSONSINK_ASSERT(!isinf(v));
+        const size_t maxlen = JSONSINK_FORMAT_DOUBLE_MAXLEN;
+        char tmp[JSONSINK_FORMAT_DOUBLE_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_double_fixed(dest != NULL ? dest : tmp,
+                                                  v, decimals);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_double_sig(struct jsonsink *s, double v, unsigned int digits)
+{
+        JSONSINK_ASSERT(!isnan(v));
+        JSONSINK_ASSERT(!isinf(v));
+        const size_t maxlen = JSONSINK_FORMAT_DOUBLE_MAXLEN;
+        char tmp[JSONSINK_FORMAT_DOUBLE_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_double_sig(dest != NULL ? dest : tmp, v,
+                                                digits);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+/*
+ * single precision
+ *
+ * the same algorithm with 64-bit approximations of 10^k.
+ * (-31 <= k <= 46) the table is small enough to have all of them.
+ */
+
+/*
+ * pow10_32[k + 31]: floor(10^k * 2^(63 - floor(log2(10^k)))) + 1
+ */
+
+static const uint64_t pow10_32[78] = {
+        0x81ceb32c4b43fcf5, /* -31 */
+        0xa2425ff75e14fc32, /* -30 */
+        0xcad2f7f5359a3b3f, /* -29 */
+        0xfd87b5f28300ca0e, /* -28 */
+        0x9e74d1b791e07e49, /* -27 */
+        0xc612062576589ddb, /* -26 */
+        0xf79687aed3eec552, /* -25 */
+        0x9abe14cd44753b53, /* -24 */
+        0xc16d9a0095928a28, /* -23 */
+        0xf1c90080baf72cb2, /* -22 */
+        0x971da05074da7bef, /* -21 */
+        0xbce5086492111aeb, /* -20 */
+        0xec1e4a7db69561a6, /* -19 */
+        0x9392ee8e921d5d08, /* -18 */
+        0xb877aa3236a4b44a, /* -17 */
+        0xe69594bec44de15c, /* -16 */
+        0x901d7cf73ab0acda, /* -15 */
+        0xb424dc35095cd810, /* -14 */
+        0xe12e13424bb40e14, /* -13 */
+        0x8cbccc096f5088cc, /* -12 */
+        0xafebff0bcb24aaff, /* -11 */
+        0xdbe6fecebdedd5bf, /* -10 */
+        0x89705f4136b4a598, /* -9 */
+        0xabcc77118461cefd, /* -8 */
+        0xd6bf94d5e57a42bd, /* -7 */
+        0x8637bd05af6c69b6, /* -6 */
+        0xa7c5ac471b478424, /* -5 */
+        0xd1b71758e219652c, /* -4 */
+        0x83126e978d4fdf3c, /* -3 */
+        0xa3d70a3d70a3d70b, /* -2 */
+        0xcccccccccccccccd, /* -1 */
+        0x8000000000000001, /* 0 */
+        0xa000000000000001, /* 1 */
+        0xc800000000000001, /* 2 */
+        0xfa00000000000001, /* 3 */
+        0x9c40000000000001, /* 4 */
+        0xc350000000000001, /* 5 */
+        0xf424000000000001, /* 6 */
+        0x9896800000000001, /* 7 */
+        0xbebc200000000001, /* 8 */
+        0xee6b280000000001, /* 9 */
+        0x9502f90000000001, /* 10 */
+        0xba43b74000000001, /* 11 */
+        0xe8d4a51000000001, /* 12 */
+        0x9184e72a00000001, /* 13 */
+        0xb5e620f480000001, /* 14 */
+        0xe35fa931a0000001, /* 15 */
+        0x8e1bc9bf04000001, /* 16 */
+        0xb1a2bc2ec5000001, /* 17 */
+        0xde0b6b3a76400001, /* 18 */
+        0x8ac7230489e80001, /* 19 */
+        0xad78ebc5ac620001, /* 20 */
+        0xd8d726b7177a8001, /* 21 */
+        0x878678326eac9001, /* 22 */
+        0xa968163f0a57b401, /* 23 */
+        0xd3c21bcecceda101, /* 24 */
+        0x84595161401484a1, /* 25 */
+        0xa56fa5b99019a5c9, /* 26 */
+        0xcecb8f27f4200f3b, /* 27 */
+        0x813f3978f8940985, /* 28 */
+        0xa18f07d736b90be6, /* 29 */
+        0xc9f2c9cd04674edf, /* 30 */
+        0xfc6f7c4045812297, /* 31 */
+        0x9dc5ada82b70b59e, /* 32 */
+        0xc5371912364ce306, /* 33 */
+        0xf684df56c3e01bc7, /* 34 */
+        0x9a130b963a6c115d, /* 35 */
+        0xc097ce7bc90715b4, /* 36 */
+        0xf0bdc21abb48db21, /* 37 */
+        0x96769950b50d88f5, /* 38 */
+        0xbc143fa4e250eb32, /* 39 */
+        0xeb194f8e1ae525fe, /* 40 */
+        0x92efd1b8d0cf37bf, /* 41 */
+        0xb7abc627050305ae, /* 42 */
+        0xe596b7b0c643c71a, /* 43 */
+        0x8f7e32ce7bea5c70, /* 44 */
+        0xb35dbf821ae4f38c, /* 45 */
+        0xe0352f62a19e306f, /* 46 */
+};
+
+static uint32_t
+round_to_odd32(uint64_t g, uint32_t cp)
+{
+        uint64_t b01 = (g & 0xffffffff) * cp;
+        uint64_t b11 = (g >> 32) * cp;
+        uint64_t hi = b11 + (b01 >> 32);
+        uint32_t y1 = hi >> 32;
+        uint32_t y0 = (uint32_t)hi;
+        return y1 | (y0 > 1);
+}
+
+/*
+ * to_decimal32: calculate the shortest decimal m * 10^e which rounds to
+ * the float c * 2^q.
+ */
+
+static uint32_t
+to_decimal32(uint32_t c, int q, bool lower_closer, int *ep)
+{
+        bool is_even = (c & 1) == 0;
+        uint32_t cbl = 4 * c - 2 + lower_closer;
+        uint32_t cb = 4 * c;
+        uint32_t cbr = 4 * c + 2;
+        int k = lower_closer ? floor_log10_three_quarters_pow2(q)
+                             : floor_log10_pow2(q);
+        int h = q + floor_log2_pow10(-k) + 1;
+        JSONSINK_ASSUME(h >= 1 && h <= 4);
+        JSONSINK_ASSUME(-k >= -31 && -k <= 46);
+        uint64_t g = pow10_32[-k + 31];
+        uint32_t vbl = round_to_odd32(g, cbl << h);
+        uint32_t vb = round_to_odd32(g, cb << h);
+        uint32_t vbr = round_to_odd32(g, cbr << h);
+        uint32_t lower = vbl + !is_even;
+        uint32_t upper = vbr - !is_even;
+        uint32_t s = vb / 4;
+
+        if (s >= 10) {
+                uint32_t sp = s / 10;
+                bool up_inside = lower <= 40 * sp;
+                bool wp_inside = 40 * sp + 40 <= upper;
+                if (up_inside != wp_inside) {
+                        *ep = k + 1;
+                        return sp + wp_inside;
+                }
+        }
+        bool u_inside = lower <= 4 * s;
+        bool w_inside = 4 * s + 4 <= upper;
+        if (u_inside != w_inside) {
+                *ep = k;
+                return s + w_inside;
+        }
+        uint32_t mid = 4 * s + 2;
+        bool round_up = vb > mid || (vb == mid && (s & 1) != 0);
+        *ep = k;
+        return s + round_up;
+}
+
+size_t
+jsonsink_format_float(char *dst, float v)
+{
+        uint32_t bits;
+        char *p = dst;
+
+        memcpy(&bits, &v, sizeof(bits));
+        /* branchless as the sign is often random */
+        *p = '-';
+        p += bits >> 31;
+        uint32_t ieee_sig = bits & (((uint32_t)1 << 23) - 1);
+        unsigned int ieee_exp = (bits >> 23) & 0xff;
+        uint32_t c;
+        int q;
+
+        JSONSINK_ASSERT(ieee_exp != 0xff); /* nan or inf */
+        if (ieee_exp == 0) {
+                if (ieee_sig == 0) {
+                        *p++ = '0';
+                        return p - dst;
+                }
+                c = ieee_sig;
+                q = 1 - 150;
+        } else {
+                c = ieee_sig | ((uint32_t)1 << 23);
+                q = (int)ieee_exp - 150;
+                /* integers < 2^24 */
+                if (q <= 0 && q >= -23 &&
+                    (c & (((uint32_t)1 << -q) - 1)) == 0) {
+                        p += jsonsink_format_uint32(p, c >> -q);
+                        return p - dst;
+                }
+        }
+
+        int e;
+        uint64_t m = to_decimal32(c, q, ieee_sig == 0 && ieee_exp > 1, &e);
+        m = remove_trailing_zeros(m, &e);
+        p = format_decimal(p, m, e, -5);
+        JSONSINK_ASSUME(p - dst <= JSONSINK_FORMAT_FLOAT_MAXLEN);
+        return p - dst;
+}
+
+void
+jsonsink_add_float(struct jsonsink *s, float v)
+{
+        JSONSINK_ASSERT(!isnan(v));
+        JSONSINK_ASSERT(!isinf(v));
+        const size_t maxlen = JSONSINK_FORMAT_FLOAT_MAXLEN;
+        char tmp[JSONSINK_FORMAT_FLOAT_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_float(dest != NULL ? dest : tmp, v);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
@@ -24,12 +24,291 @@
  * SUCH DAMAGE.
  */
 
-#include <inttypes.h>
 #include <stdint.h>
-#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 
 #include "jsonsink.h"
 
+/*
+ * escape classes
+ *
+ * an escape profile maps every byte value to one of them.
+ */
+#define P 0 /* transmit as it is */
+#define B 1 /* escape with a backslash. ie. \" and \\ */
+#define S 2 /* short escape sequences. ie. \b, \f, \n, \r, and \t */
+#define U 3 /* \u00XX */
+#define M 4 /* the first byte of a multi-byte sequence. escape as \uXXXX */
+#define L 5 /* 0xe2. escape U+2028 and U+2029 as \uXXXX. */
+
+struct jsonsink_escape_profile {
+        /*
+         * a bitmap of the bytes for which classes[] is not P.
+         * it's used by the simd scanner. (see find_special)
+         *
+         *   bitmap_lo[x & 0xf] & (1 << (x >> 4))        for x < 0x80
+         *   bitmap_hi[x & 0xf] & (1 << ((x >> 4) - 8))  for x >= 0x80
+         *
+         * JSONSINK_ENABLE_ASSERTIONS builds check the consistency
+         * with classes[]. (see check_profile)
+         */
+        uint8_t bitmap_lo[16];
+        uint8_t bitmap_hi[16];
+        uint8_t classes[256];
+};
+
+/* clang-format off */
+
+/*
+ * the default profile. only ascii characters are produced.
+ */
+const struct jsonsink_escape_profile jsonsink_escape_ascii = {
+        .bitmap_lo = {
+                0x03, 0x03, 0x07, 0x03, 0x03, 0x03, 0x03, 0x03,
+                0x03, 0x03, 0x03, 0x03, 0x23, 0x03, 0x03, 0x83,
+        },
+        .bitmap_hi = {
+                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        },
+        .classes = {
+                U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, /* 0_ */
+                U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, /* 1_ */
+                P, P, B, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 2_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 3_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 4_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, B, P, P, P, /* 5_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 6_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, U, /* 7_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* 8_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* 9_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* a_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* b_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* c_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* d_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* e_ */
+                M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, /* f_ */
+        },
+};
+
+/*
+ * safe to embed in html <script> elements.
+ * non-ascii characters other than U+2028 and U+2029 are transmitted as
+ * they are.
+ */
+const struct jsonsink_escape_profile jsonsink_escape_html = {
+        .bitmap_lo = {
+                0x03, 0x03, 0x07, 0x03, 0x03, 0x03, 0x07, 0x03,
+                0x03, 0x03, 0x03, 0x03, 0x2b, 0x03, 0x0b, 0x03,
+        },
+        .bitmap_hi = {
+                0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        },
+        .classes = {
+                U, U, U, U, U, U, U, U, S, S, S, U, S, S, U, U, /* 0_ */
+                U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, /* 1_ */
+                P, P, B, P, P, P, U, P, P, P, P, P, P, P, P, P, /* 2_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, U, P, U, P, /* 3_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 4_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, B, P, P, P, /* 5_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 6_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 7_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 8_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 9_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* a_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* b_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* c_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* d_ */
+                P, P, L, P, P, P, P, P, P, P, P, P, P, P, P, P, /* e_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* f_ */
+        },
+};
+
+/*
+ * only what RFC 8259 requires.
+ */
+const struct jsonsink_escape_profile jsonsink_escape_minimal = {
+        .bitmap_lo = {
+                0x03, 0x03, 0x07, 0x03, 0x03, 0x03, 0x03, 0x03,
+                0x03, 0x03, 0x03, 0x03, 0x23, 0x03, 0x03, 0x03,
+        },
+        .bitmap_hi = {
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        },
+        .classes = {
+                U, U, U, U, U, U, U, U, S, S, S, U, S, S, U, U, /* 0_ */
+                U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, /* 1_ */
+                P, P, B, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 2_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 3_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 4_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, B, P, P, P, /* 5_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 6_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 7_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 8_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* 9_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* a_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* b_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* c_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* d_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* e_ */
+                P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, /* f_ */
+        },
+};
+
+/* clang-format on */
+
+static const char hexdigits[16] = "0123456789abcdef";
+
+static const char short_escapes[0x20] = {
+        ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't',
+};
+
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+static void
+check_profile(const struct jsonsink_escape_profile *prof)
+{
+        unsigned int x;
+        for (x = 0; x < 256; x++) {
+                unsigned int lo = x & 0xf;
+                unsigned int hi = x >> 4;
+                bool bit;
+                if (hi < 8) {
+                        bit = (prof->bitmap_lo[lo] & (1 << hi)) != 0;
+                } else {
+                        bit = (prof->bitmap_hi[lo] & (1 << (hi - 8))) != 0;
+                }
+                JSONSINK_ASSERT(bit == (prof->classes[x] != P));
+        }
+        /* M and L rely on these */
+        for (x = 0; x < 0x80; x++) {
+                JSONSINK_ASSERT(prof->classes[x] != M);
+                JSONSINK_ASSERT(prof->classes[x] != L);
+        }
+        for (x = 0x80; x < 256; x++) {
+                JSONSINK_ASSERT(prof->classes[x] == P ||
+                                prof->classes[x] == M ||
+                                (x == 0xe2 && prof->classes[x] == L));
+        }
+}
+#endif
+
+void
+jsonsink_set_escape_profile(struct jsonsink *s,
+                            const struct jsonsink_escape_profile *prof)
+{
+#if defined(JSONSINK_ENABLE_ASSERTIONS)
+        if (prof != NULL) {
+                check_profile(prof);
+        }
+#endif
+        s->escape_profile = prof;
+}
+
+static const struct jsonsink_escape_profile *
+get_profile(const struct jsonsink *s)
+{
+        if (s->escape_profile == NULL) {
+                return &jsonsink_escape_ascii;
+        }
+        return s->escape_profile;
+}
+
+/*
+ * find_special: find the first byte which is not P.
+ * returns ep if there is no such bytes.
+ */
+
+#if defined(__SSSE3__)
+static unsigned int
+special_mask16(const struct jsonsink_escape_profile *prof, __m128i v)
+{
+        /*
+         * a pshufb-based lookup of the 256-bit bitmap.
+         * pshufb yields 0 for indexes with the msb set. it's used to
+         * select either bitmap_lo or bitmap_hi.
+         */
+        const __m128i tlo = _mm_loadu_si128((const void *)prof->bitmap_lo);
+        const __m128i thi = _mm_loadu_si128((const void *)prof->bitmap_hi);
+        const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1,
+                                           2, 4, 8, 16, 32, 64, -128);
+        const __m128i idx = _mm_and_si128(v, _mm_set1_epi8((char)0x8f));
+        __m128i row = _mm_or_si128(
+                _mm_shuffle_epi8(tlo, idx),
+                _mm_shuffle_epi8(
+                        thi, _mm_xor_si128(idx, _mm_set1_epi8((char)0x80))));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0xf));
+        __m128i bit = _mm_shuffle_epi8(bits, hi);
+        __m128i pass = _mm_cmpeq_epi8(_mm_and_si128(row, bit),
+                                      _mm_setzero_si128());
+        return ~(unsigned int)_mm_movemask_epi8(pass) & 0xffff;
+}
+#endif
+
+#if defined(__AVX2__)
+static uint32_t
+special_mask32(const struct jsonsink_escape_profile *prof, __m256i v)
+{
+        /* the same as special_mask16 */
+        const __m256i tlo = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const void *)prof->bitmap_lo));
+        const __m256i thi = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const void *)prof->bitmap_hi));
+        const __m256i bits = _mm256_setr_epi8(
+                1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1,
+                2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m256i idx =
+                _mm256_and_si256(v, _mm256_set1_epi8((char)0x8f));
+        __m256i row = _mm256_or_si256(
+                _mm256_shuffle_epi8(tlo, idx),
+                _mm256_shuffle_epi8(thi,
+                                    _mm256_xor_si256(
+                                            idx, _mm256_set1_epi8(
+                                                         (char)0x80))));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4),
+                                      _mm256_set1_epi8(0xf));
+        __m256i bit = _mm256_shuffle_epi8(bits, hi);
+        __m256i pass = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit),
+                                         _mm256_setzero_si256());
+        return ~(uint32_t)_mm256_movemask_epi8(pass);
+}
+#endif
+
+static const uint8_t *
+find_special(const struct jsonsink_escape_profile *prof, const uint8_t *p,
+             const uint8_t *ep)
+{
+#if defined(__AVX2__)
+        while (ep - p >= 32) {
+                __m256i v = _mm256_loadu_si256((const void *)p);
+                uint32_t mask = special_mask32(prof, v);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+                p += 32;
+        }
+#endif
+#if defined(__SSSE3__)
+        while (ep - p >= 16) {
+                __m128i v = _mm_loadu_si128((const void *)p);
+                unsigned int mask = special_mask16(prof, v);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+                p += 16;
+        }
+#endif
+        while (p < ep && prof->classes[*p] == P) {
+                p++;
+        }
+        return p;
+}
+
 struct surrogates {
         uint16_t high;
         uint16_t low;
@@ -50,107 +329,985 @@ calculate_sarrogates(uint32_t code)
         return (struct surrogates){high, low};
 }
 
-void
-jsonsink_add_string(struct jsonsink *s, const char *cp, size_t sz)
+static uint32_t
+decode_utf8(const uint8_t **pp, const uint8_t *ep)
 {
         /*
          * https://www.unicode.org/versions/Unicode16.0.0/core-spec/chapter-3/#G31703
          */
+        const uint8_t *p = *pp;
+        uint8_t u8 = *p++;
+        /* these bytes never appear in a valid utf-8 */
+        JSONSINK_ASSUME(u8 != 0xc0 && u8 != 0xc1 && u8 < 0xf5);
+        /* these bytes never appear at the beginning of a charater */
+        JSONSINK_ASSUME(u8 < 0x80 || 0xbf < u8);
+        uint32_t code;
+        if (u8 < 0x80) {
+                /* 1 byte */
+                code = u8 & 0x7f;
+        } else if (u8 < 0xe0) {
+                /* 2 byte */
+                JSONSINK_ASSUME(p + 1 <= ep);
+                JSONSINK_ASSUME((u8 & 0xe0) == 0xc0);
+                JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
+                code = ((u8 & 0x1f) << 6) | ((*p++) & 0x3f);
+                /* reject overlog encodings */
+                JSONSINK_ASSUME(0x80 <= code && code <= 0x7ff);
+        } else if (u8 < 0xf0) {
+                /* 3 byte */
+                JSONSINK_ASSUME(p + 2 <= ep);
+                JSONSINK_ASSUME((u8 & 0xf0) == 0xe0);
+                JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
+                JSONSINK_ASSUME((p[1] & 0xc0) == 0x80);
+                code = ((u8 & 0xf) << 12) | ((p[0] & 0x3f) << 6) |
+                       (p[1] & 0x3f);
+                /* reject overlog encodings */
+                JSONSINK_ASSUME(0x800 <= code && code <= 0xffff);
+                p += 2;
+        } else {
+                /* 4 byte */
+                JSONSINK_ASSUME(p + 3 <= ep);
+                JSONSINK_ASSUME((u8 & 0xf8) == 0xf0);
+                JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
+                JSONSINK_ASSUME((p[1] & 0xc0) == 0x80);
+                JSONSINK_ASSUME((p[2] & 0xc0) == 0x80);
+                code = ((u8 & 0x7) << 18) | ((p[0] & 0x3f) << 12) |
+                       ((p[1] & 0x3f) << 6) | ((p[2]) & 0x3f);
+                /* reject overlog encodings */
+                JSONSINK_ASSUME(0x10000 <= code && code <= 0x10ffff);
+                p += 3;
+        }
+        JSONSINK_ASSUME(code <= 0x10ffff);
+        /* sarrogate halves should never appear in a utf-8 string */
+        JSONSINK_ASSUME(code < 0xd800 || 0xe000 <= code);
+        *pp = p;
+        return code;
+}
+
+static void
+put_u16(char *dest, uint16_t x)
+{
+        dest[0] = '\\';
+        dest[1] = 'u';
+        dest[2] = hexdigits[(x >> 12) & 0xf];
+        dest[3] = hexdigits[(x >> 8) & 0xf];
+        dest[4] = hexdigits[(x >> 4) & 0xf];
+        dest[5] = hexdigits[x & 0xf];
+}
+
+/*
+ * escape_code: write \uXXXX or a surrogate pair of them for the code point.
+ */
+
+static void
+escape_code(struct jsonsink *s, uint32_t code)
+{
+        const size_t maxlen = 12;
+        char *dest = jsonsink_reserve_buffer(s, maxlen);
+        size_t len;
+        if (code >= 0x10000) {
+                /* extended character */
+                len = 12;
+                if (dest != NULL) {
+                        struct surrogates sarrogates =
+                                calculate_sarrogates(code);
+                        put_u16(dest, sarrogates.high);
+                        put_u16(dest + 6, sarrogates.low);
+                }
+        } else {
+                len = 6;
+                if (dest != NULL) {
+                        put_u16(dest, code);
+                }
+        }
+        jsonsink_commit_buffer(s, len);
+}
+
+/*
+ * escape_char: transmit a character which find_special stopped at.
+ * returns the pointer to the next character.
+ */
+
+static const uint8_t *
+escape_char(struct jsonsink *s, const struct jsonsink_escape_profile *prof,
+            const uint8_t *p, const uint8_t *ep)
+{
+        uint8_t u8 = *p;
+        uint32_t code;
+        switch (prof->classes[u8]) {
+        case B:
+                jsonsink_add_fragment(s, (char[]){0x5c, u8}, 2);
+                return p + 1;
+        case S:
+                JSONSINK_ASSUME(u8 < 0x20 && short_escapes[u8] != 0);
+                jsonsink_add_fragment(s, (char[]){0x5c, short_escapes[u8]},
+                                      2);
+                return p + 1;
+        case U:
+                JSONSINK_ASSUME(u8 < 0x80);
+                escape_code(s, u8);
+                return p + 1;
+        case M:
+                code = decode_utf8(&p, ep);
+                escape_code(s, code);
+                return p;
+        case L: {
+                const uint8_t *start = p;
+                JSONSINK_ASSUME(u8 == 0xe2);
+                code = decode_utf8(&p, ep);
+                if (code == 0x2028 || code == 0x2029) {
+                        escape_code(s, code);
+                } else {
+                        jsonsink_add_fragment(s, (const char *)start,
+                                              p - start);
+                }
+                return p;
+        }
+        default:
+                JSONSINK_ASSUME(prof->classes[u8] == P);
+                jsonsink_add_fragment(s, (const char *)p, 1);
+                return p + 1;
+        }
+}
+
+static void
+escape_string(struct jsonsink *s, const struct jsonsink_escape_profile *prof,
+              const uint8_t *p, const uint8_t *ep)
+{
+        while (p < ep) {
+                /*
+                 * transmit the characters which don't need escaping
+                 * as they are.
+                 */
+                const uint8_t *q = find_special(prof, p, ep);
+                if (q > p) {
+                        jsonsink_add_fragment(s, (const char *)p, q - p);
+                        p = q;
+                        if (p == ep) {
+                                break;
+                        }
+                }
+                p = escape_char(s, prof, p, ep);
+        }
+}
+
+void
+jsonsink_add_string(struct jsonsink *s, const char *cp, size_t sz)
+{
+        const struct jsonsink_escape_profile *prof = get_profile(s);
         const uint8_t *p = (const void *)cp;
         const uint8_t *ep = p + sz;
         JSONSINK_ASSUME(p <= ep);
 
         jsonsink_value_start(s);
         jsonsink_add_fragment(s, "\"", 1);
-        while (p < ep) {
-                /*
-                 * decode a character
-                 */
-                uint8_t u8 = *p++;
-                /* these bytes never appear in a valid utf-8 */
-                JSONSINK_ASSUME(u8 != 0xc0 && u8 != 0xc1 && u8 < 0xf5);
-                /* these bytes never appear at the beginning of a charater */
-                JSONSINK_ASSUME(u8 < 0x80 || 0xbf < u8);
-                uint32_t code;
+        escape_string(s, prof, p, ep);
+        jsonsink_add_fragment(s, "\"", 1);
+        jsonsink_value_end(s);
+}
+
+/*
+ * utf-8 validation
+ *
+ * jsonsink_add_untrusted_string uses the same kernel as
+ * jsonsink_add_string. the simd scanner additionally validates each block
+ * with the algorithm from:
+ *
+ *   John Keiser, Daniel Lemire, "Validating UTF-8 In Less Than One
+ *   Instruction Per Byte", Software: Practice and Experience 51 (5), 2021
+ *
+ * when a block has something to escape or something invalid, the scanner
+ * hands the block to the scalar validating decoder.
+ */
+
+#define INVALID 0xffffffff
+
+#if defined(__SSSE3__)
+/* error bits, used by the lookup tables below */
+#define TOO_SHORT (1 << 0)      /* 11______ 0_______, 11______ 11______ */
+#define TOO_LONG (1 << 1)       /* 0_______ 10______ */
+#define OVERLONG_3 (1 << 2)     /* 11100000 100_____ */
+#define TOO_LARGE (1 << 3)      /* 11110100 1001____ etc */
+#define SURROGATE (1 << 4)      /* 11101101 101_____ */
+#define OVERLONG_2 (1 << 5)     /* 1100000_ 10______ */
+#define TOO_LARGE_1000 (1 << 6) /* 11110101 1000____ etc */
+#define OVERLONG_4 (1 << 6)     /* 11110000 1000____ */
+#define TWO_CONTS (1 << 7)      /* 10______ 10______ */
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* clang-format off */
+#define UTF8_BYTE_1_HIGH                                                      \
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,                               \
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,                               \
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,                           \
+        TOO_SHORT | OVERLONG_2,                                               \
+        TOO_SHORT,                                                            \
+        TOO_SHORT | OVERLONG_3 | SURROGATE,                                   \
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+#define UTF8_BYTE_1_LOW                                                       \
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,                         \
+        CARRY | OVERLONG_2,                                                   \
+        CARRY,                                                                \
+        CARRY,                                                                \
+        CARRY | TOO_LARGE,                                                    \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,                       \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+#define UTF8_BYTE_2_HIGH                                                      \
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,                           \
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,                           \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |     \
+                OVERLONG_4,                                                   \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,           \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,            \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,            \
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+/* clang-format on */
+
+/*
+ * utf8_check16: returns non-zero bytes if the block `v` is not
+ * valid utf-8 when preceded by `prev`.
+ * an incomplete sequence at the end of the block is not an error here.
+ */
+static __m128i
+utf8_check16(__m128i v, __m128i prev)
+{
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i prev1 = _mm_alignr_epi8(v, prev, 15);
+        __m128i byte_1_high = _mm_shuffle_epi8(
+                _mm_setr_epi8(UTF8_BYTE_1_HIGH),
+                _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+        __m128i byte_1_low = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_LOW),
+                                              _mm_and_si128(prev1, nibble));
+        __m128i byte_2_high = _mm_shuffle_epi8(
+                _mm_setr_epi8(UTF8_BYTE_2_HIGH),
+                _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i sc = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low),
+                                   byte_2_high);
+
+        /* the 3rd and 4th bytes of 3 and 4 byte sequences */
+        __m128i prev2 = _mm_alignr_epi8(v, prev, 14);
+        __m128i prev3 = _mm_alignr_epi8(v, prev, 13);
+        __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+        __m128i is_fourth =
+                _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+        __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+                                       _mm_set1_epi8((char)0x80));
+        return _mm_xor_si128(must23, sc);
+}
+#endif
+
+#if defined(__AVX2__)
+static __m256i
+utf8_check32(__m256i v, __m256i prev)
+{
+        /* the same as utf8_check16 */
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i shifted = _mm256_permute2x128_si256(prev, v, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(v, shifted, 15);
+        __m256i byte_1_high = _mm256_shuffle_epi8(
+                _mm256_setr_epi8(UTF8_BYTE_1_HIGH, UTF8_BYTE_1_HIGH),
+                _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        __m256i byte_1_low = _mm256_shuffle_epi8(
+                _mm256_setr_epi8(UTF8_BYTE_1_LOW, UTF8_BYTE_1_LOW),
+                _mm256_and_si256(prev1, nibble));
+        __m256i byte_2_high = _mm256_shuffle_epi8(
+                _mm256_setr_epi8(UTF8_BYTE_2_HIGH, UTF8_BYTE_2_HIGH),
+                _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i sc = _mm256_and_si256(
+                _mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        __m256i prev2 = _mm256_alignr_epi8(v, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(v, shifted, 13);
+        __m256i is_third =
+                _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80));
+        __m256i is_fourth = _mm256_subs_epu8(
+                prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+        __m256i must23 =
+                _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                 _mm256_set1_epi8((char)0x80));
+        return _mm256_xor_si256(must23, sc);
+}
+#endif
+
+/*
+ * char_boundary: if a multi-byte sequence is cut at p, returns the pointer
+ * to its first byte. otherwise, returns p.
+ *
+ * the bytes in [start, p) are expected to be already validated.
+ */
+
+static const uint8_t *
+char_boundary(const uint8_t *start, const uint8_t *p)
+{
+        unsigned int i;
+        for (i = 1; i <= 3 && p - i >= start; i++) {
+                uint8_t u8 = *(p - i);
+                if (u8 < 0x80) {
+                        break;
+                }
+                if (u8 >= 0xc0) {
+                        unsigned int len = 2 + (u8 >= 0xe0) + (u8 >= 0xf0);
+                        if (len > i) {
+                                return p - i;
+                        }
+                        break;
+                }
+        }
+        return p;
+}
+
+/*
+ * find_special_or_invalid: the validating version of find_special.
+ *
+ * [p, returned value) is valid utf-8 which doesn't need escaping.
+ * [returned value, *untilp) should be examined by validate_chars.
+ */
+
+static const uint8_t *
+find_special_or_invalid(const struct jsonsink_escape_profile *prof,
+                        const uint8_t *p, const uint8_t *ep,
+                        const uint8_t **untilp)
+{
+        const uint8_t *start = p;
+#if defined(__AVX2__)
+        __m256i prev32 = _mm256_setzero_si256();
+        while (ep - p >= 32) {
+                __m256i v = _mm256_loadu_si256((const void *)p);
+                uint32_t mask = special_mask32(prof, v);
+                uint32_t nonascii = _mm256_movemask_epi8(
+                        _mm256_or_si256(v, prev32));
+                uint32_t ok = 0xffffffff;
+                if (nonascii != 0) {
+                        __m256i error = utf8_check32(v, prev32);
+                        ok = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                                error, _mm256_setzero_si256()));
+                }
+                if (ok != 0xffffffff) {
+                        *untilp = p + 32;
+                        return char_boundary(start, p);
+                }
+                if (mask != 0) {
+                        p += __builtin_ctz(mask);
+                        *untilp = p + 1;
+                        return p;
+                }
+                prev32 = v;
+                p += 32;
+        }
+        __m128i prev = _mm256_extracti128_si256(prev32, 1);
+#elif defined(__SSSE3__)
+        __m128i prev = _mm_setzero_si128();
+#endif
+#if defined(__SSSE3__)
+        while (ep - p >= 16) {
+                __m128i v = _mm_loadu_si128((const void *)p);
+                unsigned int mask = special_mask16(prof, v);
+                unsigned int nonascii =
+                        _mm_movemask_epi8(_mm_or_si128(v, prev));
+                unsigned int ok = 0xffff;
+                if (nonascii != 0) {
+                        __m128i error = utf8_check16(v, prev);
+                        ok = _mm_movemask_epi8(
+                                _mm_cmpeq_epi8(error, _mm_setzero_si128()));
+                }
+                if (ok != 0xffff) {
+                        *untilp = p + 16;
+                        return char_boundary(start, p);
+                }
+                if (mask != 0) {
+                        p += __builtin_ctz(mask);
+                        *untilp = p + 1;
+                        return p;
+                }
+                prev = v;
+                p += 16;
+        }
+#endif
+        /* leave the rest to the scalar decoder */
+        *untilp = ep;
+        return char_boundary(start, p);
+}
+
+/*
+ * decode_utf8_checked: the validating version of decode_utf8.
+ *
+ * on an ill-formed sequence, returns INVALID and advances *pp over
+ * its maximal subpart, following the "U+FFFD substitution of maximal
+ * subparts" practice:
+ * https://www.unicode.org/versions/Unicode16.0.0/core-spec/chapter-3/#G66453
+ */
+
+static uint32_t
+decode_utf8_checked(const uint8_t **pp, const uint8_t *ep)
+{
+        const uint8_t *p = *pp;
+        uint8_t u8 = *p++;
+        unsigned int len;
+        uint8_t lo = 0x80; /* the valid range of the second byte */
+        uint8_t hi = 0xbf;
+        uint32_t code;
+
+        if (u8 < 0x80) {
+                *pp = p;
+                return u8;
+        } else if (0xc2 <= u8 && u8 <= 0xdf) {
+                len = 2;
+                code = u8 & 0x1f;
+        } else if (0xe0 <= u8 && u8 <= 0xef) {
+                len = 3;
+                code = u8 & 0x0f;
+                if (u8 == 0xe0) {
+                        lo = 0xa0; /* overlong */
+                } else if (u8 == 0xed) {
+                        hi = 0x9f; /* surrogate halves */
+                }
+        } else if (0xf0 <= u8 && u8 <= 0xf4) {
+                len = 4;
+                code = u8 & 0x07;
+                if (u8 == 0xf0) {
+                        lo = 0x90; /* overlong */
+                } else if (u8 == 0xf4) {
+                        hi = 0x8f; /* > U+10FFFF */
+                }
+        } else {
+                *pp = p;
+                return INVALID;
+        }
+        if (p == ep || *p < lo || hi < *p) {
+                *pp = p;
+                return INVALID;
+        }
+        code = (code << 6) | (*p++ & 0x3f);
+        unsigned int i;
+        for (i = 2; i < len; i++) {
+                if (p == ep || (*p & 0xc0) != 0x80) {
+                        *pp = p;
+                        return INVALID;
+                }
+                code = (code << 6) | (*p++ & 0x3f);
+        }
+        *pp = p;
+        return code;
+}
+
+static void
+add_run(struct jsonsink *s, const uint8_t *p, const uint8_t *ep)
+{
+        if (p < ep) {
+                jsonsink_add_fragment(s, (const char *)p, ep - p);
+        }
+}
+
+/*
+ * validate_chars: process characters in [p, until) with the scalar
+ * validating decoder.
+ *
+ * returns the pointer to the next character, which is at or after `until`.
+ * returns NULL if it found an invalid sequence and
+ * JSONSINK_INVALID_UTF8_ERROR is specified.
+ */
+
+static const uint8_t *
+validate_chars(struct jsonsink *s, const struct jsonsink_escape_profile *prof,
+               const uint8_t *p, const uint8_t *until, const uint8_t *ep,
+               unsigned int flags)
+{
+        const uint8_t *run = p;
+        while (p < until) {
+                uint8_t u8 = *p;
+                uint8_t cls = prof->classes[u8];
                 if (u8 < 0x80) {
-                        /* 1 byte */
-                        code = u8 & 0x7f;
-                } else if (u8 < 0xe0) {
-                        /* 2 byte */
-                        JSONSINK_ASSUME(p + 1 <= ep);
-                        JSONSINK_ASSUME((u8 & 0xe0) == 0xc0);
-                        JSONSINK_ASSUME((u8 & 0xe0) == 0xc0);
-                        JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
-                        code = ((u8 & 0x1f) << 6) | ((*p++) & 0x3f);
-                        /* reject overlog encodings */
-                        JSONSINK_ASSUME(0x80 <= code && code <= 0x7ff);
-                } else if (u8 < 0xf0) {
-                        /* 3 byte */
-                        JSONSINK_ASSUME(p + 2 <= ep);
-                        JSONSINK_ASSUME((u8 & 0xf0) == 0xe0);
-                        JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
-                        JSONSINK_ASSUME((p[1] & 0xc0) == 0x80);
-                        code = ((u8 & 0xf) << 12) | ((p[0] & 0x3f) << 6) |
-                               (p[1] & 0x3f);
-                        /* reject overlog encodings */
-                        JSONSINK_ASSUME(0x800 <= code && code <= 0xffff);
-                        p += 2;
+                        if (cls != P) {
+                                add_run(s, run, p);
+                                p = escape_char(s, prof, p, ep);
+                                run = p;
+                        } else {
+                                p++;
+                        }
+                        continue;
+                }
+                const uint8_t *next = p;
+                uint32_t code = decode_utf8_checked(&next, ep);
+                if (code == INVALID) {
+                        add_run(s, run, p);
+                        if ((flags & JSONSINK_INVALID_UTF8_ERROR) != 0) {
+                                jsonsink_set_error(
+                                        s, JSONSINK_ERROR_INVALID_UTF8);
+                                return NULL;
+                        }
+                        /* U+FFFD REPLACEMENT CHARACTER */
+                        if (prof->classes[0xef] == P) {
+                                jsonsink_add_fragment(s, "\xef\xbf\xbd", 3);
+                        } else {
+                                escape_code(s, 0xfffd);
+                        }
+                        p = next;
+                        run = p;
+                        continue;
+                }
+                if (cls != P) {
+                        add_run(s, run, p);
+                        p = escape_char(s, prof, p, ep);
+                        JSONSINK_ASSERT(p == next);
+                        run = p;
                 } else {
-                        /* 4 byte */
-                        JSONSINK_ASSUME(p + 3 <= ep);
-                        JSONSINK_ASSUME((u8 & 0xf8) == 0xf0);
-                        JSONSINK_ASSUME((p[0] & 0xc0) == 0x80);
-                        JSONSINK_ASSUME((p[1] & 0xc0) == 0x80);
-                        JSONSINK_ASSUME((p[2] & 0xc0) == 0x80);
-                        code = ((u8 & 0x3) << 18) | ((p[0] & 0x3f) << 12) |
-                               ((p[1] & 0x3f) << 6) | ((p[2]) & 0x3f);
-                        /* reject overlog encodings */
-                        JSONSINK_ASSUME(0x10000 <= code && code <= 0x10ffff);
-                        p += 3;
-                }
-                JSONSINK_ASSUME(code <= 0x10ffff);
-                /* sarrogate halves should never appear in a utf-8 string */
-                JSONSINK_ASSUME(code < 0xd800 || 0xe000 <= code);
+                        p = next;
+                }
+        }
+        add_run(s, run, p);
+        return p;
+}
 
-                /*
-                 * trasnmit the decoded character.
-                 * escape if necessary.
-                 */
+/*
+ * escape_untrusted_string: the validating version of escape_string.
+ *
+ * returns false if it found an invalid sequence and
+ * JSONSINK_INVALID_UTF8_ERROR is specified.
+ */
+
+static bool
+escape_untrusted_string(struct jsonsink *s,
+                        const struct jsonsink_escape_profile *prof,
+                        const uint8_t *p, const uint8_t *ep,
+                        unsigned int flags)
+{
+        while (p < ep) {
+                const uint8_t *until;
+                const uint8_t *q =
+                        find_special_or_invalid(prof, p, ep, &until);
+                add_run(s, p, q);
+                if (q == ep) {
+                        break;
+                }
+                p = validate_chars(s, prof, q, until, ep, flags);
+                if (p == NULL) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+void
+jsonsink_add_untrusted_string(struct jsonsink *s, const char *cp, size_t sz,
+                              unsigned int flags)
+{
+        const struct jsonsink_escape_profile *prof = get_profile(s);
+        const uint8_t *p = (const void *)cp;
+        const uint8_t *ep = p + sz;
+        JSONSINK_ASSUME(p <= ep);
+
+        jsonsink_value_start(s);
+        jsonsink_add_fragment(s, "\"", 1);
+        escape_untrusted_string(s, prof, p, ep, flags);
+        jsonsink_add_fragment(s, "\"", 1);
+        jsonsink_value_end(s);
+}
+
+/*
+ * streaming
+ *
+ * a multi-byte sequence cut by a chunk boundary is kept in s->carry
+ * until the rest of it arrives.
+ */
+
+#define STREAM_UNTRUSTED 0x80 /* | JSONSINK_INVALID_UTF8_xxx */
+#define STREAM_FAILED 0x40
+
+static unsigned int
+sequence_length(uint8_t u8)
+{
+        if (u8 < 0x80) {
+                return 1;
+        }
+        if (0xc2 <= u8 && u8 <= 0xdf) {
+                return 2;
+        }
+        if (0xe0 <= u8 && u8 <= 0xef) {
+                return 3;
+        }
+        if (0xf0 <= u8 && u8 <= 0xf4) {
+                return 4;
+        }
+        return 0; /* invalid */
+}
+
+/*
+ * incomplete_tail: returns the number of bytes at the end of [p, ep)
+ * which form a valid, but incomplete, multi-byte sequence.
+ */
+
+static size_t
+incomplete_tail(const uint8_t *p, const uint8_t *ep)
+{
+        size_t i;
+        for (i = 1; i <= 3 && i <= (size_t)(ep - p); i++) {
+                const uint8_t *q = ep - i;
+                uint8_t u8 = q[0];
+                if (u8 < 0x80) {
+                        return 0;
+                }
+                if (u8 < 0xc0) {
+                        /* a continuation byte */
+                        continue;
+                }
+                if (sequence_length(u8) <= i) {
+                        return 0;
+                }
+                if (i >= 2) {
+                        /* see decode_utf8_checked */
+                        if ((u8 == 0xe0 && q[1] < 0xa0) ||
+                            (u8 == 0xed && q[1] > 0x9f) ||
+                            (u8 == 0xf0 && q[1] < 0x90) ||
+                            (u8 == 0xf4 && q[1] > 0x8f)) {
+                                return 0;
+                        }
+                }
+                return i;
+        }
+        return 0;
+}
+
+static void
+stream_start(struct jsonsink *s, unsigned int flags)
+{
+        jsonsink_value_start(s);
+        jsonsink_add_fragment(s, "\"", 1);
+        s->carrylen = 0;
+        s->stream_flags = flags;
+}
+
+void
+jsonsink_string_start(struct jsonsink *s)
+{
+        stream_start(s, 0);
+}
+
+void
+jsonsink_string_start_untrusted(struct jsonsink *s, unsigned int flags)
+{
+        JSONSINK_ASSUME((flags & (STREAM_UNTRUSTED | STREAM_FAILED)) == 0);
+        stream_start(s, STREAM_UNTRUSTED | flags);
+}
+
+/*
+ * complete_carry: feed the beginning of the chunk to the carried
+ * incomplete sequence.
+ * returns the pointer to the rest of the chunk, or NULL on an error.
+ */
+
+static const uint8_t *
+complete_carry(struct jsonsink *s, const struct jsonsink_escape_profile *prof,
+               const uint8_t *p, const uint8_t *ep)
+{
+        uint8_t tmp[4];
+        size_t n = s->carrylen;
+        size_t need = sequence_length(s->carry[0]) - n;
+        size_t take = need;
+        JSONSINK_ASSUME(n > 0 && n < 4 && need > 0 && n + need <= 4);
+        if (take > (size_t)(ep - p)) {
+                take = ep - p;
+        }
+        memcpy(tmp, s->carry, n);
+        memcpy(tmp + n, p, take);
+        if (take < need && incomplete_tail(tmp, tmp + n + take) == n + take) {
+                /* still incomplete */
+                memcpy(s->carry, tmp, n + take);
+                s->carrylen = n + take;
+                return ep;
+        }
+        s->carrylen = 0;
+        /*
+         * process the first character in tmp. it's either a complete
+         * sequence or an invalid one. in the latter case, the carried
+         * bytes are a part of the maximal subpart because they are
+         * a valid prefix.
+         */
+        unsigned int flags = s->stream_flags & JSONSINK_INVALID_UTF8_ERROR;
+        const uint8_t *next =
+                validate_chars(s, prof, tmp, tmp + 1, tmp + n + take, flags);
+        if (next == NULL) {
+                return NULL;
+        }
+        JSONSINK_ASSUME((size_t)(next - tmp) >= n);
+        return p + (next - tmp - n);
+}
+
+void
+jsonsink_string_append(struct jsonsink *s, const char *cp, size_t sz)
+{
+        const struct jsonsink_escape_profile *prof = get_profile(s);
+        const uint8_t *p = (const void *)cp;
+        const uint8_t *ep = p + sz;
+        JSONSINK_ASSUME(p <= ep);
+
+        if (sz == 0 || (s->stream_flags & STREAM_FAILED) != 0) {
+                return;
+        }
+        if (s->carrylen > 0) {
+                p = complete_carry(s, prof, p, ep);
+                if (p == NULL) {
+                        s->stream_flags |= STREAM_FAILED;
+                        return;
+                }
+                if (s->carrylen > 0) {
+                        JSONSINK_ASSUME(p == ep);
+                        return;
+                }
+        }
+        size_t tail = incomplete_tail(p, ep);
+        if ((s->stream_flags & STREAM_UNTRUSTED) != 0) {
+                if (!escape_untrusted_string(
+                            s, prof, p, ep - tail,
+                            s->stream_flags & JSONSINK_INVALID_UTF8_ERROR)) {
+                        s->stream_flags |= STREAM_FAILED;
+                        return;
+                }
+        } else {
+                escape_string(s, prof, p, ep - tail);
+        }
+        memcpy(s->carry, ep - tail, tail);
+        s->carrylen = tail;
+}
+
+void
+jsonsink_string_end(struct jsonsink *s)
+{
+        if (s->carrylen > 0 && (s->stream_flags & STREAM_FAILED) == 0) {
+                /* the input ended with an incomplete sequence */
+                JSONSINK_ASSUME((s->stream_flags & STREAM_UNTRUSTED) != 0);
+                const uint8_t *p = s->carry;
+                validate_chars(s, get_profile(s), p, p + 1, p + s->carrylen,
+                               s->stream_flags & JSONSINK_INVALID_UTF8_ERROR);
+        }
+        s->carrylen = 0;
+        jsonsink_add_fragment(s, "\"", 1);
+        jsonsink_value_end(s);
+}
+
+/*
+ * transcoding
+ *
+ * unlike jsonsink_add_string, the output is not a copy of the input.
+ * the kernel fills reservations directly.
+ */
+
+/*
+ * the maximum number of bytes put_code produces.
+ */
+#define MAX_CODE_LEN 12
+
+/*
+ * escapes_code: returns true if the profile escapes the non-ascii
+ * code point.
+ */
+
+static bool
+escapes_code(const struct jsonsink_escape_profile *prof, uint32_t code)
+{
+        uint8_t lead;
+        JSONSINK_ASSUME(0x80 <= code && code <= 0x10ffff);
+        if (code < 0x800) {
+                lead = 0xc0 | (code >> 6);
+        } else if (code < 0x10000) {
+                lead = 0xe0 | (code >> 12);
+        } else {
+                lead = 0xf0 | (code >> 18);
+        }
+        switch (prof->classes[lead]) {
+        case M:
+                return true;
+        case L:
+                return code == 0x2028 || code == 0x2029;
+        default:
+                return false;
+        }
+}
+
+/*
+ * put_code: write the code point to dest, escaping it if necessary.
+ * returns the number of bytes written.
+ */
+
+static size_t
+put_code(const struct jsonsink_escape_profile *prof, char *dest,
+         uint32_t code)
+{
+        JSONSINK_ASSUME(code <= 0x10ffff);
+        JSONSINK_ASSUME(code < 0xd800 || 0xe000 <= code);
+        if (code < 0x80) {
+                switch (prof->classes[code]) {
+                case P:
+                        dest[0] = code;
+                        return 1;
+                case B:
+                        dest[0] = '\\';
+                        dest[1] = code;
+                        return 2;
+                case S:
+                        JSONSINK_ASSUME(code < 0x20);
+                        dest[0] = '\\';
+                        dest[1] = short_escapes[code];
+                        return 2;
+                default:
+                        JSONSINK_ASSUME(prof->classes[code] == U);
+                        put_u16(dest, code);
+                        return 6;
+                }
+        }
+        if (escapes_code(prof, code)) {
                 if (code >= 0x10000) {
-                        /* extended character */
-                        const size_t len = 12;
-                        void *dest = jsonsink_reserve_buffer(s, len + 1);
-                        if (dest != NULL) {
-                                struct surrogates sarrogates =
-                                        calculate_sarrogates(code);
-                                int ret = snprintf(
-                                        dest, len + 1,
-                                        "\\u%04" PRIx16 "\\u%04" PRIx16,
-                                        sarrogates.high, sarrogates.low);
-                                JSONSINK_ASSUME(ret == len);
+                        struct surrogates sarrogates =
+                                calculate_sarrogates(code);
+                        put_u16(dest, sarrogates.high);
+                        put_u16(dest + 6, sarrogates.low);
+                        return 12;
+                }
+                put_u16(dest, code);
+                return 6;
+        }
+        if (code < 0x800) {
+                dest[0] = 0xc0 | (code >> 6);
+                dest[1] = 0x80 | (code & 0x3f);
+                return 2;
+        }
+        if (code < 0x10000) {
+                dest[0] = 0xe0 | (code >> 12);
+                dest[1] = 0x80 | ((code >> 6) & 0x3f);
+                dest[2] = 0x80 | (code & 0x3f);
+                return 3;
+        }
+        dest[0] = 0xf0 | (code >> 18);
+        dest[1] = 0x80 | ((code >> 12) & 0x3f);
+        dest[2] = 0x80 | ((code >> 6) & 0x3f);
+        dest[3] = 0x80 | (code & 0x3f);
+        return 4;
+}
+
+void
+jsonsink_add_string_latin1(struct jsonsink *s, const char *cp, size_t sz)
+{
+        const struct jsonsink_escape_profile *prof = get_profile(s);
+        const uint8_t *p = (const void *)cp;
+        const uint8_t *ep = p + sz;
+        const size_t maxlen = JSONSINK_MAX_RESERVATION;
+        char tmp[JSONSINK_MAX_RESERVATION];
+        JSONSINK_ASSUME(p <= ep);
+        JSONSINK_ASSUME(maxlen >= MAX_CODE_LEN);
+
+        jsonsink_value_start(s);
+        jsonsink_add_fragment(s, "\"", 1);
+        while (p < ep) {
+                char *dest = jsonsink_reserve_buffer(s, maxlen);
+                if (dest == NULL) {
+                        /* just count the size */
+                        dest = tmp;
+                }
+                char *d = dest;
+                char *dend = dest + maxlen;
+                while (p < ep && dend - d >= MAX_CODE_LEN) {
+#if defined(__SSSE3__)
+                        if (ep - p >= 16 && dend - d >= 16 + MAX_CODE_LEN) {
+                                /*
+                                 * copy ascii characters which don't
+                                 * need escaping as they are.
+                                 */
+                                __m128i v = _mm_loadu_si128((const void *)p);
+                                unsigned int mask = special_mask16(prof, v) |
+                                                    _mm_movemask_epi8(v);
+                                _mm_storeu_si128((void *)d, v);
+                                if (mask == 0) {
+                                        p += 16;
+                                        d += 16;
+                                        continue;
+                                }
+                                unsigned int n = __builtin_ctz(mask);
+                                p += n;
+                                d += n;
                         }
-                        jsonsink_commit_buffer(s, len);
-                } else if (code == 0x22) {
-                        /* " */
-                        jsonsink_add_fragment(s, (char[]){0x5c, 0x22}, 2);
-                } else if (code == 0x5c) {
-                        /* \ */
-                        jsonsink_add_fragment(s, (char[]){0x5c, 0x5c}, 2);
-                } else if (code <= 0x1f || code >= 0x7f) {
-                        /* control character */
-                        const size_t len = 6;
-                        void *dest = jsonsink_reserve_buffer(s, len + 1);
-                        if (dest != NULL) {
-                                int ret = snprintf(dest, len + 1, "\\u%04x",
-                                                   code);
-                                JSONSINK_ASSUME(ret == len);
+#endif
+                        /* iso-8859-1 is the first 256 code points */
+                        d += put_code(prof, d, *p++);
+                }
+                jsonsink_commit_buffer(s, d - dest);
+        }
+        jsonsink_add_fragment(s, "\"", 1);
+        jsonsink_value_end(s);
+}
+
+void
+jsonsink_add_string_utf16(struct jsonsink *s, const uint16_t *p, size_t n)
+{
+        const struct jsonsink_escape_profile *prof = get_profile(s);
+        const uint16_t *ep = p + n;
+        const size_t maxlen = JSONSINK_MAX_RESERVATION;
+        char tmp[JSONSINK_MAX_RESERVATION];
+        JSONSINK_ASSUME(p <= ep);
+        JSONSINK_ASSUME(maxlen >= MAX_CODE_LEN);
+
+        jsonsink_value_start(s);
+        jsonsink_add_fragment(s, "\"", 1);
+        while (p < ep) {
+                char *dest = jsonsink_reserve_buffer(s, maxlen);
+                if (dest == NULL) {
+                        /* just count the size */
+                        dest = tmp;
+                }
+                char *d = dest;
+                char *dend = dest + maxlen;
+                while (p < ep && dend - d >= MAX_CODE_LEN) {
+#if defined(__SSSE3__)
+                        if (ep - p >= 8 && dend - d >= 8 + MAX_CODE_LEN) {
+                                /*
+                                 * narrow ascii characters which don't
+                                 * need escaping.
+                                 */
+                                __m128i v = _mm_loadu_si128((const void *)p);
+                                __m128i ascii = _mm_cmpeq_epi16(
+                                        _mm_and_si128(
+                                                v, _mm_set1_epi16(
+                                                           (short)0xff80)),
+                                        _mm_setzero_si128());
+                                __m128i narrow = _mm_packus_epi16(v, v);
+                                unsigned int mask =
+                                        (special_mask16(prof, narrow) |
+                                         ~_mm_movemask_epi8(_mm_packs_epi16(
+                                                 ascii, ascii))) &
+                                        0xff;
+                                _mm_storel_epi64((void *)d, narrow);
+                                if (mask == 0) {
+                                        p += 8;
+                                        d += 8;
+                                        continue;
+                                }
+                                unsigned int n = __builtin_ctz(mask);
+                                p += n;
+                                d += n;
                         }
-                        jsonsink_commit_buffer(s, len);
-                } else {
-                        /* transmit as it is */
-                        uint8_t u8 = (uint8_t)code;
-                        jsonsink_add_fragment(s, (const char *)&u8, 1);
+#endif
+                        uint32_t code = *p++;
+                        if ((code & 0xf800) == 0xd800) {
+                                if (code < 0xdc00 && p < ep &&
+                                    (*p & 0xfc00) == 0xdc00) {
+                                        code = 0x10000 +
+                                               ((code - 0xd800) << 10) +
+                                               (*p++ - 0xdc00);
+                                } else {
+                                        /* an unpaired surrogate */
+                                        code = 0xfffd;
+                                }
+                        }
+                        d += put_code(prof, d, code);
                 }
+                jsonsink_commit_buffer(s, d - dest);
         }
         jsonsink_add_fragment(s, "\"", 1);
         jsonsink_value_end(s);
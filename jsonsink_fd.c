@@ -0,0 +1,282 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * sinks which write to a file descriptor.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+
+/*
+ * writev_all: write the whole vector, retrying on EINTR and partial
+ * writes. the vector is modified.
+ */
+
+static bool
+writev_all(int fd, struct iovec *iov, int iovcnt, int *errnop)
+{
+        while (iovcnt > 0) {
+                ssize_t ret = writev(fd, iov, iovcnt);
+                if (ret == -1) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        *errnop = errno;
+                        return false;
+                }
+                /* skip the written part. (partial writes on pipes etc) */
+                size_t n = ret;
+                while (iovcnt > 0 && n >= iov->iov_len) {
+                        n -= iov->iov_len;
+                        iov++;
+                        iovcnt--;
+                }
+                if (n > 0) {
+                        iov->iov_base = (char *)iov->iov_base + n;
+                        iov->iov_len -= n;
+                }
+        }
+        return true;
+}
+
+static void *
+alloc_buffer(size_t *bufsizep)
+{
+        long pagesize = sysconf(_SC_PAGESIZE);
+        size_t bufsize = *bufsizep;
+        void *buf;
+
+        if (pagesize <= 0) {
+                pagesize = 4096;
+        }
+        if (bufsize == 0) {
+                bufsize = JSONSINK_FD_DEFAULT_BUFSIZE;
+        }
+        bufsize = (bufsize + pagesize - 1) / pagesize * pagesize;
+        if (posix_memalign(&buf, pagesize, bufsize) != 0) {
+                return NULL;
+        }
+        *bufsizep = bufsize;
+        return buf;
+}
+
+/*
+ * jsonsink_fd
+ */
+
+static bool
+fd_flush(struct jsonsink *s, size_t needed)
+{
+        struct jsonsink_fd *fs = (void *)s;
+        struct iovec iov;
+
+        JSONSINK_ASSUME(needed <= s->buflen);
+        iov.iov_base = s->buf;
+        iov.iov_len = s->bufpos;
+        if (!writev_all(fs->fd, &iov, 1, &fs->write_errno)) {
+                return false;
+        }
+        s->bufpos = 0;
+        return true;
+}
+
+static bool
+fd_write_direct(struct jsonsink *s, const void *p, size_t len)
+{
+        struct jsonsink_fd *fs = (void *)s;
+        struct iovec iov;
+
+        iov.iov_base = (void *)p;
+        iov.iov_len = len;
+        return writev_all(fs->fd, &iov, 1, &fs->write_errno);
+}
+
+bool
+jsonsink_fd_init(struct jsonsink_fd *fs, int fd, size_t bufsize)
+{
+        void *buf = alloc_buffer(&bufsize);
+        if (buf == NULL) {
+                return false;
+        }
+        jsonsink_init(&fs->s);
+        jsonsink_set_buffer(&fs->s, buf, bufsize);
+        fs->s.flush = fd_flush;
+        fs->s.write_direct = fd_write_direct;
+        fs->s.direct_threshold = bufsize;
+        fs->fd = fd;
+        fs->write_errno = 0;
+        return true;
+}
+
+bool
+jsonsink_fd_finish(struct jsonsink_fd *fs)
+{
+        struct jsonsink *s = &fs->s;
+        if (jsonsink_error(s) != JSONSINK_OK) {
+                return false;
+        }
+        return jsonsink_flush(s, 0);
+}
+
+void
+jsonsink_fd_destroy(struct jsonsink_fd *fs)
+{
+        free(fs->s.buf);
+        fs->s.buf = NULL;
+}
+
+/*
+ * jsonsink_sg
+ *
+ * the pending output is the iovec list followed by the current segment
+ * of the buffer, [segstart, bufpos). adding a reference closes the
+ * current segment so that the order is preserved.
+ *
+ * at least one iovec slot is kept free for the last segment.
+ */
+
+static void
+close_segment(struct jsonsink_sg *sg)
+{
+        struct jsonsink *s = &sg->s;
+        if (s->bufpos > sg->segstart) {
+                JSONSINK_ASSUME(sg->iovcnt < JSONSINK_SG_IOVMAX);
+                struct iovec *iov = &sg->iov[sg->iovcnt++];
+                iov->iov_base = (char *)s->buf + sg->segstart;
+                iov->iov_len = s->bufpos - sg->segstart;
+                sg->segstart = s->bufpos;
+        }
+}
+
+static bool
+sg_flush(struct jsonsink *s, size_t needed)
+{
+        struct jsonsink_sg *sg = (void *)s;
+
+        JSONSINK_ASSUME(needed <= s->buflen);
+        close_segment(sg);
+        if (!writev_all(sg->fd, sg->iov, sg->iovcnt, &sg->write_errno)) {
+                return false;
+        }
+        sg->iovcnt = 0;
+        sg->segstart = 0;
+        s->bufpos = 0;
+        return true;
+}
+
+static void
+add_ref(struct jsonsink_sg *sg, const void *p, size_t len)
+{
+        struct jsonsink *s = &sg->s;
+        if (jsonsink_error(s) != JSONSINK_OK) {
+                return;
+        }
+        /* the current segment, the reference and a free slot */
+        if (sg->iovcnt + 3 > JSONSINK_SG_IOVMAX && !jsonsink_flush(s, 0)) {
+                return;
+        }
+        close_segment(sg);
+        struct iovec *iov = &sg->iov[sg->iovcnt++];
+        iov->iov_base = (void *)p;
+        iov->iov_len = len;
+}
+
+bool
+jsonsink_sg_init(struct jsonsink_sg *sg, int fd, size_t bufsize,
+                 size_t threshold)
+{
+        void *buf = alloc_buffer(&bufsize);
+        if (buf == NULL) {
+                return false;
+        }
+        sg->iov = malloc(JSONSINK_SG_IOVMAX * sizeof(*sg->iov));
+        if (sg->iov == NULL) {
+                free(buf);
+                return false;
+        }
+        if (threshold == 0) {
+                threshold = JSONSINK_SG_DEFAULT_THRESHOLD;
+        }
+        jsonsink_init(&sg->s);
+        jsonsink_set_buffer(&sg->s, buf, bufsize);
+        sg->s.flush = sg_flush;
+        sg->fd = fd;
+        sg->write_errno = 0;
+        sg->threshold = threshold;
+        sg->iovcnt = 0;
+        sg->segstart = 0;
+        return true;
+}
+
+void
+jsonsink_sg_add_serialized_value(struct jsonsink_sg *sg, const char *value,
+                                 size_t len)
+{
+        struct jsonsink *s = &sg->s;
+        if (len < sg->threshold) {
+                jsonsink_add_serialized_value(s, value, len);
+                return;
+        }
+        jsonsink_value_start(s);
+        add_ref(sg, value, len);
+        jsonsink_value_end(s);
+}
+
+void
+jsonsink_sg_add_fragment(struct jsonsink_sg *sg, const char *frag,
+                         size_t len)
+{
+        if (len < sg->threshold) {
+                jsonsink_add_fragment(&sg->s, frag, len);
+                return;
+        }
+        add_ref(sg, frag, len);
+}
+
+bool
+jsonsink_sg_finish(struct jsonsink_sg *sg)
+{
+        struct jsonsink *s = &sg->s;
+        if (jsonsink_error(s) != JSONSINK_OK) {
+                return false;
+        }
+        return jsonsink_flush(s, 0);
+}
+
+void
+jsonsink_sg_destroy(struct jsonsink_sg *sg)
+{
+        free(sg->s.buf);
+        sg->s.buf = NULL;
+        free(sg->iov);
+        sg->iov = NULL;
+}
@@ -0,0 +1,288 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * formatters for uuids, ip addresses and mac addresses.
+ *
+ * the output is written straight into a reservation with fixed-position
+ * stores where possible. for uuids, the hex expansion and the dash
+ * insertion are done with a few ssse3 shuffles when available.
+ */
+
+#include <string.h>
+
+#include "jsonsink.h"
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+static const char hexdigits[16] = "0123456789abcdef";
+
+/*
+ * uuid: 8-4-4-4-12 lowercase hex digits
+ */
+
+size_t
+jsonsink_format_uuid(char *dst, const void *uuid)
+{
+        const uint8_t *p = uuid;
+#if defined(__SSSE3__)
+        const __m128i digits = _mm_loadu_si128((const void *)hexdigits);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        __m128i in = _mm_loadu_si128((const void *)p);
+        __m128i hi = _mm_shuffle_epi8(
+                digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        /* a: hex digits 0-15, b: 16-31 */
+        __m128i a = _mm_unpacklo_epi8(hi, lo);
+        __m128i b = _mm_unpackhi_epi8(hi, lo);
+        /*
+         * insert the dashes. -1 (0x80) in the shuffle index clears the
+         * byte, which is then filled with '-'.
+         */
+        const __m128i idx0 = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, -1, 8, 9,
+                                           10, 11, -1, 12, 13);
+        const __m128i idx1 = _mm_setr_epi8(0, 1, -1, 2, 3, 4, 5, -1, 6, 7, 8,
+                                           9, 10, 11, 12, 13);
+        const __m128i dash0 = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, '-', 0,
+                                            0, 0, 0, '-', 0, 0);
+        const __m128i dash1 = _mm_setr_epi8(0, 0, '-', 0, 0, 0, 0, '-', 0, 0,
+                                            0, 0, 0, 0, 0, 0);
+        /* hex digits 14-29 */
+        __m128i ab = _mm_alignr_epi8(b, a, 14);
+        _mm_storeu_si128((void *)dst,
+                         _mm_or_si128(_mm_shuffle_epi8(a, idx0), dash0));
+        _mm_storeu_si128((void *)(dst + 16),
+                         _mm_or_si128(_mm_shuffle_epi8(ab, idx1), dash1));
+        uint32_t last = _mm_cvtsi128_si32(_mm_srli_si128(b, 12));
+        memcpy(dst + 32, &last, 4);
+#else
+        char *q = dst;
+        unsigned int i;
+        for (i = 0; i < 16; i++) {
+                if (i == 4 || i == 6 || i == 8 || i == 10) {
+                        *q++ = '-';
+                }
+                *q++ = hexdigits[p[i] >> 4];
+                *q++ = hexdigits[p[i] & 0xf];
+        }
+#endif
+        return JSONSINK_FORMAT_UUID_MAXLEN;
+}
+
+/*
+ * ipv4: dotted decimal
+ */
+
+static char *
+write_u8(char *p, unsigned int v)
+{
+        if (v >= 100) {
+                *p++ = '0' + v / 100;
+                v %= 100;
+                *p++ = '0' + v / 10;
+        } else if (v >= 10) {
+                *p++ = '0' + v / 10;
+        }
+        *p++ = '0' + v % 10;
+        return p;
+}
+
+static char *
+write_ipv4(char *p, const uint8_t *a)
+{
+        p = write_u8(p, a[0]);
+        *p++ = '.';
+        p = write_u8(p, a[1]);
+        *p++ = '.';
+        p = write_u8(p, a[2]);
+        *p++ = '.';
+        return write_u8(p, a[3]);
+}
+
+size_t
+jsonsink_format_ipv4(char *dst, const void *addr)
+{
+        return write_ipv4(dst, addr) - dst;
+}
+
+/*
+ * ipv6: rfc 5952
+ *
+ * - hex digits are lowercase, without leading zeros.
+ * - the longest run of two or more zero fields is replaced with "::".
+ *   the first one if there are ties.
+ *
+ * in addition, like inet_ntop, the last 32 bits are written in the
+ * dotted decimal for ipv4-mapped addresses (::ffff:a.b.c.d, rfc 5952
+ * section 5) and ipv4-compatible addresses. (::a.b.c.d)
+ */
+
+static char *
+write_field(char *p, unsigned int v)
+{
+        /* the number of digits without leading zeros, at least 1 */
+        unsigned int n = 1 + (v >= 0x10) + (v >= 0x100) + (v >= 0x1000);
+        switch (n) {
+        case 4:
+                *p++ = hexdigits[v >> 12];
+                /* FALLTHROUGH */
+        case 3:
+                *p++ = hexdigits[(v >> 8) & 0xf];
+                /* FALLTHROUGH */
+        case 2:
+                *p++ = hexdigits[(v >> 4) & 0xf];
+                /* FALLTHROUGH */
+        default:
+                *p++ = hexdigits[v & 0xf];
+        }
+        return p;
+}
+
+size_t
+jsonsink_format_ipv6(char *dst, const void *addr)
+{
+        const uint8_t *a = addr;
+        unsigned int fields[8];
+        int best_base = -1;
+        int best_len = 0;
+        int cur_base = -1;
+        int i;
+
+        for (i = 0; i < 8; i++) {
+                fields[i] = (a[i * 2] << 8) | a[i * 2 + 1];
+                if (fields[i] == 0) {
+                        if (cur_base < 0) {
+                                cur_base = i;
+                        }
+                        if (i - cur_base + 1 > best_len) {
+                                best_base = cur_base;
+                                best_len = i - cur_base + 1;
+                        }
+                } else {
+                        cur_base = -1;
+                }
+        }
+        if (best_len < 2) {
+                best_base = -1;
+        }
+
+        char *p = dst;
+        for (i = 0; i < 8; i++) {
+                if (i == best_base) {
+                        *p++ = ':';
+                        if (i == 0) {
+                                *p++ = ':';
+                        }
+                        i += best_len - 1;
+                        if (i == 7) {
+                                break;
+                        }
+                        continue;
+                }
+                if (i == 6 && best_base == 0 &&
+                    (best_len == 6 || (best_len == 5 && fields[5] == 0xffff))) {
+                        p = write_ipv4(p, a + 12);
+                        break;
+                }
+                p = write_field(p, fields[i]);
+                if (i < 7) {
+                        *p++ = ':';
+                }
+        }
+        JSONSINK_ASSUME(p - dst <= JSONSINK_FORMAT_IPV6_MAXLEN);
+        return p - dst;
+}
+
+/*
+ * mac: 6 bytes separated by colons
+ */
+
+size_t
+jsonsink_format_mac(char *dst, const void *mac)
+{
+        const uint8_t *p = mac;
+        char *q = dst;
+        unsigned int i;
+        for (i = 0; i < 6; i++) {
+                if (i > 0) {
+                        *q++ = ':';
+                }
+                *q++ = hexdigits[p[i] >> 4];
+                *q++ = hexdigits[p[i] & 0xf];
+        }
+        return JSONSINK_FORMAT_MAC_MAXLEN;
+}
+
+/*
+ * add_quoted: add the output of a formatter as a string value.
+ */
+
+static void
+add_quoted(struct jsonsink *s, size_t maxlen,
+           size_t (*format)(char *dst, const void *p), const void *p)
+{
+        char tmp[JSONSINK_FORMAT_IPV6_MAXLEN + 2];
+        JSONSINK_ASSUME(maxlen <= JSONSINK_FORMAT_IPV6_MAXLEN);
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen + 2);
+        if (dest == NULL) {
+                dest = tmp;
+        }
+        size_t len = format(dest + 1, p);
+        dest[0] = '"';
+        dest[len + 1] = '"';
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len + 2);
+}
+
+void
+jsonsink_add_uuid(struct jsonsink *s, const void *uuid)
+{
+        add_quoted(s, JSONSINK_FORMAT_UUID_MAXLEN, jsonsink_format_uuid,
+                   uuid);
+}
+
+void
+jsonsink_add_ipv4(struct jsonsink *s, const void *addr)
+{
+        add_quoted(s, JSONSINK_FORMAT_IPV4_MAXLEN, jsonsink_format_ipv4,
+                   addr);
+}
+
+void
+jsonsink_add_ipv6(struct jsonsink *s, const void *addr)
+{
+        add_quoted(s, JSONSINK_FORMAT_IPV6_MAXLEN, jsonsink_format_ipv6,
+                   addr);
+}
+
+void
+jsonsink_add_mac(struct jsonsink *s, const void *mac)
+{
+        add_quoted(s, JSONSINK_FORMAT_MAC_MAXLEN, jsonsink_format_mac, mac);
+}
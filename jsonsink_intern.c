@@ -0,0 +1,229 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "jsonsink.h"
+
+struct jsonsink_interned {
+        uint64_t hash;
+        size_t len;       /* the length of the raw string */
+        size_t quotedlen; /* the length of the escaped and quoted form */
+
+        /* the raw string followed by the escaped and quoted form */
+        char data[];
+};
+
+static uint64_t
+hash_string(const uint8_t *p, size_t sz)
+{
+        const uint64_t k = 0x9e3779b97f4a7c15;
+        uint64_t h = sz * k;
+        while (sz >= 8) {
+                uint64_t w;
+                memcpy(&w, p, 8);
+                h = (h ^ w) * k;
+                h ^= h >> 29;
+                p += 8;
+                sz -= 8;
+        }
+        if (sz > 0) {
+                uint64_t w = 0;
+                memcpy(&w, p, sz);
+                h = (h ^ w) * k;
+        }
+        h ^= h >> 32;
+        h *= k;
+        h ^= h >> 29;
+        return h;
+}
+
+void
+jsonsink_intern_init(struct jsonsink_intern_table *t, void *mem,
+                     size_t memsize,
+                     const struct jsonsink_escape_profile *prof)
+{
+        /* a placeholder for tables too small to have any entries */
+        static const struct jsonsink_interned *empty_slots[1];
+
+        t->count = 0;
+        t->arenapos = 0;
+        t->escape_profile = prof;
+        if (memsize < JSONSINK_INTERN_MIN_MEMSIZE) {
+                /* jsonsink_intern never touches the slots in this case */
+                t->slots = empty_slots;
+                t->mask = 0;
+                t->arena = NULL;
+                t->arenalen = 0;
+                return;
+        }
+
+        /*
+         * use roughly a quarter of the memory for the hash slots.
+         * the number of slots is a power of 2.
+         */
+        size_t nslots = 1;
+        while (nslots * 2 * sizeof(*t->slots) <= memsize / 4) {
+                nslots *= 2;
+        }
+        t->slots = mem;
+        t->mask = nslots - 1;
+        t->arena = (uint8_t *)mem + nslots * sizeof(*t->slots);
+        t->arenalen = memsize - nslots * sizeof(*t->slots);
+        size_t i;
+        for (i = 0; i < nslots; i++) {
+                t->slots[i] = NULL;
+        }
+}
+
+/*
+ * find_slot: returns the index of the slot which either has the matching
+ * entry or is empty. (linear probing)
+ */
+
+static size_t
+find_slot(const struct jsonsink_intern_table *t, uint64_t hash,
+          const char *cp, size_t sz)
+{
+        size_t i = hash & t->mask;
+        while (true) {
+                const struct jsonsink_interned *e = t->slots[i];
+                if (e == NULL ||
+                    (e->hash == hash && e->len == sz &&
+                     (sz == 0 || !memcmp(e->data, cp, sz)))) {
+                        return i;
+                }
+                i = (i + 1) & t->mask;
+        }
+}
+
+const struct jsonsink_interned *
+jsonsink_intern_lookup(const struct jsonsink_intern_table *t, const char *cp,
+                       size_t sz)
+{
+        if (t->count == 0) {
+                return NULL;
+        }
+        uint64_t hash = hash_string((const void *)cp, sz);
+        return t->slots[find_slot(t, hash, cp, sz)];
+}
+
+const struct jsonsink_interned *
+jsonsink_intern(struct jsonsink_intern_table *t, const char *cp, size_t sz)
+{
+        /* keep the load factor <= 3/4 so that probing stays short */
+        if ((t->count + 1) * 4 > (t->mask + 1) * 3) {
+                return jsonsink_intern_lookup(t, cp, sz);
+        }
+        uint64_t hash = hash_string((const void *)cp, sz);
+        size_t slot = find_slot(t, hash, cp, sz);
+        if (t->slots[slot] != NULL) {
+                return t->slots[slot];
+        }
+
+        /*
+         * allocate an entry from the arena.
+         */
+        const size_t align = alignof(struct jsonsink_interned);
+        size_t pos = (t->arenapos + align - 1) & ~(align - 1);
+        size_t hdrlen = sizeof(struct jsonsink_interned) + sz;
+        if (pos > t->arenalen || t->arenalen - pos < hdrlen) {
+                return NULL;
+        }
+        struct jsonsink_interned *e = (void *)(t->arena + pos);
+        e->hash = hash;
+        e->len = sz;
+        if (sz > 0) {
+                memcpy(e->data, cp, sz);
+        }
+
+        /*
+         * escape the string directly into the rest of the arena.
+         */
+        struct jsonsink s;
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, e->data + sz, t->arenalen - pos - hdrlen);
+        jsonsink_set_escape_profile(&s, t->escape_profile);
+        jsonsink_add_string(&s, cp, sz);
+        if (jsonsink_error(&s) != JSONSINK_OK) {
+                return NULL;
+        }
+        e->quotedlen = s.bufpos;
+        t->arenapos = pos + hdrlen + s.bufpos;
+        t->count++;
+        t->slots[slot] = e;
+        return e;
+}
+
+void
+jsonsink_add_interned(struct jsonsink *s, const struct jsonsink_interned *e)
+{
+        jsonsink_add_serialized_value(s, e->data + e->len, e->quotedlen);
+}
+
+/*
+ * add_string_miss: escape the string with the table's profile so that
+ * the output doesn't depend on whether the string is registered.
+ */
+
+static void
+add_string_miss(struct jsonsink *s, const struct jsonsink_intern_table *t,
+                const char *cp, size_t sz)
+{
+        const struct jsonsink_escape_profile *saved = s->escape_profile;
+        s->escape_profile = t->escape_profile;
+        jsonsink_add_string(s, cp, sz);
+        s->escape_profile = saved;
+}
+
+void
+jsonsink_add_string_interned(struct jsonsink *s,
+                             const struct jsonsink_intern_table *t,
+                             const char *cp, size_t sz)
+{
+        const struct jsonsink_interned *e = jsonsink_intern_lookup(t, cp, sz);
+        if (e != NULL) {
+                jsonsink_add_interned(s, e);
+        } else {
+                add_string_miss(s, t, cp, sz);
+        }
+}
+
+void
+jsonsink_add_string_intern(struct jsonsink *s,
+                           struct jsonsink_intern_table *t, const char *cp,
+                           size_t sz)
+{
+        const struct jsonsink_interned *e = jsonsink_intern(t, cp, sz);
+        if (e != NULL) {
+                jsonsink_add_interned(s, e);
+        } else {
+                add_string_miss(s, t, cp, sz);
+        }
+}
@@ -0,0 +1,303 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * integer to decimal string conversion.
+ *
+ * the digits are produced two at a time from the end, using a 200-byte
+ * table. the number of digits is calculated beforehand from the bit
+ * length of the value so that the output can be written in place without
+ * an intermediate buffer or a reverse copy.
+ */
+
+#include <string.h>
+
+#include "jsonsink.h"
+
+static const char digits2[200] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static const uint64_t pow10[20] = {
+        0, /* so that 0 has a digit. see count_digits */
+        10,
+        100,
+        1000,
+        10000,
+        100000,
+        1000000,
+        10000000,
+        100000000,
+        1000000000,
+        10000000000,
+        100000000000,
+        1000000000000,
+        10000000000000,
+        100000000000000,
+        1000000000000000,
+        10000000000000000,
+        100000000000000000,
+        1000000000000000000,
+        10000000000000000000u,
+};
+
+/*
+ * count_digits: the number of decimal digits of v. (1 for 0)
+ *
+ * floor(log10(2^bits)) is approximated as bits * 1233 >> 12.
+ * it's either the correct number of digits or one more.
+ */
+
+static unsigned int
+count_digits(uint64_t v)
+{
+        unsigned int bits = 64 - __builtin_clzll(v | 1);
+        unsigned int t = (bits * 1233) >> 12;
+        JSONSINK_ASSUME(t < 20);
+        return t + 1 - (v < pow10[t]);
+}
+
+static void
+write_digits32(char *end, uint32_t v)
+{
+        while (v >= 100) {
+                uint32_t r = v % 100;
+                v /= 100;
+                end -= 2;
+                memcpy(end, &digits2[r * 2], 2);
+        }
+        if (v >= 10) {
+                memcpy(end - 2, &digits2[v * 2], 2);
+        } else {
+                end[-1] = '0' + v;
+        }
+}
+
+/*
+ * write8: write exactly 8 digits, including leading zeros.
+ * unlike the loop in write_digits32, the divisions here don't depend on
+ * each other.
+ */
+
+static void
+write8(char *p, uint32_t v)
+{
+        JSONSINK_ASSUME(v < 100000000);
+        uint32_t hi = v / 10000;
+        uint32_t lo = v % 10000;
+        memcpy(p, &digits2[(hi / 100) * 2], 2);
+        memcpy(p + 2, &digits2[(hi % 100) * 2], 2);
+        memcpy(p + 4, &digits2[(lo / 100) * 2], 2);
+        memcpy(p + 6, &digits2[(lo % 100) * 2], 2);
+}
+
+/*
+ * write_digits: write the digits of v backward from `end`.
+ */
+
+static void
+write_digits(char *end, uint64_t v)
+{
+        while (v >= 100000000) {
+                uint64_t q = v / 100000000;
+                end -= 8;
+                write8(end, v - q * 100000000);
+                v = q;
+        }
+        write_digits32(end, v);
+}
+
+size_t
+jsonsink_format_uint32(char *dst, uint32_t v)
+{
+        unsigned int n = count_digits(v);
+        write_digits(dst + n, v);
+        return n;
+}
+
+size_t
+jsonsink_format_int32(char *dst, int32_t v)
+{
+        if (v < 0) {
+                *dst = '-';
+                return 1 + jsonsink_format_uint32(dst + 1, -(uint32_t)v);
+        }
+        return jsonsink_format_uint32(dst, v);
+}
+
+size_t
+jsonsink_format_uint64(char *dst, uint64_t v)
+{
+        unsigned int n = count_digits(v);
+        write_digits(dst + n, v);
+        return n;
+}
+
+size_t
+jsonsink_format_int64(char *dst, int64_t v)
+{
+        if (v < 0) {
+                *dst = '-';
+                return 1 + jsonsink_format_uint64(dst + 1, -(uint64_t)v);
+        }
+        return jsonsink_format_uint64(dst, v);
+}
+
+/*
+ * jsonsink_format_decimal: the integer part and the fraction are written
+ * separately. the fraction is written over a run of '0's so that its
+ * leading zeros are not lost.
+ */
+
+size_t
+jsonsink_format_decimal(char *dst, int64_t mantissa, unsigned int scale,
+                        bool trim)
+{
+        char *p = dst;
+        uint64_t u = mantissa;
+
+        JSONSINK_ASSERT(scale <= JSONSINK_DECIMAL_MAX_SCALE);
+        if (mantissa < 0) {
+                *p++ = '-';
+                u = -u;
+        }
+        if (trim) {
+                while (scale > 0 && u % 10 == 0) {
+                        u /= 10;
+                        scale--;
+                }
+        }
+        if (scale == 0) {
+                p += jsonsink_format_uint64(p, u);
+                return p - dst;
+        }
+        uint64_t ip = u / pow10[scale];
+        uint64_t frac = u - ip * pow10[scale];
+        p += jsonsink_format_uint64(p, ip);
+        *p++ = '.';
+        memset(p, '0', scale);
+        p += scale;
+        write_digits(p, frac);
+        return p - dst;
+}
+
+void
+jsonsink_add_decimal(struct jsonsink *s, int64_t mantissa, unsigned int scale,
+                     bool trim)
+{
+        const size_t maxlen = JSONSINK_FORMAT_DECIMAL_MAXLEN;
+        char tmp[JSONSINK_FORMAT_DECIMAL_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_decimal(dest != NULL ? dest : tmp,
+                                             mantissa, scale, trim);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_uint32(struct jsonsink *s, uint32_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_UINT32_MAXLEN;
+        char tmp[JSONSINK_FORMAT_UINT32_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_uint32(dest != NULL ? dest : tmp, v);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_int32(struct jsonsink *s, int32_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_INT32_MAXLEN;
+        char tmp[JSONSINK_FORMAT_INT32_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_int32(dest != NULL ? dest : tmp, v);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_uint64(struct jsonsink *s, uint64_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_UINT64_MAXLEN;
+        char tmp[JSONSINK_FORMAT_UINT64_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_uint64(dest != NULL ? dest : tmp, v);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_int64(struct jsonsink *s, int64_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_INT64_MAXLEN;
+        char tmp[JSONSINK_FORMAT_INT64_MAXLEN];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        size_t len = jsonsink_format_int64(dest != NULL ? dest : tmp, v);
+        JSONSINK_ASSUME(len <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len);
+}
+
+void
+jsonsink_add_uint64_string(struct jsonsink *s, uint64_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_UINT64_MAXLEN + 2;
+        char tmp[JSONSINK_FORMAT_UINT64_MAXLEN + 2];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        if (dest == NULL) {
+                dest = tmp;
+        }
+        size_t len = jsonsink_format_uint64(dest + 1, v);
+        dest[0] = '"';
+        dest[len + 1] = '"';
+        JSONSINK_ASSUME(len + 2 <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len + 2);
+}
+
+void
+jsonsink_add_int64_string(struct jsonsink *s, int64_t v)
+{
+        const size_t maxlen = JSONSINK_FORMAT_INT64_MAXLEN + 2;
+        char tmp[JSONSINK_FORMAT_INT64_MAXLEN + 2];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        if (dest == NULL) {
+                dest = tmp;
+        }
+        size_t len = jsonsink_format_int64(dest + 1, v);
+        dest[0] = '"';
+        dest[len + 1] = '"';
+        JSONSINK_ASSUME(len + 2 <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len + 2);
+}
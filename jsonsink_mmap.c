@@ -0,0 +1,190 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+/*
+ * a sink which writes to a file through a sliding mmap window.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+
+/*
+ * extend_file: extend the file to cover the window at `off`.
+ *
+ * the blocks are allocated with posix_fallocate so that running out of
+ * disk space is reported here as an error, rather than as SIGBUS on a
+ * store to a sparse page later. macOS doesn't have posix_fallocate.
+ * the window is left sparse there.
+ */
+
+static bool
+extend_file(struct jsonsink_mmap *m, uint64_t off)
+{
+#if defined(__APPLE__)
+        if (ftruncate(m->fd, off + m->winsize) == -1) {
+                m->write_errno = errno;
+                return false;
+        }
+#else
+        int error = posix_fallocate(m->fd, off, m->winsize);
+        if (error != 0) {
+                m->write_errno = error;
+                return false;
+        }
+#endif
+        return true;
+}
+
+/*
+ * map_window: extend the file to cover the window at `off` and map it.
+ */
+
+static void *
+map_window(struct jsonsink_mmap *m, uint64_t off)
+{
+        int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+        /* pre-fault the window instead of taking a fault per page */
+        flags |= MAP_POPULATE;
+#endif
+        if (!extend_file(m, off)) {
+                return NULL;
+        }
+        void *p = mmap(NULL, m->winsize, PROT_READ | PROT_WRITE, flags,
+                       m->fd, off);
+        if (p == MAP_FAILED) {
+                m->write_errno = errno;
+                return NULL;
+        }
+        madvise(p, m->winsize, MADV_SEQUENTIAL);
+        return p;
+}
+
+/*
+ * mmap_flush: slide the window forward.
+ *
+ * the new window starts at the page containing `bufpos`. the partial
+ * page is shared by the old and new mappings as they are MAP_SHARED
+ * mappings of the same file. no copy is necessary.
+ */
+
+static bool
+mmap_flush(struct jsonsink *s, size_t needed)
+{
+        struct jsonsink_mmap *m = (void *)s;
+        size_t keep = s->bufpos % m->pagesize;
+        uint64_t newoff = m->winoff + s->bufpos - keep;
+
+        if (keep + needed > s->buflen) {
+                /* the window is too small for the reservation */
+                return false;
+        }
+        if (newoff == m->winoff) {
+                return true;
+        }
+        void *p = map_window(m, newoff);
+        if (p == NULL) {
+                return false;
+        }
+        munmap(s->buf, m->winsize);
+        m->winoff = newoff;
+        s->buf = p;
+        s->bufpos = keep;
+        return true;
+}
+
+bool
+jsonsink_mmap_init(struct jsonsink_mmap *m, int fd, size_t winsize)
+{
+        long pagesize = sysconf(_SC_PAGESIZE);
+
+        if (pagesize <= 0) {
+                pagesize = 4096;
+        }
+        if (winsize == 0) {
+                winsize = JSONSINK_MMAP_DEFAULT_WINSIZE;
+        }
+        /*
+         * at least two pages so that the partial page and
+         * JSONSINK_MAX_RESERVATION bytes always fit.
+         */
+        winsize = (winsize + pagesize - 1) / pagesize * pagesize;
+        if (winsize < 2 * (size_t)pagesize) {
+                winsize = 2 * pagesize;
+        }
+        m->fd = fd;
+        m->write_errno = 0;
+        m->pagesize = pagesize;
+        m->winsize = winsize;
+        m->winoff = 0;
+        m->s.buf = NULL;
+        struct stat st;
+        bool have_size = fstat(fd, &st) == 0;
+        void *p = map_window(m, 0);
+        if (p == NULL) {
+                /* undo the extension, if any */
+                if (have_size && S_ISREG(st.st_mode)) {
+                        (void)ftruncate(fd, st.st_size);
+                }
+                return false;
+        }
+        jsonsink_init(&m->s);
+        jsonsink_set_buffer(&m->s, p, winsize);
+        m->s.flush = mmap_flush;
+        return true;
+}
+
+bool
+jsonsink_mmap_finish(struct jsonsink_mmap *m)
+{
+        struct jsonsink *s = &m->s;
+        if (jsonsink_error(s) != JSONSINK_OK) {
+                return false;
+        }
+        /* cut the unused part of the window */
+        if (ftruncate(m->fd, m->winoff + s->bufpos) == -1) {
+                m->write_errno = errno;
+                jsonsink_set_error(s, JSONSINK_ERROR_FLUSH_FAILED);
+                return false;
+        }
+        return true;
+}
+
+void
+jsonsink_mmap_destroy(struct jsonsink_mmap *m)
+{
+        if (m->s.buf != NULL) {
+                munmap(m->s.buf, m->winsize);
+                m->s.buf = NULL;
+        }
+}
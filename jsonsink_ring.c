@@ -0,0 +1,298 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+/*
+ * a ring buffer sink, whose memory is mapped twice back to back so that
+ * any range up to the ring size is contiguous across the wrap.
+ *
+ *   base            base + size        base + 2 * size
+ *   +-----------------+-----------------+
+ *   | memfd [0, size) | memfd [0, size) |
+ *   +-----------------+-----------------+
+ *
+ * the positions are free-running 32-bit counters. the ring size is a
+ * power of two so that `pos % size` stays consistent across the
+ * wrap-around of the counters.
+ *
+ * the producer waits for the consumer on `tail`. the consumer waits
+ * for the producer on `seq`, which is bumped after every update of
+ * `head` and `closed`. thus, unlike `head`, it changes even when
+ * jsonsink_ring_finish has nothing to publish.
+ */
+
+#if defined(__linux__)
+
+#define _GNU_SOURCE /* memfd_create */
+
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+
+struct jsonsink_ring_ctl {
+        uint32_t head; /* the end of the published data. (producer) */
+        uint32_t tail; /* the end of the consumed data. (consumer) */
+        uint32_t head_waiting;
+        uint32_t tail_waiting;
+        uint32_t closed;
+        uint32_t seq; /* bumped by the producer. (see above) */
+};
+
+static uint32_t
+load(const uint32_t *p)
+{
+        return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static void
+store(uint32_t *p, uint32_t v)
+{
+        __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static void
+bump(uint32_t *p)
+{
+        __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * futex_wait/futex_wake: not FUTEX_PRIVATE_FLAG as the memory can be
+ * shared with another process.
+ */
+
+static void
+futex_wait(uint32_t *p, uint32_t v)
+{
+        syscall(SYS_futex, p, FUTEX_WAIT, v, NULL, NULL, 0);
+}
+
+static void
+futex_wake(uint32_t *p)
+{
+        syscall(SYS_futex, p, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*
+ * wait_change: wait until `*p` is not `v`, unless `*p` has already
+ * changed. `*waiting` tells the other side to wake us up.
+ */
+
+static void
+wait_change(uint32_t *p, uint32_t v, uint32_t *waiting)
+{
+        store(waiting, 1);
+        if (load(p) == v) {
+                futex_wait(p, v);
+        }
+        store(waiting, 0);
+}
+
+static void
+publish_tail(struct jsonsink_ring_ctl *ctl, uint32_t tail)
+{
+        store(&ctl->tail, tail);
+        if (load(&ctl->tail_waiting)) {
+                futex_wake(&ctl->tail);
+        }
+}
+
+static void
+publish_head(struct jsonsink_ring_ctl *ctl, uint32_t head)
+{
+        store(&ctl->head, head);
+        bump(&ctl->seq);
+        if (load(&ctl->head_waiting)) {
+                futex_wake(&ctl->seq);
+        }
+}
+
+static bool
+ring_flush(struct jsonsink *s, size_t needed)
+{
+        struct jsonsink_ring *r = (void *)s;
+        struct jsonsink_ring_ctl *ctl = r->ctl;
+        uint32_t head = load(&ctl->head) + s->bufpos;
+
+        JSONSINK_ASSUME(needed <= r->chunksize);
+        publish_head(ctl, head);
+        size_t avail;
+        for (;;) {
+                uint32_t tail = load(&ctl->tail);
+                avail = r->size - (uint32_t)(head - tail);
+                if (avail >= needed) {
+                        break;
+                }
+                wait_change(&ctl->tail, tail, &ctl->tail_waiting);
+        }
+        /*
+         * publish at least every `chunksize` bytes so that the consumer
+         * can start before the ring gets full.
+         */
+        if (avail > r->chunksize) {
+                avail = r->chunksize;
+        }
+        s->buf = r->base + head % r->size;
+        s->buflen = avail;
+        s->bufpos = 0;
+        return true;
+}
+
+static void
+ring_unmap(struct jsonsink_ring *r)
+{
+        if (r->ctl != NULL) {
+                munmap(r->ctl, sizeof(*r->ctl));
+        }
+        if (r->base != NULL) {
+                munmap(r->base, 2 * r->size);
+        }
+        if (r->memfd != -1) {
+                close(r->memfd);
+        }
+}
+
+bool
+jsonsink_ring_init(struct jsonsink_ring *r, size_t size)
+{
+        long pagesize = sysconf(_SC_PAGESIZE);
+        size_t n;
+
+        if (pagesize <= 0) {
+                pagesize = 4096;
+        }
+        if (size == 0) {
+                size = JSONSINK_RING_DEFAULT_SIZE;
+        }
+        if (size > JSONSINK_RING_MAX_SIZE) {
+                return false;
+        }
+        for (n = pagesize; n < size; n *= 2) {
+        }
+        r->size = n;
+        r->chunksize = n / 4;
+        if (r->chunksize < JSONSINK_MAX_RESERVATION) {
+                r->chunksize = n;
+        }
+        r->base = NULL;
+        r->ctl = NULL;
+
+        /* the ring followed by a page for jsonsink_ring_ctl */
+        r->memfd = memfd_create("jsonsink-ring", MFD_CLOEXEC);
+        if (r->memfd == -1 || ftruncate(r->memfd, n + pagesize) == -1) {
+                goto fail;
+        }
+        void *p = mmap(NULL, 2 * n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (p == MAP_FAILED) {
+                goto fail;
+        }
+        r->base = p;
+        if (mmap(r->base, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 r->memfd, 0) == MAP_FAILED ||
+            mmap(r->base + n, n, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, r->memfd, 0) == MAP_FAILED) {
+                goto fail;
+        }
+        p = mmap(NULL, sizeof(*r->ctl), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 r->memfd, n);
+        if (p == MAP_FAILED) {
+                goto fail;
+        }
+        r->ctl = p; /* zero-filled by ftruncate */
+        jsonsink_init(&r->s);
+        jsonsink_set_buffer(&r->s, r->base, r->chunksize);
+        r->s.flush = ring_flush;
+        return true;
+fail:
+        ring_unmap(r);
+        return false;
+}
+
+void
+jsonsink_ring_finish(struct jsonsink_ring *r)
+{
+        struct jsonsink_ring_ctl *ctl = r->ctl;
+        uint32_t head = load(&ctl->head) + r->s.bufpos;
+
+        store(&ctl->head, head);
+        r->s.bufpos = 0;
+        store(&ctl->closed, 1);
+        /* wake the consumer even if there's nothing new to read */
+        bump(&ctl->seq);
+        futex_wake(&ctl->seq);
+}
+
+size_t
+jsonsink_ring_read(struct jsonsink_ring *r, const void **pp)
+{
+        struct jsonsink_ring_ctl *ctl = r->ctl;
+        uint32_t tail = load(&ctl->tail);
+
+        for (;;) {
+                uint32_t seq = load(&ctl->seq);
+                uint32_t head = load(&ctl->head);
+                if (head == tail && load(&ctl->closed)) {
+                        /* the producer might have published before closing */
+                        head = load(&ctl->head);
+                }
+                if (head != tail) {
+                        *pp = r->base + tail % r->size;
+                        return (uint32_t)(head - tail);
+                }
+                if (load(&ctl->closed)) {
+                        return 0;
+                }
+                wait_change(&ctl->seq, seq, &ctl->head_waiting);
+        }
+}
+
+void
+jsonsink_ring_consume(struct jsonsink_ring *r, size_t len)
+{
+        struct jsonsink_ring_ctl *ctl = r->ctl;
+        uint32_t tail = load(&ctl->tail);
+
+        JSONSINK_ASSUME(len <= (uint32_t)(load(&ctl->head) - tail));
+        publish_tail(ctl, tail + len);
+}
+
+void
+jsonsink_ring_destroy(struct jsonsink_ring *r)
+{
+        ring_unmap(r);
+        r->base = NULL;
+        r->ctl = NULL;
+        r->memfd = -1;
+        r->s.buf = NULL;
+}
+
+#endif /* defined(__linux__) */
@@ -34,34 +34,6 @@
 
 #include "jsonsink.h"
 
-void
-jsonsink_add_uint32(struct jsonsink *s, uint32_t v)
-{
-        const size_t maxlen = sizeof("4294967295");
-        void *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
-        int ret = snprintf(dest, dest != NULL ? maxlen : 0, "%" PRIu32, v);
-        if (ret < 0) {
-                jsonsink_set_error(s, JSONSINK_ERROR_SERIALIZATION);
-                return;
-        }
-        JSONSINK_ASSUME(ret < maxlen);
-        jsonsink_add_serialized_value_commit(s, ret);
-}
-
-void
-jsonsink_add_int32(struct jsonsink *s, int32_t v)
-{
-        const size_t maxlen = sizeof("-2147483648");
-        void *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
-        int ret = snprintf(dest, dest != NULL ? maxlen : 0, "%" PRId32, v);
-        if (ret < 0) {
-                jsonsink_set_error(s, JSONSINK_ERROR_SERIALIZATION);
-                return;
-        }
-        JSONSINK_ASSUME(ret < maxlen);
-        jsonsink_add_serialized_value_commit(s, ret);
-}
-
 void
 jsonsink_add_double(struct jsonsink *s, double v)
 {
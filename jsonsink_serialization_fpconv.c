@@ -25,7 +25,7 @@
  */
 
 /*
- * this file is an example to use alternative itoa/dtoa implementations,
+ * this file is an example to use alternative dtoa implementations,
  * namely [fpconv].
  *
  * [fpconv]: https://github.com/night-shift/fpconv
@@ -44,18 +44,6 @@
  */
 #define FPCONV_MAX_OUTPUT_LEN 24
 
-void
-jsonsink_add_uint32(struct jsonsink *s, uint32_t v)
-{
-        jsonsink_add_double(s, (double)v);
-}
-
-void
-jsonsink_add_int32(struct jsonsink *s, int32_t v)
-{
-        jsonsink_add_double(s, (double)v);
-}
-
 void
 jsonsink_add_double(struct jsonsink *s, double v)
 {
@@ -25,7 +25,7 @@
  */
 
 /*
- * this file is an example to use alternative itoa/dtoa implementations,
+ * this file is an example to use alternative dtoa implementations,
  * namely LJSON jnum.c.
  *
  * note: LJSON jnum.c functions write out the terminating NUL to the buffer.
@@ -44,35 +44,11 @@
 #include "jnum.h"
 #include "jsonsink.h"
 
-#define MAX_STR_SIZE_U32 sizeof("4294967295")
-#define MAX_STR_SIZE_S32 sizeof("-2147483648")
 /*
  * the maximum length of the scientific notation of IEEE 754 double is 23.
  */
 #define MAX_STR_SIZE_DOUBLE (23 + 1)
 
-void
-jsonsink_add_uint32(struct jsonsink *s, uint32_t v)
-{
-        const size_t maxlen = MAX_STR_SIZE_U32;
-        char tmp[MAX_STR_SIZE_U32];
-        void *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
-        int ret = jnum_ltoa(v, dest != NULL ? dest : tmp);
-        JSONSINK_ASSUME(ret < maxlen);
-        jsonsink_add_serialized_value_commit(s, ret);
-}
-
-void
-jsonsink_add_int32(struct jsonsink *s, int32_t v)
-{
-        const size_t maxlen = MAX_STR_SIZE_S32;
-        char tmp[MAX_STR_SIZE_S32];
-        void *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
-        int ret = jnum_itoa(v, dest != NULL ? dest : tmp);
-        JSONSINK_ASSUME(ret < maxlen);
-        jsonsink_add_serialized_value_commit(s, ret);
-}
-
 void
 jsonsink_add_double(struct jsonsink *s, double v)
 {
@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * RFC 3339 timestamps.
+ *
+ * the "YYYY-MM-DDTHH:MM:SS" part is cached per thread and only rewritten
+ * when the second changes. (and the date part only when the day changes)
+ * as timestamps in a log stream are usually close to each other, most
+ * of them only need the fraction to be formatted.
+ */
+
+#include <string.h>
+
+#include "jsonsink.h"
+
+static const char digits2[200] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static const uint32_t pow10_u32[10] = {
+        1,      10,      100,      1000,      10000,
+        100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+#define PREFIX_LEN 19 /* 2026-10-17T12:34:56 */
+
+struct prefix_cache {
+        int64_t sec;
+        int64_t day;
+        char text[PREFIX_LEN];
+};
+
+static _Thread_local struct prefix_cache cache = {
+        .sec = INT64_MIN,
+        .day = INT64_MIN,
+};
+
+static void
+put2(char *p, unsigned int v)
+{
+        JSONSINK_ASSUME(v < 100);
+        memcpy(p, &digits2[v * 2], 2);
+}
+
+static int64_t
+floor_div(int64_t a, int64_t b)
+{
+        int64_t q = a / b;
+        return q - (a % b < 0);
+}
+
+/*
+ * civil_from_days: convert days since 1970-01-01 to a date in the
+ * proleptic gregorian calendar.
+ *
+ * this is the algorithm described in Howard Hinnant's
+ * "chrono-Compatible Low-Level Date Algorithms".
+ */
+
+static void
+civil_from_days(int64_t z, int *yp, unsigned int *mp, unsigned int *dp)
+{
+        z += 719468; /* days from 0000-03-01 to 1970-01-01 */
+        int64_t era = floor_div(z, 146097);
+        unsigned int doe = z - era * 146097; /* [0, 146096] */
+        unsigned int yoe =
+                (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned int m5 = (5 * doy + 2) / 153; /* march based month */
+        unsigned int m = m5 < 10 ? m5 + 3 : m5 - 9;
+        *yp = (int)(yoe + era * 400) + (m <= 2);
+        *mp = m;
+        *dp = doy - (153 * m5 + 2) / 5 + 1;
+}
+
+static void
+update_prefix(int64_t sec)
+{
+        int64_t day = floor_div(sec, 86400);
+        unsigned int sod = sec - day * 86400;
+        char *p = cache.text;
+        if (day != cache.day) {
+                int y;
+                unsigned int m;
+                unsigned int d;
+                civil_from_days(day, &y, &m, &d);
+                /* int64_t nanoseconds cover 1677-2262 */
+                JSONSINK_ASSUME(y >= 0 && y <= 9999);
+                put2(p, y / 100);
+                put2(p + 2, y % 100);
+                p[4] = '-';
+                put2(p + 5, m);
+                p[7] = '-';
+                put2(p + 8, d);
+                p[10] = 'T';
+                p[13] = ':';
+                p[16] = ':';
+                cache.day = day;
+        }
+        put2(p + 11, sod / 3600);
+        put2(p + 14, sod / 60 % 60);
+        put2(p + 17, sod % 60);
+        cache.sec = sec;
+}
+
+size_t
+jsonsink_format_timestamp_ns(char *dst, int64_t epoch_ns,
+                             unsigned int precision)
+{
+        JSONSINK_ASSERT(precision <= 9);
+        /* note: sec * 1000000000 can overflow for negative values */
+        int64_t sec = epoch_ns / 1000000000;
+        int32_t frac = epoch_ns % 1000000000;
+        if (frac < 0) {
+                sec--;
+                frac += 1000000000;
+        }
+        char *p = dst;
+        if (sec != cache.sec) {
+                update_prefix(sec);
+        }
+        memcpy(p, cache.text, PREFIX_LEN);
+        p += PREFIX_LEN;
+        if (precision > 0) {
+                /* truncate to the precision */
+                uint32_t v = (uint32_t)frac / pow10_u32[9 - precision];
+                unsigned int n = precision;
+                *p++ = '.';
+                while (n >= 2) {
+                        n -= 2;
+                        put2(p + n, v % 100);
+                        v /= 100;
+                }
+                if (n > 0) {
+                        p[0] = '0' + v;
+                }
+                p += precision;
+        }
+        *p++ = 'Z';
+        return p - dst;
+}
+
+void
+jsonsink_add_timestamp_ns(struct jsonsink *s, int64_t epoch_ns,
+                          unsigned int precision)
+{
+        const size_t maxlen = JSONSINK_FORMAT_TIMESTAMP_MAXLEN + 2;
+        char tmp[JSONSINK_FORMAT_TIMESTAMP_MAXLEN + 2];
+        char *dest = jsonsink_add_serialized_value_reserve(s, maxlen);
+        if (dest == NULL) {
+                dest = tmp;
+        }
+        size_t len = jsonsink_format_timestamp_ns(dest + 1, epoch_ns,
+                                                  precision);
+        dest[0] = '"';
+        dest[len + 1] = '"';
+        JSONSINK_ASSUME(len + 2 <= maxlen);
+        jsonsink_add_serialized_value_commit(s, len + 2);
+}
@@ -0,0 +1,555 @@
+/*-
+ * Copyright (c)2025 YAMAMOTO Takashi,
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+/*
+ * a sink which writes to a file descriptor with io_uring.
+ *
+ * io_uring is used via raw syscalls so that liburing is not necessary.
+ */
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "jsonsink.h"
+
+struct uring_buffer {
+        void *p;
+        size_t len;  /* the number of bytes to write */
+        size_t done; /* the number of bytes written */
+        uint64_t off;
+        bool inflight;
+};
+
+struct jsonsink_uring_ring {
+        int ringfd;
+
+        /* submission queue */
+        void *sqmem;
+        size_t sqmemsize;
+        unsigned int *sqhead;
+        unsigned int *sqtail;
+        unsigned int sqmask;
+        unsigned int *sqarray;
+        struct io_uring_sqe *sqes;
+        size_t sqessize;
+
+        /* completion queue */
+        void *cqmem;
+        size_t cqmemsize;
+        unsigned int *cqhead;
+        unsigned int *cqtail;
+        unsigned int cqmask;
+        struct io_uring_cqe *cqes;
+
+        /*
+         * for seekable files, each buffer is written at its own offset
+         * and the writes can be in flight concurrently. otherwise (pipes,
+         * sockets, O_APPEND files) only one write is in flight at a time
+         * to keep the order.
+         */
+        bool sequential;
+        uint64_t off;
+
+        /*
+         * for O_DIRECT, the length and the offset of writes are multiples
+         * of `align`. 0 otherwise.
+         */
+        size_t align;
+
+        /*
+         * the buffers are registered with IORING_REGISTER_BUFFERS so that
+         * the kernel doesn't need to pin the pages for every write.
+         * (IORING_OP_WRITE_FIXED) false if the registration failed.
+         * (eg. RLIMIT_MEMLOCK on old kernels) IORING_OP_WRITE is used in
+         * that case.
+         */
+        bool fixed;
+
+        void *mem; /* nbufs * bufsize */
+        unsigned int cur;
+        unsigned int inflight;
+        struct uring_buffer bufs[];
+};
+
+static int
+uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+        return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+uring_enter(int ringfd, unsigned int to_submit, unsigned int min_complete,
+            unsigned int flags)
+{
+        return syscall(__NR_io_uring_enter, ringfd, to_submit, min_complete,
+                       flags, NULL, 0);
+}
+
+static int
+uring_register(int ringfd, unsigned int opcode, void *arg,
+               unsigned int nargs)
+{
+        return syscall(__NR_io_uring_register, ringfd, opcode, arg, nargs);
+}
+
+static bool
+register_buffers(struct jsonsink_uring_ring *r, unsigned int nbufs,
+                 size_t bufsize)
+{
+        struct iovec *iov = malloc(nbufs * sizeof(*iov));
+        unsigned int i;
+
+        if (iov == NULL) {
+                return false;
+        }
+        for (i = 0; i < nbufs; i++) {
+                iov[i].iov_base = r->bufs[i].p;
+                iov[i].iov_len = bufsize;
+        }
+        int ret = uring_register(r->ringfd, IORING_REGISTER_BUFFERS, iov,
+                                 nbufs);
+        free(iov);
+        return ret == 0;
+}
+
+static void
+ring_unmap(struct jsonsink_uring_ring *r)
+{
+        if (r->sqes != NULL) {
+                munmap(r->sqes, r->sqessize);
+        }
+        if (r->cqmem != NULL) {
+                munmap(r->cqmem, r->cqmemsize);
+        }
+        if (r->sqmem != NULL) {
+                munmap(r->sqmem, r->sqmemsize);
+        }
+        if (r->ringfd != -1) {
+                close(r->ringfd);
+        }
+}
+
+static void *
+ring_mmap(int ringfd, size_t size, off_t off)
+{
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ringfd, off);
+        if (p == MAP_FAILED) {
+                return NULL;
+        }
+        return p;
+}
+
+static bool
+ring_init(struct jsonsink_uring_ring *r, unsigned int entries)
+{
+        struct io_uring_params p;
+
+        memset(&p, 0, sizeof(p));
+        r->sqmem = r->cqmem = r->sqes = NULL;
+        r->ringfd = uring_setup(entries, &p);
+        if (r->ringfd == -1) {
+                return false;
+        }
+        r->sqmemsize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        r->sqmem = ring_mmap(r->ringfd, r->sqmemsize, IORING_OFF_SQ_RING);
+        r->cqmemsize =
+                p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        r->cqmem = ring_mmap(r->ringfd, r->cqmemsize, IORING_OFF_CQ_RING);
+        r->sqessize = p.sq_entries * sizeof(struct io_uring_sqe);
+        r->sqes = ring_mmap(r->ringfd, r->sqessize, IORING_OFF_SQES);
+        if (r->sqmem == NULL || r->cqmem == NULL || r->sqes == NULL) {
+                ring_unmap(r);
+                return false;
+        }
+        char *sq = r->sqmem;
+        r->sqhead = (void *)(sq + p.sq_off.head);
+        r->sqtail = (void *)(sq + p.sq_off.tail);
+        r->sqmask = *(unsigned int *)(sq + p.sq_off.ring_mask);
+        r->sqarray = (void *)(sq + p.sq_off.array);
+        char *cq = r->cqmem;
+        r->cqhead = (void *)(cq + p.cq_off.head);
+        r->cqtail = (void *)(cq + p.cq_off.tail);
+        r->cqmask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+        r->cqes = (void *)(cq + p.cq_off.cqes);
+        return true;
+}
+
+/*
+ * submit_write: submit a write of the unwritten part of the buffer.
+ *
+ * note: there are at most nbufs writes in flight and the submission queue
+ * has at least nbufs entries. it can't be full.
+ */
+
+static bool
+submit_write(struct jsonsink_uring *u, unsigned int i)
+{
+        struct jsonsink_uring_ring *r = u->ring;
+        struct uring_buffer *b = &r->bufs[i];
+        unsigned int tail = *r->sqtail;
+        unsigned int idx = tail & r->sqmask;
+        struct io_uring_sqe *sqe = &r->sqes[idx];
+
+        JSONSINK_ASSUME(b->done < b->len);
+        memset(sqe, 0, sizeof(*sqe));
+        if (r->fixed) {
+                sqe->opcode = IORING_OP_WRITE_FIXED;
+                sqe->buf_index = i;
+        } else {
+                sqe->opcode = IORING_OP_WRITE;
+        }
+        sqe->fd = u->fd;
+        sqe->addr = (uintptr_t)b->p + b->done;
+        sqe->len = b->len - b->done;
+        sqe->off = r->sequential ? (uint64_t)-1 : b->off + b->done;
+        sqe->user_data = i;
+        r->sqarray[idx] = idx;
+        __atomic_store_n(r->sqtail, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+                int ret = uring_enter(r->ringfd, 1, 0, 0);
+                if (ret == 1) {
+                        break;
+                }
+                if (ret == -1 && errno == EINTR) {
+                        continue;
+                }
+                /* the sqe was not consumed. undo */
+                __atomic_store_n(r->sqtail, tail, __ATOMIC_RELEASE);
+                u->write_errno = ret == -1 ? errno : EIO;
+                return false;
+        }
+        if (!b->inflight) {
+                b->inflight = true;
+                r->inflight++;
+        }
+        return true;
+}
+
+/*
+ * reap: wait for at least one completion and process all available ones.
+ * partial writes are resubmitted.
+ */
+
+static bool
+reap(struct jsonsink_uring *u)
+{
+        struct jsonsink_uring_ring *r = u->ring;
+        bool ok = true;
+
+        JSONSINK_ASSUME(r->inflight > 0);
+        for (;;) {
+                int ret = uring_enter(r->ringfd, 0, 1, IORING_ENTER_GETEVENTS);
+                if (ret != -1) {
+                        break;
+                }
+                if (errno != EINTR) {
+                        u->write_errno = errno;
+                        return false;
+                }
+        }
+        unsigned int head = *r->cqhead;
+        unsigned int tail = __atomic_load_n(r->cqtail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+                const struct io_uring_cqe *cqe = &r->cqes[head & r->cqmask];
+                unsigned int i = cqe->user_data;
+                int res = cqe->res;
+                struct uring_buffer *b = &r->bufs[i];
+
+                head++;
+                __atomic_store_n(r->cqhead, head, __ATOMIC_RELEASE);
+                JSONSINK_ASSUME(b->inflight);
+                if (res > 0) {
+                        b->done += res;
+                } else if (res != -EINTR && res != -EAGAIN) {
+                        if (u->write_errno == 0) {
+                                u->write_errno = res == 0 ? EIO : -res;
+                        }
+                        ok = false;
+                        b->done = b->len; /* give up */
+                }
+                if (b->done < b->len) {
+                        if (!submit_write(u, i)) {
+                                ok = false;
+                                b->done = b->len;
+                        } else {
+                                continue;
+                        }
+                }
+                b->inflight = false;
+                r->inflight--;
+        }
+        return ok;
+}
+
+static bool
+uring_flush(struct jsonsink *s, size_t needed)
+{
+        struct jsonsink_uring *u = (void *)s;
+        struct jsonsink_uring_ring *r = u->ring;
+        unsigned int i;
+
+        JSONSINK_ASSUME(needed <= s->buflen);
+        if (u->write_errno != 0) {
+                return false;
+        }
+
+        /*
+         * with `align`, only the aligned part is written. the rest is
+         * carried over to the next buffer. it's less than a block.
+         */
+        size_t len = s->bufpos;
+        if (r->align != 0) {
+                len -= len % r->align;
+        }
+        if (len == 0) {
+                /* the current buffer is still usable */
+                return true;
+        }
+        while (r->sequential && r->inflight > 0) {
+                if (!reap(u)) {
+                        return false;
+                }
+        }
+        struct uring_buffer *b = &r->bufs[r->cur];
+        b->len = len;
+        b->done = 0;
+        b->off = r->off;
+        r->off += len;
+        if (!submit_write(u, r->cur)) {
+                return false;
+        }
+
+        /*
+         * switch to a free buffer. block only when all of them are
+         * in flight.
+         */
+        while (r->inflight == u->nbufs) {
+                if (!reap(u)) {
+                        return false;
+                }
+        }
+        for (i = 0; r->bufs[i].inflight; i++) {
+        }
+        size_t carry = s->bufpos - len;
+        memcpy(r->bufs[i].p, (const char *)b->p + len, carry);
+        r->cur = i;
+        s->buf = r->bufs[i].p;
+        s->bufpos = carry;
+        return true;
+}
+
+/*
+ * submit_tail: for O_DIRECT, write the remaining data padded to a block.
+ * the padding is truncated by jsonsink_uring_finish.
+ */
+
+static bool
+submit_tail(struct jsonsink_uring *u)
+{
+        struct jsonsink *s = &u->s;
+        struct jsonsink_uring_ring *r = u->ring;
+        struct uring_buffer *b = &r->bufs[r->cur];
+        size_t len = s->bufpos;
+
+        if (u->write_errno != 0) {
+                return false;
+        }
+        if (len == 0) {
+                return true;
+        }
+        while (r->sequential && r->inflight > 0) {
+                if (!reap(u)) {
+                        return false;
+                }
+        }
+        size_t padded = (len + r->align - 1) / r->align * r->align;
+        JSONSINK_ASSUME(padded <= s->buflen);
+        memset((char *)b->p + len, 0, padded - len);
+        b->len = padded;
+        b->done = 0;
+        b->off = r->off;
+        r->off += len;
+        s->bufpos = 0;
+        return submit_write(u, r->cur);
+}
+
+static bool
+uring_init(struct jsonsink_uring *u, int fd, unsigned int nbufs,
+           size_t bufsize, bool direct)
+{
+        struct jsonsink_uring_ring *r;
+        long pagesize = sysconf(_SC_PAGESIZE);
+        unsigned int i;
+
+        if (pagesize <= 0) {
+                pagesize = 4096;
+        }
+        if (nbufs == 0) {
+                nbufs = JSONSINK_URING_DEFAULT_NBUFS;
+        }
+        if (bufsize == 0) {
+                bufsize = JSONSINK_URING_DEFAULT_BUFSIZE;
+        }
+        bufsize = (bufsize + pagesize - 1) / pagesize * pagesize;
+        if (direct && bufsize < 2 * (size_t)pagesize) {
+                /* a block and JSONSINK_MAX_RESERVATION bytes should fit */
+                bufsize = 2 * pagesize;
+        }
+        r = malloc(sizeof(*r) + nbufs * sizeof(r->bufs[0]));
+        if (r == NULL) {
+                return false;
+        }
+        if (posix_memalign(&r->mem, pagesize, nbufs * bufsize) != 0) {
+                free(r);
+                return false;
+        }
+        if (!ring_init(r, nbufs)) {
+                free(r->mem);
+                free(r);
+                return false;
+        }
+        for (i = 0; i < nbufs; i++) {
+                r->bufs[i].p = (char *)r->mem + i * bufsize;
+                r->bufs[i].inflight = false;
+        }
+        r->fixed = register_buffers(r, nbufs, bufsize);
+        r->cur = 0;
+        r->inflight = 0;
+
+        /*
+         * writes to a seekable file start at the current file offset.
+         * (as write(2) would do)
+         */
+        off_t off = lseek(fd, 0, SEEK_CUR);
+        int flags = fcntl(fd, F_GETFL);
+        r->sequential = off == -1 || flags == -1 || (flags & O_APPEND) != 0;
+        r->off = r->sequential ? 0 : off;
+
+        /*
+         * the page size is a multiple of the logical block sizes in
+         * practice. (512 or 4096)
+         */
+        r->align = direct ? pagesize : 0;
+        if (direct && (r->sequential || r->off % r->align != 0)) {
+                ring_unmap(r);
+                free(r->mem);
+                free(r);
+                return false;
+        }
+
+        u->ring = r;
+        u->fd = fd;
+        u->nbufs = nbufs;
+        u->write_errno = 0;
+        jsonsink_init(&u->s);
+        jsonsink_set_buffer(&u->s, r->bufs[0].p, bufsize);
+        u->s.flush = uring_flush;
+        return true;
+}
+
+bool
+jsonsink_uring_init(struct jsonsink_uring *u, int fd, unsigned int nbufs,
+                    size_t bufsize)
+{
+        return uring_init(u, fd, nbufs, bufsize, false);
+}
+
+bool
+jsonsink_uring_init_direct(struct jsonsink_uring *u, int fd,
+                           unsigned int nbufs, size_t bufsize)
+{
+        return uring_init(u, fd, nbufs, bufsize, true);
+}
+
+bool
+jsonsink_uring_finish(struct jsonsink_uring *u)
+{
+        struct jsonsink *s = &u->s;
+        struct jsonsink_uring_ring *r = u->ring;
+        bool ok = jsonsink_error(s) == JSONSINK_OK;
+
+        if (ok) {
+                if (r->align != 0) {
+                        ok = submit_tail(u);
+                } else {
+                        ok = jsonsink_flush(s, 0);
+                }
+        }
+
+        /* drain regardless of errors. the buffers are going to be freed */
+        while (r->inflight > 0) {
+                if (!reap(u)) {
+                        ok = false;
+                }
+        }
+        if (u->write_errno != 0) {
+                if (jsonsink_error(s) == JSONSINK_OK) {
+                        jsonsink_set_error(s, JSONSINK_ERROR_FLUSH_FAILED);
+                }
+                ok = false;
+        }
+        /* cut the padding of the last block */
+        if (ok && r->align != 0 && ftruncate(u->fd, r->off) == -1) {
+                u->write_errno = errno;
+                jsonsink_set_error(s, JSONSINK_ERROR_FLUSH_FAILED);
+                ok = false;
+        }
+        /* leave the file offset after the written data */
+        if (ok && !r->sequential &&
+            lseek(u->fd, r->off, SEEK_SET) == (off_t)-1) {
+                u->write_errno = errno;
+                jsonsink_set_error(s, JSONSINK_ERROR_FLUSH_FAILED);
+                ok = false;
+        }
+        return ok;
+}
+
+void
+jsonsink_uring_destroy(struct jsonsink_uring *u)
+{
+        struct jsonsink_uring_ring *r = u->ring;
+
+        JSONSINK_ASSUME(r->inflight == 0);
+        ring_unmap(r);
+        free(r->mem);
+        free(r);
+        u->ring = NULL;
+        u->s.buf = NULL;
+}
+
+#endif /* defined(__linux__) */
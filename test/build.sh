@@ -4,11 +4,24 @@ set -e
 set -x
 
 JSONSINK=..
-cc -g -O2 -Wall -Wvla -Werror -DJSONSINK_ENABLE_ASSERTIONS \
+# EXTRA_CFLAGS: eg. -mssse3 or -mavx2 to test the SIMD versions
+cc -g -O2 -Wall -Wvla -Werror -DJSONSINK_ENABLE_ASSERTIONS ${EXTRA_CFLAGS} \
 -I ${JSONSINK} \
 -o test \
 test.c \
 ${JSONSINK}/jsonsink.c \
 ${JSONSINK}/jsonsink_serialization.c \
+${JSONSINK}/jsonsink_itoa.c \
+${JSONSINK}/jsonsink_dtoa.c \
+${JSONSINK}/jsonsink_array.c \
+${JSONSINK}/jsonsink_double_cache.c \
+${JSONSINK}/jsonsink_timestamp.c \
+${JSONSINK}/jsonsink_ids.c \
 ${JSONSINK}/jsonsink_escape.c \
-${JSONSINK}/jsonsink_base64.c
+${JSONSINK}/jsonsink_intern.c \
+${JSONSINK}/jsonsink_base64.c \
+${JSONSINK}/jsonsink_base64_fd.c \
+${JSONSINK}/jsonsink_fd.c \
+${JSONSINK}/jsonsink_mmap.c \
+${JSONSINK}/jsonsink_ring.c \
+${JSONSINK}/jsonsink_uring.c
@@ -24,9 +24,23 @@
  * SUCH DAMAGE.
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE /* O_DIRECT */
+#endif
+
+#include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "jsonsink.h"
 
@@ -75,6 +89,8 @@ flush(struct jsonsink *s, size_t needed)
 static void
 build(struct jsonsink *s)
 {
+        uint32_t i;
+
         jsonsink_object_start(s);
         JSONSINK_ADD_LITERAL_KEY(s, "key1");
         jsonsink_object_start(s);
@@ -118,12 +134,138 @@ build(struct jsonsink *s)
         /* https://util.unicode.org/UnicodeJsps/character.jsp?a=1F977 */
         jsonsink_add_string(s, JSONSINK_LITERAL("ninja \xf0\x9f\xa5\xb7"));
 
+        /*
+         * test escape profiles
+         */
+        jsonsink_set_escape_profile(s, &jsonsink_escape_html);
+        jsonsink_add_string(s, JSONSINK_LITERAL("<a href=\"x\">&amp;</a> "
+                                                "ls \xe2\x80\xa8 "
+                                                "ps \xe2\x80\xa9 "
+                                                "euro \xe2\x82\xac"));
+        jsonsink_set_escape_profile(s, &jsonsink_escape_minimal);
+        jsonsink_add_string(s, JSONSINK_LITERAL("tab \t newline \n del \x7f "
+                                                "こんにちは, world"));
+        jsonsink_set_escape_profile(s, NULL);
+
+        /*
+         * test utf-8 validation
+         */
+        jsonsink_add_untrusted_string(
+                s, JSONSINK_LITERAL("ninja \xf0\x9f\xa5\xb7"),
+                JSONSINK_INVALID_UTF8_REPLACE);
+        /* overlong, surrogate half, out of range, truncated */
+        jsonsink_add_untrusted_string(
+                s,
+                JSONSINK_LITERAL("\xc0\xaf \xed\xa0\x80 \xf4\x90\x80\x80 "
+                                 "\xe3\x81 \xff end"),
+                JSONSINK_INVALID_UTF8_REPLACE);
+        jsonsink_set_escape_profile(s, &jsonsink_escape_minimal);
+        jsonsink_add_untrusted_string(s,
+                                      THOUSAND_CHARS "\xe3\x81\x93\xe3\x81"
+                                                     "\x80" THOUSAND_CHARS,
+                                      1000 + 6 + 1000,
+                                      JSONSINK_INVALID_UTF8_REPLACE);
+        jsonsink_set_escape_profile(s, NULL);
+
+        /*
+         * test streaming strings
+         */
+        jsonsink_string_start(s);
+        jsonsink_string_append(s, "ninja \xf0", 7);
+        jsonsink_string_append(s, "\x9f", 1);
+        jsonsink_string_append(s, NULL, 0);
+        jsonsink_string_append(s, "\xa5\xb7 \xe3\x81", 5);
+        jsonsink_string_append(s, "\x93\"", 2);
+        jsonsink_string_append(s, THOUSAND_CHARS, 1000);
+        jsonsink_string_end(s);
+        jsonsink_string_start_untrusted(s, JSONSINK_INVALID_UTF8_REPLACE);
+        jsonsink_string_append(s, "truncated \xf0\x9f", 12);
+        jsonsink_string_append(s, "\xa5", 1);
+        jsonsink_string_end(s);
+
+        /*
+         * test transcoding
+         */
+        jsonsink_add_string_latin1(
+                s, JSONSINK_LITERAL("caf\xe9 \"\xa9\xff\""));
+        static const uint16_t utf16[] = {
+                'n', 'i', 'n', 'j', 'a', ' ', 0xd83e, 0xdd77, ' ', 0x3053,
+                ' ', '"', '\n', ' ', 0xdc00, 0xd800, ' ', 0xd800,
+        };
+        jsonsink_add_string_utf16(s, utf16, sizeof(utf16) / sizeof(utf16[0]));
+        jsonsink_set_escape_profile(s, &jsonsink_escape_minimal);
+        jsonsink_add_string_latin1(
+                s, JSONSINK_LITERAL("caf\xe9 \"\xa9\xff\""));
+        jsonsink_add_string_utf16(s, utf16, sizeof(utf16) / sizeof(utf16[0]));
+        jsonsink_set_escape_profile(s, NULL);
+        uint16_t utf16_big[1000];
+        for (i = 0; i < 1000; i++) {
+                utf16_big[i] = THOUSAND_CHARS[i];
+        }
+        utf16_big[500] = 0xe9;
+        jsonsink_add_string_utf16(s, utf16_big, 1000);
+        jsonsink_add_string_latin1(s, THOUSAND_CHARS "\xe9", 1000 + 1);
+
+        /*
+         * test interned strings
+         */
+        static void *intern_mem[64];
+        struct jsonsink_intern_table t;
+        jsonsink_intern_init(&t, intern_mem, sizeof(intern_mem), NULL);
+        const struct jsonsink_interned *e = jsonsink_intern(
+                &t, JSONSINK_LITERAL("status \"ok\" \xe3\x81\x93"));
+        jsonsink_add_interned(s, e);
+        jsonsink_add_string_interned(s, &t, JSONSINK_LITERAL("not interned"));
+        jsonsink_add_string_intern(s, &t, JSONSINK_LITERAL("interned lazily"));
+        jsonsink_add_string_interned(s, &t,
+                                     JSONSINK_LITERAL("interned lazily"));
+
         jsonsink_add_binary_base64(
                 s, JSONSINK_LITERAL("nul \0 quote \" backslash \\"));
 
+        /*
+         * test other binary encodings
+         */
+        jsonsink_add_binary_hex(s, JSONSINK_LITERAL("\x00\x01\xab\xff"));
+        jsonsink_add_binary_base64url(s, JSONSINK_LITERAL("\xfb\xff\xfe"),
+                                      false);
+        jsonsink_add_binary_base64url(s, JSONSINK_LITERAL("\xfb\xff"),
+                                      false);
+        jsonsink_add_binary_base64url(s, JSONSINK_LITERAL("\xfb\xff"), true);
+        jsonsink_add_binary_base32(s, JSONSINK_LITERAL("foob"));
+        jsonsink_add_binary_base32(s, JSONSINK_LITERAL("foobar"));
+        jsonsink_add_binary_hex(s, THOUSAND_CHARS, 1000);
+        jsonsink_add_binary_base32(s, THOUSAND_CHARS, 1000);
+
+        /*
+         * test streaming base64
+         */
+        jsonsink_base64_start(s);
+        jsonsink_base64_append(s, "nul \0", 5);
+        jsonsink_base64_append(s, NULL, 0);
+        jsonsink_base64_append(s, " q", 2);
+        jsonsink_base64_append(s, "uote \" backslash \\", 18);
+        jsonsink_base64_end(s);
+        jsonsink_base64_start(s);
+        for (i = 0; i < 1000; i++) {
+                jsonsink_base64_append(s, &THOUSAND_CHARS[i], 1);
+        }
+        jsonsink_base64_end(s);
+        jsonsink_base64_start(s);
+        jsonsink_base64_end(s);
+        int fds[2];
+        if (pipe(fds) == 0) {
+                ssize_t ret = write(fds[1], THOUSAND_CHARS, 1000);
+                assert(ret == 1000);
+                close(fds[1]);
+                jsonsink_add_base64_fd(s, fds[0], 1000);
+                close(fds[0]);
+        }
+
         /* big strings */
         jsonsink_add_binary_base64(s, THOUSAND_CHARS, 1000);
         jsonsink_add_escaped_string(s, THOUSAND_CHARS, 1000);
+        jsonsink_add_string(s, THOUSAND_CHARS "\"", 1000 + 1);
         jsonsink_add_serialized_value(s, "\"" THOUSAND_CHARS "\"", 1000 + 2);
 
         /* empty strings */
@@ -132,7 +274,52 @@ build(struct jsonsink *s)
         jsonsink_add_binary_base64(s, NULL, 0);
         jsonsink_add_serialized_value(s, "\"\"", 2);
 
-        uint32_t i;
+        /* integers */
+        jsonsink_add_uint32(s, 0);
+        jsonsink_add_uint32(s, UINT32_MAX);
+        jsonsink_add_int32(s, INT32_MIN);
+        jsonsink_add_uint64(s, 0);
+        jsonsink_add_uint64(s, UINT64_MAX);
+        jsonsink_add_int64(s, INT64_MIN);
+        jsonsink_add_int64(s, INT64_MAX);
+        jsonsink_add_uint64_string(s, UINT64_MAX);
+        jsonsink_add_int64_string(s, INT64_MIN);
+        jsonsink_add_decimal(s, 1234, 2, false);
+        jsonsink_add_decimal(s, -5, 3, false);
+        jsonsink_add_decimal(s, 1500000, 6, true);
+
+        /* floats */
+        jsonsink_add_float(s, 0.1f);
+        jsonsink_add_float(s, -1.5e-7f);
+        jsonsink_add_float(s, FLT_MAX);
+        jsonsink_add_float(s, FLT_TRUE_MIN);
+        jsonsink_add_double_fixed(s, 35.6894875, 6);
+        jsonsink_add_double_fixed(s, 139.6917064, 3);
+        jsonsink_add_double_sig(s, 6.02214076e23, 3);
+        jsonsink_add_timestamp_ns(s, 1792240496789123456, 6);
+        jsonsink_add_timestamp_ns(s, 1792240496789123456, 0);
+        jsonsink_add_uuid(s, (const uint8_t[]){0x12, 0x3e, 0x45, 0x67, 0xe8,
+                                               0x9b, 0x12, 0xd3, 0xa4, 0x56,
+                                               0x42, 0x66, 0x14, 0x17, 0x40,
+                                               0x00});
+        jsonsink_add_ipv4(s, (const uint8_t[]){192, 0, 2, 1});
+        jsonsink_add_ipv6(s, (const uint8_t[]){0x20, 0x01, 0x0d, 0xb8, 0, 0,
+                                               0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               1});
+        jsonsink_add_mac(s, (const uint8_t[]){0, 0, 0x5e, 0, 0x53, 1});
+
+        /* numeric arrays */
+        jsonsink_add_uint32_array(s, (const uint32_t[]){0, 1, UINT32_MAX},
+                                  3);
+        jsonsink_add_int64_array(s, NULL, 0);
+        jsonsink_add_int64_array(s,
+                                 (const int64_t[]){INT64_MIN, -1, INT64_MAX,
+                                                   INT64_MIN, -1, INT64_MAX},
+                                 6);
+        jsonsink_add_float_array(s, (const float[]){0.1f, -FLT_MAX}, 2);
+        jsonsink_add_double_array(s, (const double[]){0.1, -DBL_MAX, 5e-324},
+                                  3);
+
         for (i = 0; i < 100; i++) {
                 jsonsink_object_start(s);
                 JSONSINK_ADD_LITERAL_KEY(s, "version");
@@ -194,8 +381,1856 @@ test_with_static_buffer(void)
         return 0;
 }
 
+/*
+ * check_escaped: add `in` with `add` and the escape profile `prof`, and
+ * compare the exact bytes with `expected`, which is the string value
+ * without the quotes. the same is done after a long ascii prefix so that
+ * the simd scanners see the input in the middle of their blocks.
+ */
+
+static void
+check_escaped(const struct jsonsink_escape_profile *prof,
+              void (*add)(struct jsonsink *, const char *, size_t),
+              const char *in, size_t inlen, const char *expected)
+{
+        static const char prefix[] = "0123456789012345678901234567890123"
+                                     "456789012345678901234567890123456";
+        const size_t prefixlen = sizeof(prefix) - 1;
+        char src[256];
+        char buf[512];
+        char exp[512];
+        unsigned int i;
+        assert(prefixlen + inlen <= sizeof(src));
+        memcpy(src, prefix, prefixlen);
+        memcpy(src + prefixlen, in, inlen);
+        for (i = 0; i < 2; i++) {
+                size_t skip = i == 0 ? prefixlen : 0;
+                struct jsonsink s;
+                jsonsink_init(&s);
+                jsonsink_set_buffer(&s, buf, sizeof(buf));
+                jsonsink_set_escape_profile(&s, prof);
+                add(&s, src + skip, prefixlen + inlen - skip);
+                assert(jsonsink_error(&s) == JSONSINK_OK);
+                int n = snprintf(exp, sizeof(exp), "\"%s%s\"",
+                                 prefix + skip, expected);
+                assert(n > 0 && (size_t)n < sizeof(exp));
+                assert(jsonsink_size(&s) == (size_t)n);
+                assert(!memcmp(buf, exp, n));
+        }
+}
+
+static void
+check_escaped_utf16(const struct jsonsink_escape_profile *prof,
+                    const uint16_t *in, size_t n, const char *expected)
+{
+        char buf[256];
+        struct jsonsink s;
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, buf, sizeof(buf));
+        jsonsink_set_escape_profile(&s, prof);
+        jsonsink_add_string_utf16(&s, in, n);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+        assert(jsonsink_size(&s) == strlen(expected) + 2);
+        assert(buf[0] == '"' && buf[strlen(expected) + 1] == '"');
+        assert(!memcmp(buf + 1, expected, strlen(expected)));
+}
+
+void
+test_escape_profiles(void)
+{
+        /* short escapes, other control characters, del, '/' and html */
+        static const char ctl[] = "\"\\/\b\f\n\r\t\x01\x1f\x7f <>&'";
+        /* 2, 3 and 4 byte sequences, including U+2028 and U+2029 */
+        static const char utf8[] = "\xc3\xa9 \xe2\x80\xa8\xe2\x80\xa9 "
+                                   "\xe2\x82\xac \xf0\x9f\xa5\xb7";
+        static const char latin1[] = "<&> \t\x7f\x80\xa9\xe9\xff";
+        static const uint16_t utf16[] = {
+                '<', 0xe9, 0x2028, 0xd83e, 0xdd77, 0xd800, '\t', 0x7f, 0x1f,
+        };
+        const size_t n16 = sizeof(utf16) / sizeof(utf16[0]);
+
+        /* the default: pure ascii, no short forms */
+        check_escaped(NULL, jsonsink_add_string, ctl, sizeof(ctl) - 1,
+                      "\\\"\\\\/\\u0008\\u000c\\u000a\\u000d\\u0009"
+                      "\\u0001\\u001f\\u007f <>&'");
+        check_escaped(&jsonsink_escape_ascii, jsonsink_add_string, utf8,
+                      sizeof(utf8) - 1,
+                      "\\u00e9 \\u2028\\u2029 \\u20ac \\ud83e\\udd77");
+        check_escaped(NULL, jsonsink_add_string_latin1, latin1,
+                      sizeof(latin1) - 1,
+                      "<&> \\u0009\\u007f\\u0080\\u00a9\\u00e9\\u00ff");
+        check_escaped_utf16(NULL, utf16, n16,
+                            "<\\u00e9\\u2028\\ud83e\\udd77\\ufffd"
+                            "\\u0009\\u007f\\u001f");
+
+        /* html: '<', '>', '&', U+2028 and U+2029 escaped, the rest raw */
+        check_escaped(&jsonsink_escape_html, jsonsink_add_string, ctl,
+                      sizeof(ctl) - 1,
+                      "\\\"\\\\/\\b\\f\\n\\r\\t\\u0001\\u001f\x7f "
+                      "\\u003c\\u003e\\u0026'");
+        check_escaped(&jsonsink_escape_html, jsonsink_add_string, utf8,
+                      sizeof(utf8) - 1,
+                      "\xc3\xa9 \\u2028\\u2029 \xe2\x82\xac "
+                      "\xf0\x9f\xa5\xb7");
+        check_escaped(&jsonsink_escape_html, jsonsink_add_string_latin1,
+                      latin1, sizeof(latin1) - 1,
+                      "\\u003c\\u0026\\u003e \\t\x7f\xc2\x80\xc2\xa9"
+                      "\xc3\xa9\xc3\xbf");
+        check_escaped_utf16(&jsonsink_escape_html, utf16, n16,
+                            "\\u003c\xc3\xa9\\u2028\xf0\x9f\xa5\xb7"
+                            "\xef\xbf\xbd\\t\x7f\\u001f");
+
+        /* minimal: only '"', '\\' and control characters */
+        check_escaped(&jsonsink_escape_minimal, jsonsink_add_string, ctl,
+                      sizeof(ctl) - 1,
+                      "\\\"\\\\/\\b\\f\\n\\r\\t\\u0001\\u001f\x7f <>&'");
+        check_escaped(&jsonsink_escape_minimal, jsonsink_add_string, utf8,
+                      sizeof(utf8) - 1, utf8);
+        check_escaped(&jsonsink_escape_minimal, jsonsink_add_string_latin1,
+                      latin1, sizeof(latin1) - 1,
+                      "<&> \\t\x7f\xc2\x80\xc2\xa9\xc3\xa9\xc3\xbf");
+        check_escaped_utf16(&jsonsink_escape_minimal, utf16, n16,
+                            "<\xc3\xa9\xe2\x80\xa8\xf0\x9f\xa5\xb7"
+                            "\xef\xbf\xbd\\t\x7f\\u001f");
+}
+
+void
+test_untrusted_string_error(void)
+{
+        char buf[100];
+        struct jsonsink s0;
+        struct jsonsink *s = &s0;
+        jsonsink_init(s);
+        jsonsink_set_buffer(s, buf, sizeof(buf));
+        jsonsink_add_untrusted_string(s, JSONSINK_LITERAL("ok \xe3\x81\x93"),
+                                      JSONSINK_INVALID_UTF8_ERROR);
+        assert(jsonsink_error(s) == JSONSINK_OK);
+        jsonsink_add_untrusted_string(s, JSONSINK_LITERAL("ng \xe3\x81"),
+                                      JSONSINK_INVALID_UTF8_ERROR);
+        assert(jsonsink_error(s) == JSONSINK_ERROR_INVALID_UTF8);
+}
+
+/*
+ * ref_encode: a straightforward rfc 4648 encoder to compare the encoders
+ * with. `bits` per character. (4 for hex, 5 for base32, 6 for base64)
+ */
+
+static size_t
+ref_encode(const char *alphabet, unsigned int bits, bool padding,
+           const uint8_t *p, size_t sz, char *out)
+{
+        const uint32_t mask = (1 << bits) - 1;
+        /* the number of characters of a whole block */
+        const unsigned int group = bits == 6 ? 4 : bits == 5 ? 8 : 2;
+        uint32_t acc = 0;
+        unsigned int nacc = 0;
+        size_t n = 0;
+        size_t i;
+        for (i = 0; i < sz; i++) {
+                acc = (acc << 8) | p[i];
+                nacc += 8;
+                while (nacc >= bits) {
+                        nacc -= bits;
+                        out[n++] = alphabet[(acc >> nacc) & mask];
+                }
+        }
+        if (nacc > 0) {
+                out[n++] = alphabet[(acc << (bits - nacc)) & mask];
+        }
+        while (padding && n % group != 0) {
+                out[n++] = '=';
+        }
+        return n;
+}
+
+struct mem_sink {
+        struct jsonsink s;
+        char *out;
+        size_t outlen;
+        size_t outsize;
+};
+
+static bool
+mem_sink_flush(struct jsonsink *s, size_t needed)
+{
+        struct mem_sink *ms = (void *)s;
+        assert(ms->outlen + s->bufpos <= ms->outsize);
+        memcpy(ms->out + ms->outlen, s->buf, s->bufpos);
+        ms->outlen += s->bufpos;
+        s->bufpos = 0;
+        return true;
+}
+
+static void
+add_base64url_padding(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_base64url(s, p, sz, true);
+}
+
+static void
+add_base64url_nopad(struct jsonsink *s, const void *p, size_t sz)
+{
+        jsonsink_add_binary_base64url(s, p, sz, false);
+}
+
+/* the streaming api with varying chunk sizes */
+static void
+add_base64_stream(struct jsonsink *s, const void *p, size_t sz)
+{
+        const uint8_t *cp = p;
+        size_t chunk = 1;
+        jsonsink_base64_start(s);
+        while (sz > 0) {
+                size_t n = chunk < sz ? chunk : sz;
+                jsonsink_base64_append(s, cp, n);
+                cp += n;
+                sz -= n;
+                chunk = chunk * 3 % 101;
+        }
+        jsonsink_base64_end(s);
+}
+
+struct binary_encoder {
+        void (*add)(struct jsonsink *, const void *, size_t);
+        const char *alphabet;
+        unsigned int bits;
+        bool padding;
+};
+
+/*
+ * check_binary_encoder: encode `len` bytes at `src` with a flushing
+ * sink whose buffer is `buf`, after a value of `off` bytes, and compare
+ * the output with ref_encode.
+ */
+
+static void
+check_binary_encoder(const struct binary_encoder *enc, const uint8_t *src,
+                     size_t len, char *buf, size_t bufsize, size_t off)
+{
+        static const char pad[] = "11111111111111111";
+        char out[5000];
+        char ref[5000];
+        struct mem_sink ms;
+
+        assert(off < sizeof(pad));
+        jsonsink_init(&ms.s);
+        jsonsink_set_buffer(&ms.s, buf, bufsize);
+        ms.s.flush = mem_sink_flush;
+        ms.out = out;
+        ms.outlen = 0;
+        ms.outsize = sizeof(out);
+        jsonsink_array_start(&ms.s);
+        if (off > 0) {
+                jsonsink_add_serialized_value(&ms.s, pad, off);
+        }
+        enc->add(&ms.s, src, len);
+        jsonsink_array_end(&ms.s);
+        assert(jsonsink_flush(&ms.s, 0));
+        assert(jsonsink_error(&ms.s) == JSONSINK_OK);
+
+        size_t reflen = ref_encode(enc->alphabet, enc->bits, enc->padding,
+                                   src, len, ref);
+        assert(reflen <= sizeof(ref));
+        /* "[" pad "," */
+        size_t pos = 1;
+        assert(out[0] == '[');
+        if (off > 0) {
+                assert(!memcmp(out + 1, pad, off) && out[off + 1] == ',');
+                pos = off + 2;
+        }
+        /* the whitespaces for JSONSINK_BASE64_ALIGN */
+        while (pos < ms.outlen && out[pos] == ' ') {
+                pos++;
+        }
+        assert(ms.outlen == pos + 1 + reflen + 2);
+        assert(out[pos] == '"');
+        assert(!memcmp(out + pos + 1, ref, reflen));
+        assert(!memcmp(out + pos + 1 + reflen, "\"]", 2));
+}
+
+void
+test_reserve_buffer_upto(void)
+{
+        char buf[100];
+        char out[256];
+        struct mem_sink ms;
+        size_t len;
+        jsonsink_init(&ms.s);
+        jsonsink_set_buffer(&ms.s, buf, sizeof(buf));
+        ms.s.flush = mem_sink_flush;
+        ms.out = out;
+        ms.outlen = 0;
+        ms.outsize = sizeof(out);
+        /* as much as available */
+        assert(jsonsink_reserve_buffer_upto(&ms.s, 10, 1000, &len) == buf);
+        assert(len == sizeof(buf));
+        jsonsink_commit_buffer(&ms.s, 95);
+        /* less than `minlen` is available. flushed. */
+        assert(jsonsink_reserve_buffer_upto(&ms.s, 10, 1000, &len) == buf);
+        assert(len == sizeof(buf) && ms.outlen == 95);
+        jsonsink_commit_buffer(&ms.s, 3);
+        /* up to `maxlen` */
+        assert(jsonsink_reserve_buffer_upto(&ms.s, 1, 2, &len) == buf + 3);
+        assert(len == 2);
+        jsonsink_commit_buffer(&ms.s, 2);
+        assert(jsonsink_error(&ms.s) == JSONSINK_OK);
+
+        /* no buffer. `maxlen` is accounted. */
+        struct jsonsink s;
+        jsonsink_init(&s);
+        assert(jsonsink_reserve_buffer_upto(&s, 4, 1000, &len) == NULL);
+        assert(len == 1000);
+        jsonsink_commit_buffer(&s, len);
+        assert(jsonsink_size(&s) == 1000);
+        assert(jsonsink_error(&s) == JSONSINK_ERROR_NO_BUFFER_SPACE);
+}
+
+void
+test_binary_encoders(void)
+{
+        static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                  "abcdefghijklmnopqrstuvwxyz0123456789+/";
+        static const char b64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "abcdefghijklmnopqrstuvwxyz0123456789-_";
+        static const char b32[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+        static const struct binary_encoder encoders[] = {
+                {jsonsink_add_binary_base64, b64, 6, true},
+                {add_base64_stream, b64, 6, true},
+                {add_base64url_padding, b64url, 6, true},
+                {add_base64url_nopad, b64url, 6, false},
+                {jsonsink_add_binary_base32, b32, 5, true},
+                {jsonsink_add_binary_hex, "0123456789abcdef", 4, false},
+        };
+        /*
+         * buffer sizes which make the encoders cut the output at various
+         * points, including in the middle of simd blocks.
+         */
+        static const size_t bufsizes[] = {
+                JSONSINK_MAX_RESERVATION, 65, 70, 96, 100, 127, 256, 4096,
+        };
+        /* the misalignment of the input, the buffer and the output */
+        static const size_t offsets[] = {0, 1, 17};
+        /* all up to 700, and around BASE64_ALIGN_THRESHOLD (1024) */
+        static const size_t biglens[] = {1023, 1024, 1025, 1031, 2000};
+        const size_t maxlen = 700;
+        uint8_t src[2000 + 17];
+        uint32_t x = 1;
+        size_t i;
+        for (i = 0; i < sizeof(src); i++) {
+                x = x * 1103515245 + 12345;
+                src[i] = x >> 16;
+        }
+        unsigned int e;
+        for (e = 0; e < sizeof(encoders) / sizeof(encoders[0]); e++) {
+                unsigned int b;
+                for (b = 0; b < sizeof(bufsizes) / sizeof(bufsizes[0]); b++) {
+                        unsigned int o;
+                        for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]);
+                             o++) {
+                                size_t off = offsets[o];
+                                /* exact size for the sanitizers */
+                                char *buf = malloc(off + bufsizes[b]);
+                                assert(buf != NULL);
+                                size_t len;
+                                for (len = 0; len <= maxlen; len++) {
+                                        check_binary_encoder(
+                                                &encoders[e], src + off, len,
+                                                buf + off, bufsizes[b], off);
+                                }
+                                for (i = 0; i < sizeof(biglens) /
+                                                        sizeof(biglens[0]);
+                                     i++) {
+                                        check_binary_encoder(
+                                                &encoders[e], src + off,
+                                                biglens[i], buf + off,
+                                                bufsizes[b], off);
+                                }
+                                free(buf);
+                        }
+                }
+        }
+}
+
+void
+test_base64_fd_error(void)
+{
+        char buf[100];
+        struct jsonsink s0;
+        struct jsonsink *s = &s0;
+        int fds[2];
+        jsonsink_init(s);
+        jsonsink_set_buffer(s, buf, sizeof(buf));
+        assert(pipe(fds) == 0);
+        assert(write(fds[1], "short", 5) == 5);
+        close(fds[1]);
+        jsonsink_add_base64_fd(s, fds[0], 6);
+        close(fds[0]);
+        assert(jsonsink_error(s) == JSONSINK_ERROR_READ_FAILED);
+}
+
+void
+test_fd_sink(void)
+{
+        struct jsonsink_fd fs;
+        struct jsonsink s;
+
+        /* the expected output */
+        jsonsink_init(&s);
+        build(&s);
+        assert(jsonsink_error(&s) == JSONSINK_ERROR_NO_BUFFER_SPACE);
+        size_t len = jsonsink_size(&s);
+        char *expected = malloc(len);
+        assert(expected != NULL);
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, expected, len);
+        build(&s);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+
+        /* a single page buffer, which gets full a few times */
+        FILE *fp = tmpfile();
+        assert(fp != NULL);
+        assert(jsonsink_fd_init(&fs, fileno(fp), 1));
+        assert(fs.s.buflen < len);
+        build(&fs.s);
+        assert(jsonsink_fd_finish(&fs));
+        jsonsink_fd_destroy(&fs);
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        rewind(fp);
+        assert(fread(buf, 1, len + 1, fp) == len);
+        assert(!memcmp(buf, expected, len));
+        fclose(fp);
+        free(buf);
+        free(expected);
+
+        /* a write error */
+        int fd = open("/dev/null", O_RDONLY);
+        assert(fd != -1);
+        assert(jsonsink_fd_init(&fs, fd, 0));
+        build(&fs.s);
+        assert(!jsonsink_fd_finish(&fs));
+        assert(jsonsink_error(&fs.s) == JSONSINK_ERROR_FLUSH_FAILED);
+        assert(fs.write_errno == EBADF);
+        jsonsink_fd_destroy(&fs);
+        close(fd);
+}
+
+/*
+ * emit_sg: large values and fragments mixed with small ones.
+ * `add_value`/`add_fragment` are either the plain jsonsink functions
+ * or the jsonsink_sg ones.
+ */
+
+static void
+emit_sg(struct jsonsink *s, const char *big, size_t biglen,
+        void (*add_value)(struct jsonsink *, const char *, size_t),
+        void (*add_fragment)(struct jsonsink *, const char *, size_t))
+{
+        unsigned int i;
+        jsonsink_array_start(s);
+        for (i = 0; i < 300; i++) {
+                jsonsink_add_uint32(s, i);
+                add_value(s, big, biglen - i % 3);
+                if (i % 7 == 0) {
+                        /* "big" starts with a digit */
+                        jsonsink_value_start(s);
+                        add_fragment(s, big + 1, biglen - 2);
+                        jsonsink_value_end(s);
+                }
+                add_value(s, "\"small\"", 7);
+        }
+        jsonsink_array_end(s);
+}
+
+/*
+ * make_big: a value for emit_sg. `biglen` digits.
+ */
+
+static char *
+make_big(size_t biglen)
+{
+        char *big = malloc(biglen);
+        assert(big != NULL);
+        memset(big, '1', biglen);
+        return big;
+}
+
+/*
+ * expected_emit_sg: the emit_sg output generated with the plain
+ * jsonsink functions into a buffer of the exact size.
+ */
+
+static char *
+expected_emit_sg(const char *big, size_t biglen, size_t *lenp)
+{
+        struct jsonsink s;
+        jsonsink_init(&s);
+        emit_sg(&s, big, biglen, jsonsink_add_serialized_value,
+                jsonsink_add_fragment);
+        assert(jsonsink_error(&s) == JSONSINK_ERROR_NO_BUFFER_SPACE);
+        size_t len = jsonsink_size(&s);
+        char *expected = malloc(len);
+        assert(expected != NULL);
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, expected, len);
+        emit_sg(&s, big, biglen, jsonsink_add_serialized_value,
+                jsonsink_add_fragment);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+        *lenp = len;
+        return expected;
+}
+
+static void
+sg_add_value(struct jsonsink *s, const char *p, size_t len)
+{
+        jsonsink_sg_add_serialized_value((void *)s, p, len);
+}
+
+static void
+sg_add_fragment(struct jsonsink *s, const char *p, size_t len)
+{
+        jsonsink_sg_add_fragment((void *)s, p, len);
+}
+
+void
+test_sg_sink(void)
+{
+        struct jsonsink_sg sg;
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        /*
+         * thresholds:
+         * 1: everything but the small ones is referenced. (the iovec list
+         *    gets full before the buffer)
+         * 0: the default
+         * biglen: only some of the values are referenced.
+         * biglen + 1: nothing is referenced.
+         */
+        static const size_t thresholds[] = {1, 0, 10000, 10001};
+        unsigned int i;
+        for (i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+                FILE *fp = tmpfile();
+                assert(fp != NULL);
+                assert(jsonsink_sg_init(&sg, fileno(fp), 1, thresholds[i]));
+                emit_sg(&sg.s, big, biglen, sg_add_value, sg_add_fragment);
+                assert(jsonsink_sg_finish(&sg));
+                jsonsink_sg_destroy(&sg);
+                rewind(fp);
+                assert(fread(buf, 1, len + 1, fp) == len);
+                assert(!memcmp(buf, expected, len));
+                fclose(fp);
+        }
+
+        /* a write error */
+        int fd = open("/dev/null", O_RDONLY);
+        assert(fd != -1);
+        assert(jsonsink_sg_init(&sg, fd, 0, 1));
+        emit_sg(&sg.s, big, biglen, sg_add_value, sg_add_fragment);
+        assert(!jsonsink_sg_finish(&sg));
+        assert(jsonsink_error(&sg.s) == JSONSINK_ERROR_FLUSH_FAILED);
+        assert(sg.write_errno == EBADF);
+        jsonsink_sg_destroy(&sg);
+        close(fd);
+
+        free(buf);
+        free(expected);
+        free(big);
+}
+
+struct direct_sink {
+        struct jsonsink s;
+        char buf[JSONSINK_MAX_RESERVATION];
+        char *out;
+        size_t outlen;
+        size_t outsize;
+        unsigned int ndirect;
+        bool fail;
+};
+
+static bool
+direct_sink_append(struct direct_sink *ds, const void *p, size_t len)
+{
+        if (ds->fail) {
+                return false;
+        }
+        if (ds->outlen + len > ds->outsize) {
+                ds->outsize = (ds->outlen + len) * 2;
+                ds->out = realloc(ds->out, ds->outsize);
+                assert(ds->out != NULL);
+        }
+        memcpy(ds->out + ds->outlen, p, len);
+        ds->outlen += len;
+        return true;
+}
+
+static bool
+direct_sink_flush(struct jsonsink *s, size_t needed)
+{
+        struct direct_sink *ds = (void *)s;
+        if (!direct_sink_append(ds, s->buf, s->bufpos)) {
+                return false;
+        }
+        s->bufpos = 0;
+        return true;
+}
+
+static bool
+direct_sink_write_direct(struct jsonsink *s, const void *p, size_t len)
+{
+        struct direct_sink *ds = (void *)s;
+        assert(s->bufpos == 0);
+        assert(len >= s->direct_threshold);
+        ds->ndirect++;
+        return direct_sink_append(ds, p, len);
+}
+
+static void
+direct_sink_init(struct direct_sink *ds, size_t threshold)
+{
+        jsonsink_init(&ds->s);
+        jsonsink_set_buffer(&ds->s, ds->buf, sizeof(ds->buf));
+        ds->s.flush = direct_sink_flush;
+        ds->s.write_direct = direct_sink_write_direct;
+        ds->s.direct_threshold = threshold;
+        ds->out = NULL;
+        ds->outlen = 0;
+        ds->outsize = 0;
+        ds->ndirect = 0;
+        ds->fail = false;
+}
+
+void
+test_write_direct(void)
+{
+        struct direct_sink ds;
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        /*
+         * thresholds and the expected number of write_direct calls:
+         * 1: everything but the numbers
+         * biglen: only some of the values (i % 3 == 0)
+         * biglen + 1: nothing
+         */
+        static const struct {
+                size_t threshold;
+                unsigned int ndirect;
+        } cases[] = {
+                {1, 300 * 2 + 43},
+                {10000, 100},
+                {10001, 0},
+        };
+        unsigned int i;
+        for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+                direct_sink_init(&ds, cases[i].threshold);
+                emit_sg(&ds.s, big, biglen, jsonsink_add_serialized_value,
+                        jsonsink_add_fragment);
+                assert(jsonsink_flush(&ds.s, 0));
+                assert(jsonsink_error(&ds.s) == JSONSINK_OK);
+                assert(ds.ndirect == cases[i].ndirect);
+                assert(ds.outlen == len);
+                assert(!memcmp(ds.out, expected, len));
+                free(ds.out);
+        }
+
+        /* a write error */
+        direct_sink_init(&ds, 1);
+        jsonsink_array_start(&ds.s);
+        ds.fail = true;
+        jsonsink_add_serialized_value(&ds.s, big, biglen);
+        assert(jsonsink_error(&ds.s) == JSONSINK_ERROR_FLUSH_FAILED);
+        assert(ds.ndirect == 0);
+
+        /* jsonsink_fd uses write_direct for values >= its buffer size */
+        struct jsonsink_fd fs;
+        FILE *fp = tmpfile();
+        assert(fp != NULL);
+        assert(jsonsink_fd_init(&fs, fileno(fp), 1));
+        assert(fs.s.direct_threshold < biglen);
+        emit_sg(&fs.s, big, biglen, jsonsink_add_serialized_value,
+                jsonsink_add_fragment);
+        assert(jsonsink_fd_finish(&fs));
+        jsonsink_fd_destroy(&fs);
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        rewind(fp);
+        assert(fread(buf, 1, len + 1, fp) == len);
+        assert(!memcmp(buf, expected, len));
+        fclose(fp);
+
+        free(buf);
+        free(expected);
+        free(big);
+}
+
+void
+test_mmap_sink(void)
+{
+        struct jsonsink_mmap m;
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        /*
+         * the smallest window, which slides many times, and the default.
+         * the existing contents of the file are replaced.
+         */
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        static const size_t winsizes[] = {1, 0};
+        unsigned int i;
+        for (i = 0; i < sizeof(winsizes) / sizeof(winsizes[0]); i++) {
+                FILE *fp = tmpfile();
+                assert(fp != NULL);
+                int fd = fileno(fp);
+                assert(ftruncate(fd, len * 2) == 0);
+                assert(jsonsink_mmap_init(&m, fd, winsizes[i]));
+                emit_sg(&m.s, big, biglen, jsonsink_add_serialized_value,
+                        jsonsink_add_fragment);
+                assert(jsonsink_mmap_finish(&m));
+                jsonsink_mmap_destroy(&m);
+                assert(lseek(fd, 0, SEEK_END) == len);
+                assert(pread(fd, buf, len + 1, 0) == len);
+                assert(!memcmp(buf, expected, len));
+                fclose(fp);
+        }
+
+        /* not a regular file */
+        int fds[2];
+        assert(pipe(fds) == 0);
+        assert(!jsonsink_mmap_init(&m, fds[1], 0));
+        assert(m.write_errno != 0);
+        assert(m.s.buf == NULL);
+        jsonsink_mmap_destroy(&m);
+        close(fds[0]);
+        close(fds[1]);
+
+        free(buf);
+        free(expected);
+        free(big);
+}
+
+#if defined(__linux__)
+/*
+ * uring_emit: write the emit_sg output with jsonsink_uring.
+ */
+
+static bool
+uring_emit(int fd, unsigned int nbufs, const char *big, size_t biglen,
+           int *errnop)
+{
+        struct jsonsink_uring u;
+        assert(jsonsink_uring_init(&u, fd, nbufs, 1));
+        emit_sg(&u.s, big, biglen, jsonsink_add_serialized_value,
+                jsonsink_add_fragment);
+        bool ok = jsonsink_uring_finish(&u);
+        assert(ok == (jsonsink_error(&u.s) == JSONSINK_OK));
+        *errnop = u.write_errno;
+        jsonsink_uring_destroy(&u);
+        return ok;
+}
+
+void
+test_uring_sink(void)
+{
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        int write_errno;
+
+        /* io_uring might not be available. (eg. seccomp) */
+        struct jsonsink_uring u;
+        if (!jsonsink_uring_init(&u, 1, 0, 0)) {
+                fprintf(stderr, "io_uring is not available. skipping\n");
+                free(big);
+                return;
+        }
+        jsonsink_uring_destroy(&u);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        static const unsigned int nbufs[] = {1, 2, 4, 16};
+        unsigned int i;
+        for (i = 0; i < sizeof(nbufs) / sizeof(nbufs[0]); i++) {
+                /*
+                 * a regular file. the output starts at the current file
+                 * offset, which is at the end of the output after
+                 * jsonsink_uring_finish.
+                 */
+                FILE *fp = tmpfile();
+                assert(fp != NULL);
+                int fd = fileno(fp);
+                assert(write(fd, "prefix", 6) == 6);
+                assert(uring_emit(fd, nbufs[i], big, biglen, &write_errno));
+                assert(lseek(fd, 0, SEEK_CUR) == 6 + len);
+                assert(pread(fd, buf, len + 1, 6) == len);
+                assert(!memcmp(buf, expected, len));
+                fclose(fp);
+
+                /* a pipe, drained by a child process */
+                int fds[2];
+                assert(pipe(fds) == 0);
+                pid_t pid = fork();
+                assert(pid != -1);
+                if (pid == 0) {
+                        size_t n = 0;
+                        ssize_t ret;
+                        close(fds[1]);
+                        while ((ret = read(fds[0], buf + n, len + 1 - n)) >
+                               0) {
+                                n += ret;
+                        }
+                        _exit(n == len && !memcmp(buf, expected, len) ? 0
+                                                                      : 1);
+                }
+                close(fds[0]);
+                assert(uring_emit(fds[1], nbufs[i], big, biglen,
+                                  &write_errno));
+                close(fds[1]);
+                int status;
+                assert(waitpid(pid, &status, 0) == pid);
+                assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        /* a write error */
+        int fd = open("/dev/null", O_RDONLY);
+        assert(fd != -1);
+        assert(!uring_emit(fd, 2, big, biglen, &write_errno));
+        assert(write_errno == EBADF);
+        close(fd);
+
+        free(buf);
+        free(expected);
+        free(big);
+}
+
+/*
+ * direct_emit: write the emit_sg output, or an empty array if `big` is
+ * NULL, to a new file with O_DIRECT and read it back into `buf`.
+ * returns the size of the file, or -1 if O_DIRECT or io_uring is not
+ * supported.
+ */
+
+static ssize_t
+direct_emit(unsigned int nbufs, const char *big, size_t biglen, char *buf,
+            size_t bufsize)
+{
+        struct jsonsink_uring u;
+        char path[] = "/tmp/jsonsink-test.XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd != -1);
+        close(fd);
+        fd = open(path, O_WRONLY | O_DIRECT);
+        if (fd == -1) {
+                assert(errno == EINVAL);
+                unlink(path);
+                return -1;
+        }
+        if (!jsonsink_uring_init_direct(&u, fd, nbufs, 1)) {
+                /* io_uring is not available */
+                close(fd);
+                unlink(path);
+                return -1;
+        }
+        if (big != NULL) {
+                emit_sg(&u.s, big, biglen, jsonsink_add_serialized_value,
+                        jsonsink_add_fragment);
+        } else {
+                jsonsink_array_start(&u.s);
+                jsonsink_array_end(&u.s);
+        }
+        assert(jsonsink_uring_finish(&u));
+        jsonsink_uring_destroy(&u);
+        close(fd);
+        fd = open(path, O_RDONLY);
+        assert(fd != -1);
+        unlink(path);
+        ssize_t len = pread(fd, buf, bufsize, 0);
+        assert(len != -1);
+        close(fd);
+        return len;
+}
+
+void
+test_uring_direct(void)
+{
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        char *buf = malloc(len + 1);
+        assert(buf != NULL);
+        ssize_t ret = direct_emit(1, NULL, 0, buf, len + 1);
+        if (ret == -1) {
+                fprintf(stderr, "O_DIRECT or io_uring is not supported. "
+                                "skipping\n");
+                goto out;
+        }
+        /* only the padded tail block */
+        assert(ret == 2);
+        assert(!memcmp(buf, "[]", 2));
+        static const unsigned int nbufs[] = {1, 2, 4};
+        unsigned int i;
+        for (i = 0; i < sizeof(nbufs) / sizeof(nbufs[0]); i++) {
+                ret = direct_emit(nbufs[i], big, biglen, buf, len + 1);
+                assert(ret == len);
+                assert(!memcmp(buf, expected, len));
+        }
+
+        /* an unaligned offset */
+        struct jsonsink_uring u;
+        FILE *fp = tmpfile();
+        assert(fp != NULL);
+        assert(write(fileno(fp), "x", 1) == 1);
+        assert(!jsonsink_uring_init_direct(&u, fileno(fp), 0, 0));
+        fclose(fp);
+out:
+        free(buf);
+        free(expected);
+        free(big);
+}
+
+/*
+ * ring_consume: read everything from the ring and compare it with
+ * `expected`. consume it in pieces of `piece` bytes.
+ */
+
+static bool
+ring_consume(struct jsonsink_ring *r, const char *expected, size_t len,
+             size_t piece)
+{
+        const void *p;
+        size_t n = 0;
+        size_t avail;
+        while ((avail = jsonsink_ring_read(r, &p)) > 0) {
+                if (avail > piece) {
+                        avail = piece;
+                }
+                if (n + avail > len || memcmp(p, expected + n, avail)) {
+                        return false;
+                }
+                n += avail;
+                jsonsink_ring_consume(r, avail);
+        }
+        return n == len;
+}
+
+void
+test_ring_sink(void)
+{
+        struct jsonsink_ring r;
+        size_t biglen = 10000;
+        char *big = make_big(biglen);
+        size_t len;
+        char *expected = expected_emit_sg(big, biglen, &len);
+
+        /*
+         * the smallest ring, which wraps many times, and the default.
+         * the consumer is a child process.
+         */
+        static const struct {
+                size_t size;
+                size_t piece;
+        } cases[] = {
+                {1, 1000},
+                {1, SIZE_MAX},
+                {0, SIZE_MAX},
+        };
+        unsigned int i;
+        for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+                assert(jsonsink_ring_init(&r, cases[i].size));
+                pid_t pid = fork();
+                assert(pid != -1);
+                if (pid == 0) {
+                        bool ok = ring_consume(&r, expected, len,
+                                               cases[i].piece);
+                        jsonsink_ring_destroy(&r);
+                        _exit(ok ? 0 : 1);
+                }
+                emit_sg(&r.s, big, biglen, jsonsink_add_serialized_value,
+                        jsonsink_add_fragment);
+                assert(jsonsink_error(&r.s) == JSONSINK_OK);
+                jsonsink_ring_finish(&r);
+                int status;
+                assert(waitpid(pid, &status, 0) == pid);
+                assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+                jsonsink_ring_destroy(&r);
+        }
+
+        /*
+         * jsonsink_ring_finish with nothing to publish wakes up the
+         * consumer which is already waiting.
+         */
+        assert(jsonsink_ring_init(&r, 0));
+        pid_t pid = fork();
+        assert(pid != -1);
+        if (pid == 0) {
+                const void *cp;
+                alarm(10); /* fail rather than hang */
+                size_t n = jsonsink_ring_read(&r, &cp);
+                jsonsink_ring_destroy(&r);
+                _exit(n == 0 ? 0 : 1);
+        }
+        usleep(100000); /* let the child block */
+        jsonsink_ring_finish(&r);
+        int status;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        jsonsink_ring_destroy(&r);
+
+        /* the mirror: a range across the end of the ring is contiguous */
+        assert(jsonsink_ring_init(&r, 1));
+        size_t size = r.size;
+        char *p = r.base;
+        p[size - 1] = 'a';
+        assert(p[2 * size - 1] == 'a');
+        p[size] = 'b';
+        assert(p[0] == 'b');
+        jsonsink_ring_destroy(&r);
+
+        free(expected);
+        free(big);
+}
+#endif /* defined(__linux__) */
+
+void
+test_intern_table(void)
+{
+        static void *mem[128];
+        struct jsonsink_intern_table t;
+        jsonsink_intern_init(&t, mem, sizeof(mem), &jsonsink_escape_minimal);
+        assert(jsonsink_intern_lookup(&t, JSONSINK_LITERAL("a")) == NULL);
+        const struct jsonsink_interned *a =
+                jsonsink_intern(&t, JSONSINK_LITERAL("a"));
+        assert(a != NULL);
+        assert(jsonsink_intern(&t, JSONSINK_LITERAL("a")) == a);
+        assert(jsonsink_intern_lookup(&t, JSONSINK_LITERAL("a")) == a);
+        assert(jsonsink_intern_lookup(&t, JSONSINK_LITERAL("b")) == NULL);
+        assert(jsonsink_intern(&t, NULL, 0) != NULL);
+        assert(jsonsink_intern(&t, THOUSAND_CHARS, 1000) == NULL);
+
+        /* fill the table */
+        char key[16];
+        unsigned int n = 0;
+        while (n < 1000) {
+                int len = snprintf(key, sizeof(key), "key%u", n);
+                if (jsonsink_intern(&t, key, len) == NULL) {
+                        break;
+                }
+                n++;
+        }
+        assert(n > 0 && n < 1000);
+        while (n-- > 0) {
+                int len = snprintf(key, sizeof(key), "key%u", n);
+                assert(jsonsink_intern_lookup(&t, key, len) != NULL);
+        }
+        assert(jsonsink_intern_lookup(&t, JSONSINK_LITERAL("a")) == a);
+
+        /*
+         * a table too small to register anything. misses use the table's
+         * escape profile, not the sink's one.
+         */
+        static void *small[1];
+        struct jsonsink_intern_table st;
+        jsonsink_intern_init(&st, small, sizeof(small),
+                             &jsonsink_escape_html);
+        assert(jsonsink_intern(&st, JSONSINK_LITERAL("<a>")) == NULL);
+        assert(jsonsink_intern_lookup(&st, JSONSINK_LITERAL("<a>")) == NULL);
+        char buf[64];
+        struct jsonsink s;
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, buf, sizeof(buf));
+        jsonsink_array_start(&s);
+        jsonsink_add_string_intern(&s, &st, JSONSINK_LITERAL("<a>"));
+        jsonsink_add_string_interned(&s, &st, JSONSINK_LITERAL("<a>"));
+        jsonsink_add_string(&s, JSONSINK_LITERAL("<a>"));
+        jsonsink_array_end(&s);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+        const char *expected = "[\"\\u003ca\\u003e\",\"\\u003ca\\u003e\","
+                               "\"<a>\"]";
+        assert(jsonsink_size(&s) == strlen(expected));
+        assert(!memcmp(buf, expected, strlen(expected)));
+}
+
+static void
+check_format_integer(uint64_t x)
+{
+        char buf[JSONSINK_FORMAT_INT64_MAXLEN];
+        char expected[32];
+        size_t len;
+        int n;
+
+        len = jsonsink_format_uint64(buf, x);
+        n = snprintf(expected, sizeof(expected), "%" PRIu64, x);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+        len = jsonsink_format_int64(buf, (int64_t)x);
+        n = snprintf(expected, sizeof(expected), "%" PRId64, (int64_t)x);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+        len = jsonsink_format_uint32(buf, (uint32_t)x);
+        n = snprintf(expected, sizeof(expected), "%" PRIu32, (uint32_t)x);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+        len = jsonsink_format_int32(buf, (int32_t)x);
+        n = snprintf(expected, sizeof(expected), "%" PRId32, (int32_t)x);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+}
+
+void
+test_format_integers(void)
+{
+        uint64_t p = 1;
+        uint64_t x = 1;
+        unsigned int i;
+
+        /* around every power of 10 */
+        for (i = 0; i < 20; i++) {
+                check_format_integer(p - 1);
+                check_format_integer(p);
+                check_format_integer(p + 1);
+                check_format_integer(-p);
+                p *= 10;
+        }
+        check_format_integer(UINT64_MAX);
+        check_format_integer(INT64_MAX);
+        check_format_integer((uint64_t)INT64_MIN);
+        check_format_integer(UINT32_MAX);
+        check_format_integer(INT32_MAX);
+        check_format_integer((uint32_t)INT32_MIN);
+
+        /* xorshift64 */
+        for (i = 0; i < 100000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                check_format_integer(x >> (x & 63));
+        }
+}
+
+static void
+check_format_decimal(int64_t m, unsigned int scale)
+{
+        char buf[JSONSINK_FORMAT_DECIMAL_MAXLEN];
+        char expected[64];
+        uint64_t u = m < 0 ? -(uint64_t)m : (uint64_t)m;
+        uint64_t p = 1;
+        unsigned int i;
+        size_t len;
+        int n;
+
+        for (i = 0; i < scale; i++) {
+                p *= 10;
+        }
+        if (scale == 0) {
+                n = snprintf(expected, sizeof(expected), "%" PRId64, m);
+        } else {
+                n = snprintf(expected, sizeof(expected),
+                             "%s%" PRIu64 ".%0*" PRIu64, m < 0 ? "-" : "",
+                             u / p, (int)scale, u % p);
+        }
+        len = jsonsink_format_decimal(buf, m, scale, false);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+
+        /* trim the trailing zeros of the fraction */
+        if (scale > 0) {
+                while (expected[n - 1] == '0') {
+                        n--;
+                }
+                if (expected[n - 1] == '.') {
+                        n--;
+                }
+        }
+        len = jsonsink_format_decimal(buf, m, scale, true);
+        assert(len == (size_t)n && !memcmp(buf, expected, len));
+}
+
+static void
+check_decimal(int64_t m, unsigned int scale, bool trim, const char *expected)
+{
+        char buf[JSONSINK_FORMAT_DECIMAL_MAXLEN];
+        size_t len = jsonsink_format_decimal(buf, m, scale, trim);
+        assert(len == strlen(expected) && !memcmp(buf, expected, len));
+}
+
+void
+test_format_decimal(void)
+{
+        uint64_t x = 1;
+        unsigned int i;
+
+        check_decimal(1234, 2, false, "12.34");
+        check_decimal(-5, 3, false, "-0.005");
+        check_decimal(1200, 2, false, "12.00");
+        check_decimal(1200, 2, true, "12");
+        check_decimal(1230, 2, true, "12.3");
+        check_decimal(0, 2, false, "0.00");
+        check_decimal(0, 2, true, "0");
+        check_decimal(INT64_MIN, 19, false, "-0.9223372036854775808");
+        check_decimal(INT64_MIN, 0, true, "-9223372036854775808");
+        check_decimal(INT64_MAX, 1, true, "922337203685477580.7");
+
+        /* xorshift64 */
+        for (i = 0; i < 100000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                int64_t m = (int64_t)x >> (x & 63);
+                if ((x & 0x100) != 0) {
+                        /* make trailing zeros common */
+                        m -= m % 1000;
+                }
+                check_format_decimal(m, (x >> 10) % 20);
+        }
+}
+
+void
+test_double_cache(void)
+{
+        static const double values[] = {
+                0, 0.5, -0.0, 12.5, 0, 0.5, 1e300, -2.2250738585072014e-308,
+        };
+        static uint64_t mem[JSONSINK_DOUBLE_CACHE_ENTRY_SIZE * 5 / 8];
+        struct jsonsink_double_cache c;
+        char expected[512];
+        char buf[512];
+        struct jsonsink s;
+        unsigned int i;
+        unsigned int j;
+
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, expected, sizeof(expected));
+        jsonsink_array_start(&s);
+        for (j = 0; j < 2; j++) {
+                for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                        jsonsink_add_double(&s, values[i]);
+                }
+        }
+        jsonsink_array_end(&s);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+        size_t len = jsonsink_size(&s);
+
+        /* 4 entries */
+        jsonsink_double_cache_init(&c, mem, sizeof(mem));
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, buf, sizeof(buf));
+        jsonsink_array_start(&s);
+        for (j = 0; j < 2; j++) {
+                for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                        jsonsink_add_double_cached(&s, &c, values[i]);
+                }
+        }
+        jsonsink_array_end(&s);
+        assert(jsonsink_error(&s) == JSONSINK_OK);
+        assert(jsonsink_size(&s) == len);
+        assert(!memcmp(buf, expected, len));
+        assert(c.hits + c.misses == 16);
+        /* the second round hits unless evicted */
+        assert(c.hits > 0);
+
+        /*
+         * 1 entry. -2.2250738585072014e-308 is too long to be cached with
+         * jsonsink_serialization.c. ("%1.17g") it doesn't evict 0.
+         */
+        static const double values2[] = {
+                0, 0, 0.5, 0.5, 0, -2.2250738585072014e-308,
+                -2.2250738585072014e-308, 0,
+        };
+        jsonsink_double_cache_init(&c, mem, JSONSINK_DOUBLE_CACHE_ENTRY_SIZE);
+        jsonsink_init(&s);
+        jsonsink_set_buffer(&s, buf, sizeof(buf));
+        for (i = 0; i < sizeof(values2) / sizeof(values2[0]); i++) {
+                jsonsink_add_double_cached(&s, &c, values2[i]);
+        }
+        assert(c.hits == 3);
+        assert(c.misses == 5);
+
+        /* size calculation */
+        jsonsink_double_cache_init(&c, mem, sizeof(mem));
+        jsonsink_init(&s);
+        jsonsink_array_start(&s);
+        for (j = 0; j < 2; j++) {
+                for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                        jsonsink_add_double_cached(&s, &c, values[i]);
+                }
+        }
+        jsonsink_array_end(&s);
+        assert(jsonsink_error(&s) == JSONSINK_ERROR_NO_BUFFER_SPACE);
+        assert(jsonsink_size(&s) == len);
+}
+
+static void
+check_timestamp(int64_t ns, unsigned int precision)
+{
+        char buf[JSONSINK_FORMAT_TIMESTAMP_MAXLEN];
+        char expected[64];
+        int64_t sec = ns / 1000000000;
+        int64_t frac = ns % 1000000000;
+        if (frac < 0) {
+                sec--;
+                frac += 1000000000;
+        }
+        time_t t = sec;
+        struct tm tm;
+        assert(gmtime_r(&t, &tm) != NULL);
+        size_t n = strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%S",
+                            &tm);
+        if (precision > 0) {
+                char frac_str[16];
+                snprintf(frac_str, sizeof(frac_str), "%09" PRId64, frac);
+                expected[n++] = '.';
+                memcpy(expected + n, frac_str, precision);
+                n += precision;
+        }
+        expected[n++] = 'Z';
+        size_t len = jsonsink_format_timestamp_ns(buf, ns, precision);
+        assert(len == n && !memcmp(buf, expected, len));
+}
+
+void
+test_timestamp(void)
+{
+        char buf[JSONSINK_FORMAT_TIMESTAMP_MAXLEN];
+        uint64_t x = 1;
+        unsigned int i;
+        size_t len;
+
+        len = jsonsink_format_timestamp_ns(buf, 0, 0);
+        assert(len == 20 && !memcmp(buf, "1970-01-01T00:00:00Z", len));
+        len = jsonsink_format_timestamp_ns(buf, -1, 9);
+        assert(len == 30 &&
+               !memcmp(buf, "1969-12-31T23:59:59.999999999Z", len));
+        len = jsonsink_format_timestamp_ns(buf, 951782400999999999, 3);
+        assert(len == 24 && !memcmp(buf, "2000-02-29T00:00:00.999Z", len));
+        len = jsonsink_format_timestamp_ns(buf, INT64_MIN, 9);
+        assert(len == 30 &&
+               !memcmp(buf, "1677-09-21T00:12:43.145224192Z", len));
+        len = jsonsink_format_timestamp_ns(buf, INT64_MAX, 9);
+        assert(len == 30 &&
+               !memcmp(buf, "2262-04-11T23:47:16.854775807Z", len));
+
+        /* xorshift64 */
+        for (i = 0; i < 100000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                /* close timestamps reuse the cached prefix */
+                int64_t ns = (int64_t)x >> (x & 31);
+                check_timestamp(ns, i % 10);
+                check_timestamp(ns + (x & 0xffff) * 1000, i % 10);
+        }
+}
+
+static void
+check_ipv6(const uint8_t *a)
+{
+        char buf[JSONSINK_FORMAT_IPV6_MAXLEN];
+        char expected[INET6_ADDRSTRLEN];
+        assert(inet_ntop(AF_INET6, a, expected, sizeof(expected)) != NULL);
+        size_t len = jsonsink_format_ipv6(buf, a);
+        assert(len == strlen(expected) && !memcmp(buf, expected, len));
+}
+
+void
+test_ids(void)
+{
+        char buf[64];
+        char expected[64];
+        uint8_t a[16];
+        uint64_t x = 1;
+        unsigned int i;
+        unsigned int j;
+        size_t len;
+        int n;
+
+        /* every run of zero fields */
+        for (i = 0; i < 256; i++) {
+                for (j = 0; j < 8; j++) {
+                        a[j * 2] = (i >> j) & 1 ? 0 : j + 1;
+                        a[j * 2 + 1] = 0;
+                }
+                check_ipv6(a);
+        }
+        memset(a, 0, sizeof(a));
+        check_ipv6(a);
+        a[15] = 1;
+        check_ipv6(a); /* ::1 */
+        a[10] = a[11] = 0xff;
+        check_ipv6(a); /* ::ffff:0.0.0.1 */
+        a[10] = 0xfe;
+        check_ipv6(a);
+        a[10] = a[11] = 0;
+        a[12] = 192;
+        check_ipv6(a); /* ::192.0.0.1 */
+
+        for (i = 0; i < 100000; i++) {
+                for (j = 0; j < 16; j += 8) {
+                        x ^= x << 13;
+                        x ^= x >> 7;
+                        x ^= x << 17;
+                        memcpy(a + j, &x, 8);
+                }
+                /* zero some of the fields */
+                for (j = 0; j < 8; j++) {
+                        if ((x >> (j * 2) & 3) != 0) {
+                                a[j * 2] = a[j * 2 + 1] = 0;
+                        }
+                        /* short fields */
+                        if ((x >> (j + 16) & 1) != 0) {
+                                a[j * 2] = 0;
+                        }
+                }
+                check_ipv6(a);
+
+                assert(inet_ntop(AF_INET, a, expected, sizeof(expected)) !=
+                       NULL);
+                len = jsonsink_format_ipv4(buf, a);
+                assert(len == strlen(expected) &&
+                       !memcmp(buf, expected, len));
+
+                n = snprintf(expected, sizeof(expected),
+                             "%02x%02x%02x%02x-%02x%02x-%02x%02x-"
+                             "%02x%02x-%02x%02x%02x%02x%02x%02x",
+                             a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7],
+                             a[8], a[9], a[10], a[11], a[12], a[13], a[14],
+                             a[15]);
+                len = jsonsink_format_uuid(buf, a);
+                assert(len == (size_t)n && !memcmp(buf, expected, len));
+
+                n = snprintf(expected, sizeof(expected),
+                             "%02x:%02x:%02x:%02x:%02x:%02x", a[0], a[1],
+                             a[2], a[3], a[4], a[5]);
+                len = jsonsink_format_mac(buf, a);
+                assert(len == (size_t)n && !memcmp(buf, expected, len));
+        }
+}
+
+/*
+ * emit_numbers: add the numbers either with the array emitters or with
+ * a loop of the single value functions, surrounded by other values to
+ * check the commas.
+ */
+
+static void
+emit_numbers(struct jsonsink *s, int type, const void *values, size_t n,
+             bool batch)
+{
+        char tmp[JSONSINK_FORMAT_DOUBLE_MAXLEN];
+        size_t i;
+
+        jsonsink_array_start(s);
+        jsonsink_add_uint32(s, 1);
+        if (batch) {
+                switch (type) {
+                case 0:
+                        jsonsink_add_uint32_array(s, values, n);
+                        break;
+                case 1:
+                        jsonsink_add_int64_array(s, values, n);
+                        break;
+                case 2:
+                        jsonsink_add_float_array(s, values, n);
+                        break;
+                case 3:
+                        jsonsink_add_double_array(s, values, n);
+                        break;
+                }
+        } else {
+                jsonsink_array_start(s);
+                for (i = 0; i < n; i++) {
+                        switch (type) {
+                        case 0:
+                                jsonsink_add_uint32(
+                                        s, ((const uint32_t *)values)[i]);
+                                break;
+                        case 1:
+                                jsonsink_add_int64(
+                                        s, ((const int64_t *)values)[i]);
+                                break;
+                        case 2:
+                                jsonsink_add_float(
+                                        s, ((const float *)values)[i]);
+                                break;
+                        case 3:
+                                /* not jsonsink_add_double */
+                                jsonsink_add_serialized_value(
+                                        s, tmp,
+                                        jsonsink_format_double(
+                                                tmp, ((const double *)
+                                                              values)[i]));
+                                break;
+                        }
+                }
+                jsonsink_array_end(s);
+        }
+        jsonsink_add_uint32(s, 2);
+        jsonsink_array_end(s);
+}
+
+void
+test_number_arrays(void)
+{
+        static uint32_t u32[100];
+        static int64_t i64[100];
+        static float f32[100];
+        static double f64[100];
+        const void *values[] = {u32, i64, f32, f64};
+        static const size_t ns[] = {0, 1, 2, 3, 10, 100};
+        static char expected[4096];
+        static char buf[4096];
+        uint64_t x = 1;
+        unsigned int i;
+        unsigned int j;
+        int type;
+
+        for (i = 0; i < 100; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                u32[i] = (uint32_t)x >> (x & 31);
+                i64[i] = (int64_t)x >> (x & 63);
+                uint32_t fbits = x >> 32;
+                uint64_t dbits = x;
+                if ((fbits & 0x7f800000) == 0x7f800000) {
+                        fbits ^= 0x40000000; /* avoid nan and inf */
+                }
+                if ((dbits & 0x7ff0000000000000) == 0x7ff0000000000000) {
+                        dbits ^= 0x4000000000000000;
+                }
+                memcpy(&f32[i], &fbits, sizeof(fbits));
+                memcpy(&f64[i], &dbits, sizeof(dbits));
+        }
+        u32[0] = UINT32_MAX;
+        i64[0] = INT64_MIN;
+        f32[0] = -FLT_MIN;
+        f64[0] = -0x1.0000000000001p-1022;
+
+        for (type = 0; type < 4; type++) {
+                for (i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+                        struct jsonsink s;
+                        size_t n = ns[i];
+
+                        jsonsink_init(&s);
+                        jsonsink_set_buffer(&s, expected, sizeof(expected));
+                        emit_numbers(&s, type, values[type], n, false);
+                        assert(jsonsink_error(&s) == JSONSINK_OK);
+                        size_t len = jsonsink_size(&s);
+
+                        /* a large buffer */
+                        jsonsink_init(&s);
+                        jsonsink_set_buffer(&s, buf, sizeof(buf));
+                        emit_numbers(&s, type, values[type], n, true);
+                        assert(jsonsink_error(&s) == JSONSINK_OK);
+                        assert(jsonsink_size(&s) == len);
+                        assert(!memcmp(buf, expected, len));
+
+                        /* size calculation */
+                        jsonsink_init(&s);
+                        emit_numbers(&s, type, values[type], n, true);
+                        assert(jsonsink_error(&s) ==
+                               JSONSINK_ERROR_NO_BUFFER_SPACE);
+                        assert(jsonsink_size(&s) == len);
+
+                        /* small buffers with flush */
+                        for (j = JSONSINK_MAX_RESERVATION / 2;
+                             j <= JSONSINK_MAX_RESERVATION; j++) {
+                                struct sink sink;
+                                char sbuf[JSONSINK_MAX_RESERVATION];
+                                sink.fp = fmemopen(buf, sizeof(buf), "w");
+                                assert(sink.fp != NULL);
+                                jsonsink_init(&sink.s);
+                                jsonsink_set_buffer(&sink.s, sbuf, j);
+                                sink.s.flush = flush;
+                                emit_numbers(&sink.s, type, values[type], n,
+                                             true);
+                                jsonsink_flush(&sink.s, 0);
+                                assert(jsonsink_error(&sink.s) ==
+                                       JSONSINK_OK);
+                                assert(ftell(sink.fp) == (long)len);
+                                fclose(sink.fp);
+                                assert(!memcmp(buf, expected, len));
+                        }
+                }
+        }
+}
+
+/*
+ * significant_digits: extract the significant digits of a number,
+ * without leading and trailing zeros.
+ */
+
+static void
+significant_digits(const char *cp, char *out)
+{
+        char *dp = out;
+
+        for (; *cp != 0 && *cp != 'e'; cp++) {
+                if (*cp < '0' || *cp > '9' || (dp == out && *cp == '0')) {
+                        continue;
+                }
+                *dp++ = *cp;
+        }
+        while (dp > out && dp[-1] == '0') {
+                dp--;
+        }
+        *dp = 0;
+}
+
+static void
+check_format_double(double v)
+{
+        char buf[JSONSINK_FORMAT_DOUBLE_MAXLEN + 1];
+        char expected[32];
+        char d1[32];
+        char d2[32];
+        size_t len;
+        int prec;
+
+        len = jsonsink_format_double(buf, v);
+        assert(len <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        buf[len] = 0;
+        assert(strtod(buf, NULL) == v);
+
+        /*
+         * the shortest correctly rounded representation which rounds
+         * back to the same value.
+         */
+        for (prec = 0; prec < 17; prec++) {
+                snprintf(expected, sizeof(expected), "%.*e", prec, v);
+                if (strtod(expected, NULL) == v) {
+                        break;
+                }
+        }
+        significant_digits(buf, d1);
+        significant_digits(expected, d2);
+        assert(!strcmp(d1, d2));
+}
+
+void
+test_format_double(void)
+{
+        static const double values[] = {
+                0.0,
+                1.0,
+                -1.0,
+                0.1,
+                1.2345,
+                -1.2345,
+                100,
+                123456789012345680,
+                1e21,
+                1e22,
+                1e-6,
+                1e-7,
+                5e-324,
+                2.2250738585072009e-308,
+                2.2250738585072014e-308,
+                1.7976931348623157e308,
+                9007199254740993.0,
+                4294967295.0,
+        };
+        char buf[JSONSINK_FORMAT_DOUBLE_MAXLEN];
+        uint64_t x = 1;
+        unsigned int i;
+
+        for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                check_format_double(values[i]);
+                check_format_double(-values[i]);
+        }
+        assert(jsonsink_format_double(buf, -0.0) == 2 &&
+               !memcmp(buf, "-0", 2));
+        assert(jsonsink_format_double(buf, 1e21) == 5 &&
+               !memcmp(buf, "1e+21", 5));
+        assert(jsonsink_format_double(buf, 1e20) == 21);
+        assert(jsonsink_format_double(buf, 1.5e-7) == 6 &&
+               !memcmp(buf, "1.5e-7", 6));
+        assert(jsonsink_format_double(buf, 0.000015) == 8 &&
+               !memcmp(buf, "0.000015", 8));
+
+        /* xorshift64 */
+        for (i = 0; i < 10000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                double v;
+                memcpy(&v, &x, sizeof(v));
+                if (isnan(v) || isinf(v)) {
+                        continue;
+                }
+                check_format_double(v);
+                check_format_double((double)(int32_t)x / 100000);
+                check_format_double((double)(uint32_t)x);
+        }
+}
+
+static void
+check_format_float(float v)
+{
+        char buf[JSONSINK_FORMAT_FLOAT_MAXLEN + 1];
+        char expected[32];
+        char d1[32];
+        char d2[32];
+        size_t len;
+        int prec;
+
+        len = jsonsink_format_float(buf, v);
+        assert(len <= JSONSINK_FORMAT_FLOAT_MAXLEN);
+        buf[len] = 0;
+        assert(strtof(buf, NULL) == v);
+        for (prec = 0; prec < 9; prec++) {
+                snprintf(expected, sizeof(expected), "%.*e", prec, v);
+                if (strtof(expected, NULL) == v) {
+                        break;
+                }
+        }
+        significant_digits(buf, d1);
+        significant_digits(expected, d2);
+        assert(!strcmp(d1, d2));
+}
+
+void
+test_format_float(void)
+{
+        char buf[JSONSINK_FORMAT_FLOAT_MAXLEN];
+        uint32_t x = 1;
+        unsigned int i;
+
+        assert(jsonsink_format_float(buf, 0.1f) == 3 &&
+               !memcmp(buf, "0.1", 3));
+        assert(jsonsink_format_float(buf, -1.5e-7f) == 7 &&
+               !memcmp(buf, "-1.5e-7", 7));
+        assert(jsonsink_format_float(buf, 16777216.0f) == 8 &&
+               !memcmp(buf, "16777216", 8));
+        assert(jsonsink_format_float(buf, -1e20f) ==
+               JSONSINK_FORMAT_FLOAT_MAXLEN);
+        check_format_float(FLT_MAX);
+        check_format_float(FLT_MIN);
+        check_format_float(FLT_TRUE_MIN);
+        check_format_float(1.0e-44f);
+
+        /* xorshift32 */
+        for (i = 0; i < 10000; i++) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                float v;
+                memcpy(&v, &x, sizeof(v));
+                if (isnan(v) || isinf(v)) {
+                        continue;
+                }
+                check_format_float(v);
+                check_format_float((float)(int32_t)x / 1000);
+        }
+}
+
+static void
+check_double_fixed(double v, unsigned int decimals, const char *expected)
+{
+        char buf[JSONSINK_FORMAT_DOUBLE_MAXLEN + 1];
+        size_t len = jsonsink_format_double_fixed(buf, v, decimals);
+        assert(len <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        buf[len] = 0;
+        assert(!strcmp(buf, expected));
+}
+
+static void
+check_double_sig(double v, unsigned int digits, const char *expected)
+{
+        char buf[JSONSINK_FORMAT_DOUBLE_MAXLEN + 1];
+        size_t len = jsonsink_format_double_sig(buf, v, digits);
+        assert(len <= JSONSINK_FORMAT_DOUBLE_MAXLEN);
+        buf[len] = 0;
+        assert(!strcmp(buf, expected));
+}
+
+void
+test_format_double_precision(void)
+{
+        char expected[64];
+        uint64_t x = 1;
+        unsigned int i;
+
+        check_double_fixed(3.14159, 3, "3.142");
+        check_double_fixed(1.5, 3, "1.5");
+        check_double_fixed(-0.0004, 3, "0");
+        check_double_fixed(-0.0005, 3, "-0.001");
+        check_double_fixed(0.125, 2, "0.12"); /* a tie */
+        check_double_fixed(0.375, 2, "0.38"); /* a tie */
+        check_double_fixed(2.675, 2, "2.67"); /* 2.67499999... */
+        check_double_fixed(1e-7, 7, "0.0000001");
+        check_double_fixed(123456789.0, 2, "123456789");
+        check_double_fixed(0x1p55, 1, "36028797018963968");
+        check_double_fixed(1e300, 3, "1e+300");
+        check_double_sig(3.14159, 3, "3.14");
+        check_double_sig(123456, 2, "120000");
+        check_double_sig(0.000123456, 2, "0.00012");
+        check_double_sig(0.125, 2, "0.12"); /* a tie */
+        check_double_sig(1.25e-10, 2, "1.3e-10"); /* 1.2500000000000001e-10 */
+        check_double_sig(0.15, 1, "0.1"); /* 0.1499999... */
+        check_double_sig(9.99, 2, "10");
+        check_double_sig(-1e300 / 3, 4, "-3.333e+299");
+        check_double_sig(0.1, 17, "0.1");
+
+        /* compare with printf */
+        for (i = 0; i < 10000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                double v = (double)(int32_t)x / 1000 / (1 << (x >> 60));
+                unsigned int decimals = (x >> 32) % 10;
+                char *cp;
+
+                snprintf(expected, sizeof(expected), "%.*f", decimals, v);
+                if (strchr(expected, '.') != NULL) {
+                        cp = expected + strlen(expected);
+                        while (cp[-1] == '0') {
+                                cp--;
+                        }
+                        if (cp[-1] == '.') {
+                                cp--;
+                        }
+                        *cp = 0;
+                }
+                if (!strcmp(expected, "-0")) {
+                        strcpy(expected, "0");
+                }
+                check_double_fixed(v, decimals, expected);
+        }
+}
+
 int
 main(int argc, char **argv)
 {
+        test_format_integers();
+        test_format_decimal();
+        test_format_double();
+        test_format_float();
+        test_format_double_precision();
+        test_number_arrays();
+        test_double_cache();
+        test_timestamp();
+        test_ids();
+        test_escape_profiles();
+        test_untrusted_string_error();
+        test_intern_table();
+        test_reserve_buffer_upto();
+        test_binary_encoders();
+        test_base64_fd_error();
+        test_fd_sink();
+        test_sg_sink();
+        test_write_direct();
+        test_mmap_sink();
+#if defined(__linux__)
+        test_uring_sink();
+        test_uring_direct();
+        test_ring_sink();
+#endif
         test_with_static_buffer();
 }